@@ -0,0 +1,221 @@
+"""
+Converts a data_ready2 device folder (metadata.json + xy_train.bin) into the
+self-describing v2 container read by the device (see include/DatasetFormat.h).
+
+    python convert_dataset.py data_ready2/1
+    python convert_dataset.py data_ready2/1 --out xy_train.bin --stats
+    python convert_dataset.py data_ready2/1 --out xy_train.bin --quantize int8
+    python convert_dataset.py data_ready2/1 --out xy_train.bin --stats --test-out xy_test.bin
+
+The output replaces xy_train.bin on the device, metadata.json is no longer needed.
+With --test-out a seeded share of the rows (--test-fraction) goes to a second
+container instead, with the same columns, quantization and stats as the training
+one. Uploaded as /xy_test.bin it is what the device compares the quantized model on.
+"""
+import argparse
+import json
+import math
+import os
+import random
+import struct
+
+DATASET_V2_MAGIC = 0x32445441  # "ATD2"
+DATASET_V2_VERSION = 2
+DATASET_V2_NO_LABEL = 0xFF
+DATASET_V2_FLAG_STATS = 0x01
+
+HEADER_FORMAT = "<IHHIHHHHBBHII"
+COLUMN_FORMAT = "<BBHff"
+
+# Must match ColumnType in include/DatasetDecoder.h
+COLUMN_TYPES = {
+    "float32": (0, "<f", 4),
+    "int32": (1, "<i", 4),
+    "uint8": (2, "<B", 1),
+    "int8": (3, "<b", 1),
+    "int16": (4, "<h", 2),
+}
+
+
+def load_metadata(path):
+    with open(path, "r") as f:
+        return json.load(f)
+
+
+def class_mapper(meta):
+    """Returns stored label -> 0-based class index, mirroring the device's old lookup."""
+    if "label_map" in meta:
+        # Rows were already written with the encoded label (1..N, 0 = no label)
+        classes = len(meta["label_map"])
+        return lambda raw: raw - 1 if 1 <= raw <= classes else DATASET_V2_NO_LABEL
+    mapping = {int(v): i for i, v in enumerate(meta.get("label_values", []))}
+    return lambda raw: mapping.get(raw, DATASET_V2_NO_LABEL)
+
+
+def read_rows(path, row_size):
+    with open(path, "rb") as f:
+        while True:
+            row = f.read(row_size)
+            if len(row) < row_size:
+                return
+            yield row
+
+
+def split_rows(path, row_size, test_fraction, seed):
+    """Yields (row, held_out), one seeded draw per row so every pass over the file splits it alike."""
+    draw = random.Random(seed)
+    for row in read_rows(path, row_size):
+        yield row, test_fraction > 0 and draw.random() < test_fraction
+
+
+def feature_ranges(bin_path, row_size, feature_fmts, test_fraction=0.0, seed=0):
+    """Per-feature min, max, mean and std over the finite values of the training rows."""
+    n = len(feature_fmts)
+    lo = [math.inf] * n
+    hi = [-math.inf] * n
+    sums = [0.0] * n
+    squares = [0.0] * n
+    counts = [0] * n
+    for row, held_out in split_rows(bin_path, row_size, test_fraction, seed):
+        if held_out:
+            continue
+        for i, (off, fmt, _) in enumerate(feature_fmts):
+            v = struct.unpack_from(fmt, row, off)[0]
+            if math.isfinite(v):
+                lo[i] = min(lo[i], v)
+                hi[i] = max(hi[i], v)
+                sums[i] += v
+                squares[i] += v * v
+                counts[i] += 1
+    mean = [s / max(c, 1) for s, c in zip(sums, counts)]
+    std = [math.sqrt(max(q / max(c, 1) - m * m, 0.0)) for q, c, m in zip(squares, counts, mean)]
+    lo = [v if math.isfinite(v) else 0.0 for v in lo]
+    hi = [v if math.isfinite(v) else 0.0 for v in hi]
+    return lo, hi, mean, std
+
+
+def quantizer(lo, hi, bits):
+    """Affine int8/int16 mapping covering [lo, hi]; value = (raw - zero_point) * scale."""
+    qmin, qmax = -(1 << (bits - 1)), (1 << (bits - 1)) - 1
+    scale = (hi - lo) / (qmax - qmin) if hi > lo else 1.0
+    zero_point = qmin - lo / scale
+
+    def quantize(v):
+        if not math.isfinite(v):
+            v = 0.0
+        return max(qmin, min(qmax, int(round(v / scale + zero_point))))
+
+    return scale, zero_point, quantize
+
+
+def convert(meta_path, bin_path, out_path, with_stats, quantize=None, test_path=None, test_fraction=0.2, seed=10):
+    meta = load_metadata(meta_path)
+    label_name = meta.get("label_column", "activityID")
+    schema = meta["schema"]
+    row_size = sum(c["bytes"] for c in schema)
+
+    label = next((c for c in schema if c["name"] == label_name), None)
+    if label is None:
+        raise SystemExit("Label column '%s' not found in schema" % label_name)
+    features = [c for c in schema if c["name"] not in (label_name, "timestamp")]
+    classes = len(meta.get("label_values", [])) or len(meta.get("label_map", {}))
+    to_class = class_mapper(meta)
+
+    label_fmt = COLUMN_TYPES[label["type"]][1]
+    feature_fmts = [(c["offset"], COLUMN_TYPES[c["type"]][1], c["bytes"]) for c in features]
+    if not test_path:
+        test_fraction = 0.0
+    lo, hi, mean, std = feature_ranges(bin_path, row_size, feature_fmts, test_fraction, seed) if (with_stats or quantize) else (None,) * 4
+
+    # Output row: class index (uint8) followed by one value per feature, float columns quantized on request
+    columns = []
+    encoders = []
+    offset = 1
+    for i, c in enumerate(features):
+        if quantize and c["type"] == "float32":
+            bits = 8 if quantize == "int8" else 16
+            scale, zero_point, q = quantizer(lo[i], hi[i], bits)
+            fmt = "<b" if bits == 8 else "<h"
+            columns.append((COLUMN_TYPES[quantize][0], offset, scale, zero_point))
+            encoders.append((fmt, q))
+            offset += bits // 8
+        else:
+            columns.append((COLUMN_TYPES[c["type"]][0], offset, 1.0, 0.0))
+            encoders.append(None)
+            offset += c["bytes"]
+    out_row_size = offset
+
+    header_bytes = struct.calcsize(HEADER_FORMAT) + len(columns) * struct.calcsize(COLUMN_FORMAT)
+    max_error = 0.0
+
+    def finish(dst, rows):
+        flags = 0
+        footer_offset = 0
+        if with_stats and rows > 0:
+            flags |= DATASET_V2_FLAG_STATS
+            footer_offset = header_bytes + rows * out_row_size
+            dst.write(struct.pack("<%df" % len(mean), *mean))
+            dst.write(struct.pack("<%df" % len(std), *std))
+
+        dst.seek(0)
+        dst.write(struct.pack(HEADER_FORMAT, DATASET_V2_MAGIC, DATASET_V2_VERSION, header_bytes, rows,
+                              len(features), classes, out_row_size, 0, COLUMN_TYPES["uint8"][0], flags, 0,
+                              footer_offset, 0))
+        for type_id, off, scale, zero_point in columns:
+            dst.write(struct.pack(COLUMN_FORMAT, type_id, 0, off, scale, zero_point))
+
+    outputs = [(out_path, [0])]
+    if test_path:
+        outputs.append((test_path, [0]))
+    files = [open(path, "wb") for path, _ in outputs]
+    try:
+        for dst in files:
+            dst.write(b"\0" * header_bytes)
+        for row, held_out in split_rows(bin_path, row_size, test_fraction, seed):
+            raw_label = struct.unpack_from(label_fmt, row, label["offset"])[0]
+            out = bytearray([to_class(raw_label)])
+            for i, (off, fmt, size) in enumerate(feature_fmts):
+                if encoders[i] is None:
+                    out += row[off:off + size]
+                    continue
+                out_fmt, q = encoders[i]
+                v = struct.unpack_from(fmt, row, off)[0]
+                raw = q(v)
+                out += struct.pack(out_fmt, raw)
+                if math.isfinite(v):
+                    max_error = max(max_error, abs((raw - columns[i][3]) * columns[i][2] - v))
+            target = 1 if held_out else 0
+            files[target].write(out)
+            outputs[target][1][0] += 1
+        for dst, (_, rows) in zip(files, outputs):
+            finish(dst, rows[0])
+    finally:
+        for dst in files:
+            dst.close()
+
+    for path, rows in outputs:
+        print("%s: %d rows, %d features, %d classes, %d -> %d bytes/row -> %s (%d bytes)"
+              % (bin_path, rows[0], len(features), classes, row_size, out_row_size, path, os.path.getsize(path)))
+    if quantize:
+        print("%s max absolute dequantization error: %g" % (quantize, max_error))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert xy_train.bin + metadata.json into the v2 dataset container")
+    parser.add_argument("folder", help="device folder holding metadata.json and xy_train.bin (e.g. data_ready2/1)")
+    parser.add_argument("--out", help="output file (default: <folder>/xy_train_v2.bin)")
+    parser.add_argument("--stats", action="store_true", help="append the per-feature mean/std footer")
+    parser.add_argument("--quantize", choices=["int8", "int16"], help="store float features quantized with per-column scale/zero point")
+    parser.add_argument("--test-out", help="also write held-out rows to this file (upload as /xy_test.bin), stats and quantization come from the other rows")
+    parser.add_argument("--test-fraction", type=float, default=0.2, help="share of the rows held out with --test-out (default: 0.2)")
+    parser.add_argument("--seed", type=int, default=10, help="seed of the held-out split (default: 10)")
+    args = parser.parse_args()
+
+    meta_path = os.path.join(args.folder, "metadata.json")
+    bin_path = os.path.join(args.folder, "xy_train.bin")
+    out_path = args.out or os.path.join(args.folder, "xy_train_v2.bin")
+    convert(meta_path, bin_path, out_path, args.stats, args.quantize, args.test_out, args.test_fraction, args.seed)
+
+
+if __name__ == "__main__":
+    main()
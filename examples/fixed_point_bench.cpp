@@ -0,0 +1,99 @@
+/*
+Device benchmark for the fixed point backend (flash to an ESP32 and open the serial monitor).
+
+Times one training step of the device network (31-144-72-36-18, tanh/softmax as in main.cpp) with the float
+BatchTrainer and with FixedPointTrainer, per row and with batches of 8, on random rows. It also times the
+144x72 dot products on their own with int64 accumulators (what FixedPointTrainer used before) and with the
+int32 accumulators it uses now, which is the part the Xtensa core has no 64-bit multiply-accumulate for.
+The host benchmark (host_bench_fixed.cpp) cannot show this, x86 adds int64 as fast as int32.
+*/
+
+#include <Arduino.h>
+#include "FixedPoint.h"
+
+static const unsigned int TOPOLOGY[] = {31, 144, 72, 36, 18};
+static const uint8_t ACTIVATIONS[] = {TrainActivation_TANH, TrainActivation_TANH, TrainActivation_TANH, TrainActivation_SOFTMAX};
+static const int LAYERS = 4;
+static const int STEPS = 200;
+
+static TrainLayer layers[LAYERS];
+
+void buildNetwork() {
+    for (int l = 0; l < LAYERS; l++) {
+        float** weights = new float*[TOPOLOGY[l + 1]];
+        for (unsigned int i = 0; i < TOPOLOGY[l + 1]; i++) {
+            weights[i] = new float[TOPOLOGY[l]];
+            for (unsigned int j = 0; j < TOPOLOGY[l]; j++) weights[i][j] = (random(-1000, 1000) / 1000.0f) / sqrtf(TOPOLOGY[l]);
+        }
+        float* bias = new float[TOPOLOGY[l + 1]]();
+        layers[l] = {weights, bias, TOPOLOGY[l], TOPOLOGY[l + 1], ACTIVATIONS[l]};
+    }
+}
+
+template <typename Trainer>
+void timeTrainer(const char* name, unsigned int batchSize) {
+    Trainer trainer(layers, LAYERS, batchSize);
+    if (!trainer.isValid()) {
+        Serial.printf("%-8s batch %u: not enough memory\n", name, batchSize);
+        return;
+    }
+    for (unsigned int b = 0; b < batchSize; b++) {
+        for (unsigned int j = 0; j < TOPOLOGY[0]; j++) trainer.input(b)[j] = random(-1000, 1000) / 100.0f;
+        for (unsigned int k = 0; k < TOPOLOGY[LAYERS]; k++) trainer.target(b)[k] = k == b % TOPOLOGY[LAYERS] ? 1.0f : 0.0f;
+    }
+    unsigned long start = micros();
+    for (int s = 0; s < STEPS; s++) trainer.train(batchSize, 0.01f, 0.01f);
+    unsigned long elapsed = micros() - start;
+    Serial.printf("%-8s batch %u: %8.1f us/row\n", name, batchSize, (double)elapsed / STEPS / batchSize);
+}
+
+void timeDotProducts() {
+    const unsigned int inputs = 144, outputs = 72;
+    int16_t* w = (int16_t*)malloc(inputs * outputs * sizeof(int16_t));
+    int16_t x[inputs];
+    for (unsigned int k = 0; k < inputs * outputs; k++) w[k] = random(-4096, 4096);
+    for (unsigned int j = 0; j < inputs; j++) x[j] = random(-32768, 32767);
+    volatile int64_t sink64 = 0;
+    volatile int32_t sink32 = 0;
+
+    unsigned long start = micros();
+    for (int s = 0; s < STEPS; s++) {
+        for (unsigned int i = 0; i < outputs; i++) {
+            const int16_t* row = w + i * inputs;
+            int64_t acc = 0;
+            for (unsigned int j = 0; j < inputs; j++) acc += (int32_t)row[j] * x[j];
+            sink64 = sink64 + (acc >> 15);
+        }
+    }
+    unsigned long int64Time = micros() - start;
+
+    int shift = fixedCeilLog2(inputs);
+    start = micros();
+    for (int s = 0; s < STEPS; s++) {
+        for (unsigned int i = 0; i < outputs; i++) {
+            const int16_t* row = w + i * inputs;
+            int32_t acc = 0;
+            for (unsigned int j = 0; j < inputs; j++) acc += ((int32_t)row[j] * x[j]) >> shift;
+            sink32 = sink32 + (acc >> (15 - shift));
+        }
+    }
+    unsigned long int32Time = micros() - start;
+    free(w);
+    Serial.printf("144x72 dot products: int64 %.1f us, int32 %.1f us per layer\n", (double)int64Time / STEPS, (double)int32Time / STEPS);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+    randomSeed(10);
+    buildNetwork();
+    timeDotProducts();
+    timeTrainer<BatchTrainer>("float", 1);
+    timeTrainer<FixedPointTrainer>("Q15", 1);
+    timeTrainer<BatchTrainer>("float", 8);
+    timeTrainer<FixedPointTrainer>("Q15", 8);
+}
+
+void loop() {
+    delay(1000);
+}
@@ -0,0 +1,193 @@
+/*
+Host benchmark for the activation tables (runs on the development machine, not on the ESP32).
+
+First times every exp-based activation with exp()/tanh() and with the ActivationTable lookups on a million
+pre-activations in [-12, 12], and checks the largest error against the bounds in ActivationTable.h.
+Then trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) on a data_ready2 subject with
+BatchTrainer as compiled, and scores the trained network with both the exact and the table forward pass.
+
+Build it twice to compare training with and without the tables:
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_activation.cpp -o /tmp/bench_activation && /tmp/bench_activation [data_ready2/1/xy_train.bin]
+    g++ -O2 -std=c++17 -pthread -Iinclude -DUSE_ACTIVATION_TABLE examples/host_bench_activation.cpp -o /tmp/bench_activation_table && /tmp/bench_activation_table
+*/
+
+#include "host_bench_common.h"
+#include "ActivationTable.h"
+
+static const int EPOCHS = 4;
+static const unsigned int BATCH = 8;
+static const float LEARNING_RATE = 0.02f * 2.83f;
+static const size_t VALUES = 1 << 20;
+
+// Exact activations in float, as BatchTrainer computes them without USE_ACTIVATION_TABLE
+void exactActivate(uint8_t activation, float* v, unsigned int n) {
+    switch (activation) {
+        case TrainActivation_SIGMOID: for (unsigned int i = 0; i < n; i++) v[i] = 1 / (1 + expf(-v[i])); break;
+        case TrainActivation_TANH: for (unsigned int i = 0; i < n; i++) v[i] = tanhf(v[i]); break;
+        case TrainActivation_ELU: for (unsigned int i = 0; i < n; i++) v[i] = v[i] > 0 ? v[i] : TRAIN_ALPHA_ELU * (expf(v[i]) - 1); break;
+        case TrainActivation_SELU:
+            for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_LAMBDA_SELU * (v[i] > 0 ? v[i] : TRAIN_ALPHA_SELU * (expf(v[i]) - 1));
+            break;
+        case TrainActivation_SOFTMAX: {
+            float m = v[0], sum = 0;
+            for (unsigned int i = 1; i < n; i++) if (v[i] > m) m = v[i];
+            for (unsigned int i = 0; i < n; i++) sum += v[i] = expf(v[i] - m);
+            for (unsigned int i = 0; i < n; i++) v[i] /= sum;
+            break;
+        }
+    }
+}
+
+void tableActivate(uint8_t activation, float* v, unsigned int n) {
+    switch (activation) {
+        case TrainActivation_SIGMOID: for (unsigned int i = 0; i < n; i++) v[i] = ActivationTable::sigmoidValue(v[i]); break;
+        case TrainActivation_TANH: for (unsigned int i = 0; i < n; i++) v[i] = ActivationTable::tanhValue(v[i]); break;
+        case TrainActivation_ELU: for (unsigned int i = 0; i < n; i++) v[i] = v[i] > 0 ? v[i] : TRAIN_ALPHA_ELU * (ActivationTable::expNegative(v[i]) - 1); break;
+        case TrainActivation_SELU:
+            for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_LAMBDA_SELU * (v[i] > 0 ? v[i] : TRAIN_ALPHA_SELU * (ActivationTable::expNegative(v[i]) - 1));
+            break;
+        case TrainActivation_SOFTMAX: {
+            float m = v[0], sum = 0;
+            for (unsigned int i = 1; i < n; i++) if (v[i] > m) m = v[i];
+            for (unsigned int i = 0; i < n; i++) sum += v[i] = ActivationTable::expNegative(v[i] - m);
+            for (unsigned int i = 0; i < n; i++) v[i] /= sum;
+            break;
+        }
+    }
+}
+
+// Reference in double
+void referenceActivate(uint8_t activation, const float* x, double* v, unsigned int n) {
+    switch (activation) {
+        case TrainActivation_SIGMOID: for (unsigned int i = 0; i < n; i++) v[i] = 1 / (1 + exp(-(double)x[i])); break;
+        case TrainActivation_TANH: for (unsigned int i = 0; i < n; i++) v[i] = tanh((double)x[i]); break;
+        case TrainActivation_ELU: for (unsigned int i = 0; i < n; i++) v[i] = x[i] > 0 ? x[i] : TRAIN_ALPHA_ELU * (exp((double)x[i]) - 1); break;
+        case TrainActivation_SELU:
+            for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_LAMBDA_SELU * (x[i] > 0 ? x[i] : TRAIN_ALPHA_SELU * (exp((double)x[i]) - 1));
+            break;
+        case TrainActivation_SOFTMAX: {
+            double m = x[0], sum = 0;
+            for (unsigned int i = 1; i < n; i++) if (x[i] > m) m = x[i];
+            for (unsigned int i = 0; i < n; i++) sum += v[i] = exp(x[i] - m);
+            for (unsigned int i = 0; i < n; i++) v[i] /= sum;
+            break;
+        }
+    }
+}
+
+// Class of one row through the network, with the exact or the table activations
+int predict(const Network& net, const float* x, bool table) {
+    float a[144], b[144];
+    memcpy(a, x, FEATURES * sizeof(float));
+    for (int l = 0; l < LAYERS; l++) {
+        const TrainLayer& layer = net.layers[l];
+        for (unsigned int i = 0; i < layer.outputs; i++) {
+            float z = layer.bias[i];
+            for (unsigned int j = 0; j < layer.inputs; j++) z += layer.weights[i][j] * a[j];
+            b[i] = z;
+        }
+        if (table) tableActivate(layer.activation, b, layer.outputs);
+        else exactActivate(layer.activation, b, layer.outputs);
+        memcpy(a, b, layer.outputs * sizeof(float));
+    }
+    return argmax(a);
+}
+
+void benchActivations() {
+    static const uint8_t KINDS[] = {TrainActivation_SIGMOID, TrainActivation_TANH, TrainActivation_ELU, TrainActivation_SELU, TrainActivation_SOFTMAX};
+    static const char* NAMES[] = {"sigmoid", "tanh", "elu", "selu", "softmax"};
+    std::vector<float> inputs(VALUES), values(VALUES);
+    std::vector<double> reference(CLASSES);
+    srand(SEED);
+    for (size_t k = 0; k < VALUES; k++) inputs[k] = ((float)rand() / RAND_MAX - 0.5f) * 24.0f;
+
+    printf("%d table pieces, %zu bytes of tables\n", ACTIVATION_TABLE_INTERVALS, sizeof(ActivationTables));
+    printf("            exact ns   table ns   speedup   max error    bound\n");
+    for (int a = 0; a < 5; a++) {
+        unsigned int n = KINDS[a] == TrainActivation_SOFTMAX ? CLASSES : 1;
+        double ns[2];
+        volatile float sink = 0;
+        for (int table = 0; table < 2; table++) {
+            values = inputs;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t k = 0; k + n <= VALUES; k += n) {
+                if (table) tableActivate(KINDS[a], &values[k], n);
+                else exactActivate(KINDS[a], &values[k], n);
+            }
+            ns[table] = secondsSince(start) * 1e9 / VALUES;
+            sink = sink + values[VALUES / 2];
+        }
+        // values now hold the table results
+        double worst = 0;
+        for (size_t k = 0; k + n <= VALUES; k += n) {
+            referenceActivate(KINDS[a], &inputs[k], reference.data(), n);
+            for (unsigned int i = 0; i < n; i++) worst = fmax(worst, fabs(values[k + i] - reference[i]));
+        }
+        double bound = KINDS[a] == TrainActivation_SIGMOID ? ActivationTable::sigmoidErrorBound()
+                     : KINDS[a] == TrainActivation_TANH ? ActivationTable::tanhErrorBound()
+                     : KINDS[a] == TrainActivation_ELU ? ActivationTable::expUnitErrorBound(TRAIN_ALPHA_ELU)
+                     : KINDS[a] == TrainActivation_SELU ? ActivationTable::expUnitErrorBound(TRAIN_LAMBDA_SELU * TRAIN_ALPHA_SELU)
+                     : ActivationTable::softmaxErrorBound(n);
+        printf("%-10s  %8.2f   %8.2f   %6.2fx   %.3e  %.3e %s\n", NAMES[a], ns[0], ns[1], ns[0] / ns[1], worst, bound, worst <= bound ? "ok" : "EXCEEDED");
+    }
+}
+
+int main(int argc, char** argv) {
+    benchActivations();
+
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    std::vector<uint8_t> data;
+    if (!readRows(path, data)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    static Network net;
+    net.init(SEED);
+    BatchTrainer trainer(net.layers, LAYERS, BATCH);
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, SEED);
+    reader.open(data.data(), data.size());
+    const uint8_t* row;
+    auto start = std::chrono::steady_clock::now();
+    for (int e = 0; e < EPOCHS; e++) {
+        if (e > 0) reader.rewind();
+        unsigned int count = 0;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(count));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(count));
+            if (++count == BATCH) {
+                trainer.train(count, LEARNING_RATE, LEARNING_RATE);
+                count = 0;
+            }
+        }
+    }
+    double trainSeconds = secondsSince(start);
+
+    size_t rows = 0, exactCorrect = 0, tableCorrect = 0, agree = 0;
+    float x[FEATURES];
+    DatasetReader all(ROW_SIZE);
+    all.open(data.data(), data.size());
+    while ((row = all.next()) != nullptr) {
+        int label = decode(plan, row, x);
+        if (label < 0) continue;
+        int exact = predict(net, x, false), table = predict(net, x, true);
+        rows++;
+        exactCorrect += exact == label;
+        tableCorrect += table == label;
+        agree += exact == table;
+    }
+#if defined(USE_ACTIVATION_TABLE)
+    const char* mode = "table";
+#else
+    const char* mode = "exact";
+#endif
+    printf("%s: trained with %s activations, %d epochs, %.2f s/epoch\n", path, mode, EPOCHS, trainSeconds / EPOCHS);
+    printf("accuracy with exact activations %.2f%%, with tables %.2f%%, same class on %.2f%% of rows\n", 100.0 * exactCorrect / rows,
+           100.0 * tableCorrect / rows, 100.0 * agree / rows);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+Host benchmark for mini-batch training (runs on the development machine, not on the ESP32).
+
+Trains the hidden layers of the device network (31-144-72-36-18, tanh/softmax as in main.cpp) with
+BatchTrainer on a shuffled data_ready2 subject, once per batch size. Batch size 1 is the per-row update the
+library's BackProp does; larger batches apply one averaged update per batch with a learning rate raised
+with the batch size. Reports rows/s, weight writes per epoch and accuracy after each epoch.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_batch.cpp -o /tmp/bench_batch && /tmp/bench_batch [data_ready2/1/xy_train.bin]
+*/
+
+#include "host_bench_common.h"
+
+static const int EPOCHS = 8;
+static const float LEARNING_RATE = 0.02f;
+
+float accuracy(BatchTrainer& trainer, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    DatasetReader reader(ROW_SIZE);
+    reader.open(data.data(), data.size());
+    const uint8_t* row;
+    int labels[256];
+    unsigned int count = 0, correct = 0, total = 0;
+    auto flush = [&]() {
+        trainer.forward(count);
+        for (unsigned int b = 0; b < count; b++) correct += argmax(trainer.output(b)) == labels[b];
+        total += count;
+        count = 0;
+    };
+    while ((row = reader.next()) != nullptr) {
+        int label = decode(plan, row, trainer.input(count));
+        if (label < 0) continue;
+        labels[count] = label;
+        if (++count == trainer.getBatchSize()) flush();
+    }
+    if (count > 0) flush();
+    return total == 0 ? 0 : (float)correct / total;
+}
+
+void run(unsigned int batchSize, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    static Network net;
+    net.init(SEED);
+    BatchTrainer trainer(net.layers, LAYERS, batchSize);
+    // Square root scaling keeps the per-row step comparable while the averaged gradient gets less noisy
+    float learningRate = LEARNING_RATE * sqrtf((float)batchSize);
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, SEED);
+    reader.open(data.data(), data.size());
+
+    unsigned long long rows = 0;
+    double seconds = 0;
+    printf("B=%-3u lr=%.3f ", batchSize, learningRate);
+    for (int e = 1; e <= EPOCHS; e++) {
+        if (e > 1) reader.rewind();
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* row;
+        unsigned int count = 0;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(count));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(count));
+            rows++;
+            if (++count == batchSize) {
+                trainer.train(count, learningRate, learningRate);
+                count = 0;
+            }
+        }
+        if (count > 0) trainer.train(count, learningRate, learningRate);
+        seconds += secondsSince(start);
+        printf(" %5.1f", accuracy(trainer, plan, data) * 100);
+        fflush(stdout);
+    }
+    printf("  | %8.0f rows/s  %6.2f M weight writes/epoch\n", rows / seconds, trainer.getWeightWrites() / (double)EPOCHS / 1e6);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    std::vector<uint8_t> data;
+    if (!readRows(path, data)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    printf("%s: %zu rows, accuracy (%%) after each of %d epochs\n", path, data.size() / ROW_SIZE, EPOCHS);
+    const unsigned int batchSizes[] = {1, 4, 8, 16, 32};
+    for (unsigned int b : batchSizes) run(b, plan, data);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+Fixture shared by the host benchmarks that train the device network (31-144-72-36-18, tanh/softmax as in
+main.cpp) on data_ready2 subjects: the topology, the network with its seeded initialization, and reading and
+decoding a subject file. Each benchmark keeps only what it measures.
+*/
+
+#ifndef HOST_BENCH_COMMON_H_
+#define HOST_BENCH_COMMON_H_
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "BatchTrainer.h"
+#include "DatasetReader.h"
+#include "DatasetDecoder.h"
+
+static const int FEATURES = 31;
+static const int ROW_SIZE = 1 + FEATURES * 4;
+static const int CLASSES = 18;
+static const unsigned int TOPOLOGY[] = {FEATURES, 144, 72, 36, CLASSES};
+static const uint8_t ACTIVATIONS[] = {TrainActivation_TANH, TrainActivation_TANH, TrainActivation_TANH, TrainActivation_SOFTMAX};
+static const int LAYERS = 4;
+static const uint32_t SEED = 10;
+
+// Weights of type T with the Layer views a trainer takes
+template <typename T, typename Layer>
+struct NetworkOf {
+    std::vector<std::vector<T>> weights[LAYERS];
+    std::vector<T*> rows[LAYERS];
+    std::vector<T> bias[LAYERS];
+    Layer layers[LAYERS];
+
+    // Uniform weights scaled by 1 / sqrt(inputs), zero biases
+    void init(uint32_t seed) {
+        srand(seed);
+        for (int l = 0; l < LAYERS; l++) {
+            unsigned int in = TOPOLOGY[l], out = TOPOLOGY[l + 1];
+            weights[l].assign(out, std::vector<T>(in));
+            bias[l].assign(out, 0);
+            for (unsigned int i = 0; i < out; i++) {
+                for (unsigned int j = 0; j < in; j++) weights[l][i][j] = ((float)rand() / RAND_MAX - 0.5f) * 2.0f / sqrtf(in);
+            }
+        }
+        bind();
+    }
+
+    // Every weight and bias set to value
+    void fill(T value) {
+        for (int l = 0; l < LAYERS; l++) {
+            weights[l].assign(TOPOLOGY[l + 1], std::vector<T>(TOPOLOGY[l], value));
+            bias[l].assign(TOPOLOGY[l + 1], value);
+        }
+        bind();
+    }
+
+    void copyFrom(const NetworkOf& other) {
+        for (int l = 0; l < LAYERS; l++) {
+            weights[l] = other.weights[l];
+            bias[l] = other.bias[l];
+        }
+        bind();
+    }
+
+    void bind() {
+        for (int l = 0; l < LAYERS; l++) {
+            rows[l].resize(weights[l].size());
+            for (size_t i = 0; i < weights[l].size(); i++) rows[l][i] = weights[l][i].data();
+            layers[l] = {rows[l].data(), bias[l].data(), TOPOLOGY[l], TOPOLOGY[l + 1], ACTIVATIONS[l]};
+        }
+    }
+};
+
+typedef NetworkOf<float, TrainLayer> Network;
+
+// Rows of a subject file decoded once, for the accuracy passes
+struct Subject {
+    std::vector<uint8_t> data;
+    std::vector<float> inputs;
+    std::vector<int> labels;
+};
+
+// Inputs with non-finite values zeroed, returns the class or -1
+int decode(const DecodePlan& plan, const uint8_t* row, float* x) {
+    plan.decodeInputs(row, x);
+    for (int k = 0; k < FEATURES; k++) if (!std::isfinite(x[k])) x[k] = 0;
+    return plan.classIndex(row, CLASSES);
+}
+
+template <typename T>
+int decode(const DecodePlan& plan, const uint8_t* row, T* x) {
+    float v[FEATURES];
+    int label = decode(plan, row, v);
+    for (int k = 0; k < FEATURES; k++) x[k] = v[k];
+    return label;
+}
+
+template <typename T>
+void oneHot(int label, T* y) {
+    for (int k = 0; k < CLASSES; k++) y[k] = k == label ? 1 : 0;
+}
+
+template <typename T>
+int argmax(const T* v) {
+    int best = 0;
+    for (int k = 1; k < CLASSES; k++) if (v[k] > v[best]) best = k;
+    return best;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Layout of the data_ready2 files: the encoded class, then the features as float32
+void subjectPlan(DecodePlan& plan) {
+    plan.begin(FEATURES);
+    plan.setLabel(ColumnType_INT8, 0);
+    for (int k = 0; k < FEATURES; k++) plan.addInput(ColumnType_FLOAT32, 1 + 4 * k);
+    plan.finalize(ROW_SIZE, FEATURES);
+    plan.labelMode = LabelMode_ENCODED;
+}
+
+// Whole rows of path, false when it can't be opened
+bool readRows(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) return false;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    data.resize(data.size() - data.size() % ROW_SIZE);
+    return true;
+}
+
+bool loadSubject(const char* path, const DecodePlan& plan, Subject& subject) {
+    if (!readRows(path, subject.data)) return false;
+    float x[FEATURES];
+    DatasetReader all(ROW_SIZE);
+    all.open(subject.data.data(), subject.data.size());
+    const uint8_t* row;
+    while ((row = all.next()) != nullptr) {
+        int label = decode(plan, row, x);
+        if (label < 0) continue;
+        subject.inputs.insert(subject.inputs.end(), x, x + FEATURES);
+        subject.labels.push_back(label);
+    }
+    return true;
+}
+
+// Percentage of the labelled rows of subject the trainer's network classifies right
+double accuracy(BatchTrainer& trainer, const Subject& subject) {
+    size_t correct = 0;
+    for (size_t i = 0; i < subject.labels.size(); i++) {
+        memcpy(trainer.input(0), &subject.inputs[i * FEATURES], FEATURES * sizeof(float));
+        trainer.forward(1);
+        correct += argmax(trainer.output(0)) == subject.labels[i];
+    }
+    return subject.labels.empty() ? 0 : 100.0 * correct / subject.labels.size();
+}
+
+#endif /* HOST_BENCH_COMMON_H_ */
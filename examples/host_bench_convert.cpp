@@ -0,0 +1,95 @@
+/*
+Host benchmark for the streaming dataset converters (runs on the development machine, not on the ESP32).
+
+Packs datasets/x_train_0.csv + y_train_0.csv into a v2 binary container, unpacks it back into an x/y CSV
+pair with convertDatasetToCsv, and checks that every value survives the round trip.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_convert.cpp -o /tmp/bench_convert && /tmp/bench_convert
+*/
+
+#include <cstdio>
+#include <vector>
+#include "DatasetConvert.h"
+
+static const char* X_PATH = "datasets/x_train_0.csv";
+static const char* Y_PATH = "datasets/y_train_0.csv";
+static const char* BIN_PATH = "/tmp/bench_convert.bin";
+static const char* X_OUT_PATH = "/tmp/bench_convert_x.csv";
+static const char* Y_OUT_PATH = "/tmp/bench_convert_y.csv";
+
+void report(const char* name, const DatasetConvertStats& stats) {
+    printf("%-14s %8llu rows  %6.2f MB in  %6.2f MB out  %7.1f MB/s\n", name, stats.rows,
+        stats.bytesIn / 1048576.0, stats.bytesOut / 1048576.0, stats.bytesPerSecond() / 1048576.0);
+}
+
+// Compares two CSV files value by value after parsing both as float
+bool sameValues(const char* a, const char* b, unsigned long long& values) {
+    CsvReader ra, rb;
+    if (!ra.open(a) || !rb.open(b)) return false;
+    float va[DATASET_CONVERT_MAX_FEATURES], vb[DATASET_CONVERT_MAX_FEATURES];
+    char *la, *lb;
+    while ((la = ra.nextLine()) != nullptr) {
+        if ((lb = rb.nextLine()) == nullptr) return *la == '\0';
+        int na = parseCsvFields(la, va, DATASET_CONVERT_MAX_FEATURES);
+        int nb = parseCsvFields(lb, vb, DATASET_CONVERT_MAX_FEATURES);
+        if (na != nb) return false;
+        for (int i = 0; i < na; i++, values++) {
+            if (va[i] != vb[i] && !(va[i] != va[i] && vb[i] != vb[i])) return false;
+        }
+    }
+    return rb.nextLine() == nullptr;
+}
+
+int main() {
+    DatasetConvertStats packStats;
+    {
+        CsvReader xIn, yIn;
+        BlockWriter out;
+        if (!xIn.open(X_PATH) || !yIn.open(Y_PATH) || !out.open(fopen(BIN_PATH, "wb"))) {
+            printf("run from the repository root, %s not found\n", X_PATH);
+            return 1;
+        }
+        if (!convertCsvToDataset(xIn, yIn, out, packStats)) {
+            printf("CSV -> binary failed\n");
+            return 1;
+        }
+    }
+    report("CSV -> binary", packStats);
+
+    DatasetConvertStats unpackStats;
+    {
+        FILE* f = fopen(BIN_PATH, "rb");
+        DatasetV2Header header;
+        std::vector<uint8_t> meta;
+        if (f == nullptr || fread(&header, sizeof(header), 1, f) != 1 || !validDatasetV2Header(header, (size_t)-1)) {
+            printf("bad v2 header\n");
+            return 1;
+        }
+        meta.resize(header.headerBytes - sizeof(header));
+        fread(meta.data(), 1, meta.size(), f);
+        fclose(f);
+        DecodePlan plan;
+        buildDatasetV2Plan(header, (const DatasetV2Column*)meta.data(), plan, header.featureCount);
+
+        DatasetReader reader(header.rowSize, DATASET_READER_BLOCK_SIZE, true);
+        BlockWriter xOut, yOut;
+        reader.open(BIN_PATH, header.headerBytes, datasetV2DataBytes(header));
+        xOut.open(fopen(X_OUT_PATH, "wb"));
+        yOut.open(fopen(Y_OUT_PATH, "wb"));
+        if (!convertDatasetToCsv(reader, plan, header.classCount, xOut, yOut, unpackStats)) {
+            printf("binary -> CSV failed\n");
+            return 1;
+        }
+    }
+    report("binary -> CSV", unpackStats);
+
+    unsigned long long values = 0;
+    bool xSame = sameValues(X_PATH, X_OUT_PATH, values);
+    bool ySame = sameValues(Y_PATH, Y_OUT_PATH, values);
+    printf("round trip     %s (%llu values compared as float)\n", xSame && ySame ? "identical" : "MISMATCH", values);
+
+    remove(BIN_PATH);
+    remove(X_OUT_PATH);
+    remove(Y_OUT_PATH);
+    return xSame && ySame ? 0 : 1;
+}
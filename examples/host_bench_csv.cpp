@@ -0,0 +1,134 @@
+/*
+Host benchmark for the DATASET_ORIGINAL CSV path (runs on the development machine, not on the ESP32).
+
+Parses every datasets/x_train_*.csv / y_train_*.csv pair twice: once the way trainModelFromOriginalDataset
+used to (byte-wise readStringUntil into a growing string, one substring + strtof per value) and once with
+CsvReader (block reads into a fixed buffer, in-place split, parseCsvNumber). Reports throughput and the
+largest difference between the two parsers.
+
+    g++ -O2 -std=c++17 -Iinclude examples/host_bench_csv.cpp -o /tmp/bench_csv && /tmp/bench_csv
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "CsvReader.h"
+
+static const int INPUTS = 32;
+static const int OUTPUTS = 18;
+static const int FILES = 32;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Stream::readStringUntil reads one byte at a time and appends to a String
+bool readStringUntil(FILE* f, std::string& line) {
+    line.clear();
+    int c;
+    bool any = false;
+    while ((c = fgetc(f)) != EOF) {
+        any = true;
+        if (c == '\n') break;
+        line += (char)c;
+    }
+    return any;
+}
+
+int parseLegacy(const std::string& line, float* out, int maxFields) {
+    int j = 0;
+    size_t startPos = 0;
+    size_t commaPos = line.find(',');
+    while (commaPos != std::string::npos && j < maxFields) {
+        std::string valueStr = line.substr(startPos, commaPos - startPos);
+        out[j++] = strtof(valueStr.c_str(), NULL);
+        startPos = commaPos + 1;
+        commaPos = line.find(',', startPos);
+    }
+    if (startPos < line.length() && j < maxFields) {
+        std::string valueStr = line.substr(startPos);
+        out[j++] = strtof(valueStr.c_str(), NULL);
+    }
+    return j;
+}
+
+int main() {
+    std::vector<std::string> xs, ys;
+    char path[64];
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "datasets/x_train_%d.csv", i);
+        FILE* f = fopen(path, "rb");
+        if (f == nullptr) continue;
+        fclose(f);
+        xs.push_back(path);
+        snprintf(path, sizeof(path), "datasets/y_train_%d.csv", i);
+        ys.push_back(path);
+    }
+    if (xs.empty()) {
+        printf("run from the repository root, datasets/x_train_*.csv not found\n");
+        return 1;
+    }
+
+    float x[INPUTS], y[OUTPUTS];
+    volatile double sink = 0;
+    unsigned long long rows = 0, bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < xs.size(); i++) {
+        FILE* xf = fopen(xs[i].c_str(), "rb");
+        FILE* yf = fopen(ys[i].c_str(), "rb");
+        std::string xLine, yLine;
+        while (readStringUntil(xf, xLine) && readStringUntil(yf, yLine)) {
+            if (xLine.empty() || yLine.empty()) break;
+            sink += parseLegacy(xLine, x, INPUTS) + parseLegacy(yLine, y, OUTPUTS) + x[0];
+            bytes += xLine.size() + yLine.size() + 2;
+            rows++;
+        }
+        fclose(xf);
+        fclose(yf);
+    }
+    double legacy = secondsSince(start);
+
+    unsigned long long fastRows = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < xs.size(); i++) {
+        CsvReader xr, yr;
+        xr.open(xs[i].c_str());
+        yr.open(ys[i].c_str());
+        char *xLine, *yLine;
+        while ((xLine = xr.nextLine()) != nullptr && (yLine = yr.nextLine()) != nullptr) {
+            if (*xLine == '\0' || *yLine == '\0') break;
+            sink += parseCsvFields(xLine, x, INPUTS) + parseCsvFields(yLine, y, OUTPUTS) + x[0];
+            fastRows++;
+        }
+    }
+    double fast = secondsSince(start);
+
+    // Accuracy of parseCsvNumber against strtof on every x value
+    double maxRelError = 0;
+    unsigned long long values = 0, mismatches = 0;
+    for (size_t i = 0; i < xs.size(); i++) {
+        CsvReader xr;
+        xr.open(xs[i].c_str());
+        char* line;
+        while ((line = xr.nextLine()) != nullptr) {
+            float a[INPUTS], b[INPUTS];
+            int n = parseCsvFields(line, a, INPUTS);
+            parseLegacy(line, b, INPUTS);
+            for (int k = 0; k < n; k++, values++) {
+                if (a[k] != b[k]) mismatches++;
+                if (b[k] != 0) maxRelError = fmax(maxRelError, fabs((a[k] - b[k]) / b[k]));
+            }
+        }
+    }
+
+    double mb = bytes / 1048576.0;
+    printf("%zu file pairs, %llu rows, %.1f MB\n", xs.size(), rows, mb);
+    printf("readStringUntil + substring : %8.1f MB/s %10.0f rows/s\n", mb / legacy, rows / legacy);
+    printf("CsvReader                   : %8.1f MB/s %10.0f rows/s\n", mb / fast, fastRows / fast);
+    printf("speedup                     : %.1fx\n", legacy / fast);
+    printf("values differing from strtof: %llu of %llu, max relative error %.2g\n", mismatches, values, maxRelError);
+    return sink == 0.12345 ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+/*
+Host benchmark for the binary dataset pipeline (runs on the development machine, not on the ESP32).
+
+Streams synthetic PAMAP-shaped rows (uint8 label + 31 float32 = 125 bytes) through the same DatasetReader,
+DatasetPrefetcher and DatasetPartition code the device uses, with a small dense layer standing in for
+FeedForward so the effect of prefetching is visible.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_dataset.cpp -o /tmp/bench_dataset && /tmp/bench_dataset
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "DatasetPartition.h"
+#include "DatasetPrefetch.h"
+
+static const int FEATURES = 31;
+static const int ROW_SIZE = 1 + FEATURES * 4;
+static const int ROWS = 20000;
+static const int EPOCHS = 5;
+static const int HIDDEN = 144;
+static const char* BIN_PATH = "/tmp/bench_xy_train.bin";
+static const char* IMAGE_PATH = "/tmp/bench_dataset.part";
+
+static float weights[HIDDEN][32];
+
+float fakeFeedForward(const float* x) {
+    float sum = 0;
+    for (int i = 0; i < HIDDEN; i++) {
+        float acc = 0;
+        for (int j = 0; j < 32; j++) acc += weights[i][j] * x[j];
+        sum += acc > 0 ? acc : 0;
+    }
+    return sum;
+}
+
+void run(const char* name, DatasetReader& reader, const DecodePlan& plan, bool threaded) {
+    DatasetPrefetcher<float> prefetcher(reader, plan, 32, 18, EPOCHS);
+    if (threaded) prefetcher.start();
+    auto start = std::chrono::steady_clock::now();
+    volatile float sink = 0;
+    unsigned long rows = 0;
+    PrefetchSlot<float>* slot;
+    while ((slot = prefetcher.acquire()) != nullptr) {
+        if (!slot->endOfEpoch) {
+            sink = sink + fakeFeedForward(slot->x);
+            rows++;
+        }
+        prefetcher.release();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-34s %10.0f rows/s  io %6lu MB/s  stalls %lu\n", name, rows / seconds, reader.bytesPerSecond() >> 20, prefetcher.getStalls());
+}
+
+int main() {
+    FILE* f = fopen(BIN_PATH, "wb");
+    srand(10);
+    for (int r = 0; r < ROWS; r++) {
+        uint8_t row[ROW_SIZE];
+        row[0] = (uint8_t)(1 + rand() % 18);
+        for (int k = 0; k < FEATURES; k++) {
+            float v = (float)rand() / RAND_MAX * 4.0f - 2.0f;
+            memcpy(row + 1 + 4 * k, &v, 4);
+        }
+        fwrite(row, 1, ROW_SIZE, f);
+    }
+    fclose(f);
+    for (int i = 0; i < HIDDEN; i++) for (int j = 0; j < 32; j++) weights[i][j] = (float)rand() / RAND_MAX - 0.5f;
+
+    DecodePlan plan;
+    plan.begin(FEATURES + 1);
+    plan.setLabel(ColumnType_UINT8, 0);
+    for (int k = 0; k < FEATURES; k++) plan.addInput(ColumnType_FLOAT32, 1 + 4 * k);
+    plan.finalize(ROW_SIZE, 32);
+    plan.labelMode = LabelMode_ENCODED;
+
+    for (int threaded = 0; threaded < 2; threaded++) {
+        const char* suffix = threaded ? " + prefetch" : "";
+        char name[64];
+        {
+            DatasetReader reader(ROW_SIZE, 4096, false);
+            reader.open(BIN_PATH);
+            snprintf(name, sizeof(name), "file, 4 KB blocks%s", suffix);
+            run(name, reader, plan, threaded);
+        }
+        {
+            DatasetReader reader(ROW_SIZE, 4096, true);
+            reader.open(BIN_PATH);
+            snprintf(name, sizeof(name), "file, double buffered%s", suffix);
+            run(name, reader, plan, threaded);
+        }
+        {
+            DatasetPartition partition;
+            DatasetPartition::stage(BIN_PATH, IMAGE_PATH);
+            partition.open(IMAGE_PATH);
+            DatasetReader reader(ROW_SIZE);
+            reader.open(partition.data(), partition.size());
+            snprintf(name, sizeof(name), "mmap partition image%s", suffix);
+            run(name, reader, plan, threaded);
+        }
+    }
+    remove(BIN_PATH);
+    remove(IMAGE_PATH);
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+Host micro-benchmark for the binary dataset row decode (runs on the development machine, not on the ESP32).
+
+Compares the previous per-column string dispatch of trainModelFromBinaryDataset against the compiled
+DecodePlan, on synthetic PAMAP-shaped rows (uint8 label + 31 float32 = 125 bytes), and the fused int8
+dequantization of the same rows stored quantized (uint8 label + 31 int8 = 32 bytes).
+
+    g++ -O2 -std=c++17 -Iinclude examples/host_bench_decode.cpp -o /tmp/bench_decode && /tmp/bench_decode
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "DatasetDecoder.h"
+
+#ifndef IDFLOAT
+#define IDFLOAT float
+#endif
+
+static const int FEATURES = 31;
+static const int ROW_SIZE = 1 + FEATURES * 4;
+static const int ROWS = 20000;
+static const int EPOCHS = 20;
+
+struct LegacyCol { std::string name; std::string type; int bytes; int offset; };
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    std::vector<uint8_t> data((size_t)ROWS * ROW_SIZE);
+    srand(10);
+    for (int r = 0; r < ROWS; r++) {
+        uint8_t* row = &data[(size_t)r * ROW_SIZE];
+        row[0] = (uint8_t)(1 + rand() % 18);
+        for (int f = 0; f < FEATURES; f++) {
+            float v = (float)rand() / RAND_MAX * 4.0f - 2.0f;
+            memcpy(row + 1 + 4 * f, &v, 4);
+        }
+    }
+
+    std::vector<LegacyCol> cols;
+    cols.push_back({"activityID", "uint8", 1, 0});
+    for (int f = 0; f < FEATURES; f++) cols.push_back({"f" + std::to_string(f), "float32", 4, 1 + 4 * f});
+    std::vector<int> inputIndices;
+    for (int i = 1; i <= FEATURES; i++) inputIndices.push_back(i);
+
+    DecodePlan plan;
+    plan.begin(cols.size());
+    for (size_t i = 0; i < cols.size(); i++) {
+        if (i == 0) plan.setLabel(columnTypeFromString(cols[i].type.c_str()), cols[i].offset);
+        else plan.addInput(columnTypeFromString(cols[i].type.c_str()), cols[i].offset);
+    }
+    plan.finalize(ROW_SIZE, 32);
+    plan.labelMode = LabelMode_ENCODED;
+
+    IDFLOAT x[32] = {0};
+    volatile double sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int e = 0; e < EPOCHS; e++) {
+        for (int r = 0; r < ROWS; r++) {
+            const uint8_t* rowbuf = &data[(size_t)r * ROW_SIZE];
+            for (size_t i = 0; i < inputIndices.size(); ++i) {
+                LegacyCol& c = cols[inputIndices[i]];
+                float val = 0.0f;
+                if (c.type == "float32") { float v; memcpy(&v, rowbuf + c.offset, 4); val = v; }
+                else if (c.type == "int32") { int32_t v; memcpy(&v, rowbuf + c.offset, 4); val = (float)v; }
+                else if (c.type == "uint8") { val = (float)*(uint8_t*)(rowbuf + c.offset); }
+                else if (c.type == "int8") { val = (float)*(int8_t*)(rowbuf + c.offset); }
+                x[i] = (IDFLOAT)val;
+            }
+            LegacyCol& lc = cols[0];
+            long labelVal = 0;
+            if (lc.type == "int8") labelVal = *(int8_t*)(rowbuf + lc.offset);
+            else if (lc.type == "uint8") labelVal = *(uint8_t*)(rowbuf + lc.offset);
+            else { int32_t v; memcpy(&v, rowbuf + lc.offset, 4); labelVal = v; }
+            sink += x[r % FEATURES] + labelVal;
+        }
+    }
+    double legacy = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int e = 0; e < EPOCHS; e++) {
+        for (int r = 0; r < ROWS; r++) {
+            const uint8_t* rowbuf = &data[(size_t)r * ROW_SIZE];
+            plan.decodeInputs(rowbuf, x);
+            sink += x[r % FEATURES] + plan.classIndex(rowbuf, 18);
+        }
+    }
+    double compiled = secondsSince(start);
+
+    plan.contiguousFloat32 = false;
+    start = std::chrono::steady_clock::now();
+    for (int e = 0; e < EPOCHS; e++) {
+        for (int r = 0; r < ROWS; r++) {
+            const uint8_t* rowbuf = &data[(size_t)r * ROW_SIZE];
+            plan.decodeInputs(rowbuf, x);
+            sink += x[r % FEATURES] + plan.classIndex(rowbuf, 18);
+        }
+    }
+    double stepped = secondsSince(start);
+
+    // Same values quantized to int8 over [-2, 2], as convert_dataset.py --quantize int8 would store them
+    const int Q_ROW_SIZE = 1 + FEATURES;
+    const float scale = 4.0f / 255.0f;
+    const float zeroPoint = -128.0f + 2.0f / scale;
+    std::vector<uint8_t> qdata((size_t)ROWS * Q_ROW_SIZE);
+    for (int r = 0; r < ROWS; r++) {
+        const uint8_t* row = &data[(size_t)r * ROW_SIZE];
+        uint8_t* qrow = &qdata[(size_t)r * Q_ROW_SIZE];
+        qrow[0] = row[0] - 1;
+        for (int f = 0; f < FEATURES; f++) {
+            float v; memcpy(&v, row + 1 + 4 * f, 4);
+            long q = lroundf(v / scale + zeroPoint);
+            qrow[1 + f] = (uint8_t)(int8_t)(q < -128 ? -128 : q > 127 ? 127 : q);
+        }
+    }
+    DecodePlan qplan;
+    qplan.begin(FEATURES);
+    qplan.setLabel(ColumnType_UINT8, 0);
+    for (int f = 0; f < FEATURES; f++) qplan.addInput(ColumnType_INT8, 1 + f, scale, zeroPoint);
+    qplan.finalize(Q_ROW_SIZE, 32);
+    qplan.labelMode = LabelMode_INDEX;
+
+    start = std::chrono::steady_clock::now();
+    for (int e = 0; e < EPOCHS; e++) {
+        for (int r = 0; r < ROWS; r++) {
+            const uint8_t* rowbuf = &qdata[(size_t)r * Q_ROW_SIZE];
+            qplan.decodeInputs(rowbuf, x);
+            sink += x[r % FEATURES] + qplan.classIndex(rowbuf, 18);
+        }
+    }
+    double quantized = secondsSince(start);
+
+    double rows = (double)ROWS * EPOCHS;
+    printf("legacy string dispatch : %12.0f rows/s\n", rows / legacy);
+    printf("decode plan (per step) : %12.0f rows/s\n", rows / stepped);
+    printf("decode plan (memcpy)   : %12.0f rows/s\n", rows / compiled);
+    printf("decode plan (int8)     : %12.0f rows/s, %d vs %d bytes per row\n", rows / quantized, Q_ROW_SIZE, ROW_SIZE);
+    printf("speedup                : %.1fx\n", legacy / compiled);
+    return sink == 0.12345 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+/*
+Host benchmark for the numeric backends (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) on a shuffled data_ready2 subject
+with per-row updates three times: 64-bit double and float (BatchTrainer, what USE_64_BIT_DOUBLE selects in the
+library) and Q15 fixed point (FixedPointTrainer, USE_FIXED_POINT). Reports ms/row/neuron as in the metrics
+notes, accuracy after each epoch, the error of the piecewise-linear activations, whether the fixed point
+weights round-trip through the float model and that a ReLU topology falls back to float training.
+
+The host has a double FPU, so the double/float gap here understates the one on the ESP32 (software double).
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_fixed.cpp -o /tmp/bench_fixed && /tmp/bench_fixed [data_ready2/1/xy_train.bin]
+*/
+
+#include "FixedPoint.h"
+#include "host_bench_common.h"
+
+// Second copy of BatchTrainer with double weights
+#undef BATCHTRAINER_H_
+#undef DFLOAT
+#undef IDFLOAT
+#define DFLOAT double
+#define IDFLOAT double
+namespace Double {
+#include "BatchTrainer.h"
+}
+#undef DFLOAT
+#undef IDFLOAT
+#define DFLOAT float
+#define IDFLOAT float
+
+static const int NEURONS = 144 + 72 + 36 + CLASSES;
+static const int EPOCHS = 6;
+static const float LEARNING_RATE = 0.02f;
+
+template <typename Trainer>
+float accuracy(Trainer& trainer, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    DatasetReader reader(ROW_SIZE);
+    reader.open(data.data(), data.size());
+    const uint8_t* row;
+    unsigned int correct = 0, total = 0;
+    while ((row = reader.next()) != nullptr) {
+        int label = decode(plan, row, trainer.input(0));
+        if (label < 0) continue;
+        trainer.forward(1);
+        correct += argmax(trainer.output(0)) == label;
+        total++;
+    }
+    return total == 0 ? 0 : (float)correct / total;
+}
+
+template <typename Trainer>
+void run(const char* name, Trainer& trainer, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, SEED);
+    reader.open(data.data(), data.size());
+    unsigned long long rows = 0;
+    double seconds = 0;
+    printf("%-8s", name);
+    for (int e = 1; e <= EPOCHS; e++) {
+        if (e > 1) reader.rewind();
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* row;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(0));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(0));
+            trainer.train(1, LEARNING_RATE, LEARNING_RATE);
+            rows++;
+        }
+        seconds += secondsSince(start);
+        printf(" %5.1f", accuracy(trainer, plan, data) * 100);
+        fflush(stdout);
+    }
+    printf("  | %.6f ms/row/neuron  %7.0f rows/s\n", seconds * 1000 / rows / NEURONS, rows / seconds);
+}
+
+void activationErrors() {
+    double tanhError = 0, sigmoidError = 0, expError = 0;
+    for (int32_t z = -(8 << FIXED_WEIGHT_FRAC); z <= (8 << FIXED_WEIGHT_FRAC); z++) {
+        double v = z / (double)(1 << FIXED_WEIGHT_FRAC);
+        int32_t zs[1] = {z};
+        int16_t out[1];
+        tanhError = fmax(tanhError, fabs(fixedTanh(z) / (double)FIXED_ONE - tanh(v)));
+        FixedPointTrainer::activate(TrainActivation_SIGMOID, zs, out, 1);
+        sigmoidError = fmax(sigmoidError, fabs(out[0] / (double)FIXED_ONE - 1 / (1 + exp(-v))));
+        if (z <= 0) expError = fmax(expError, fabs(fixedExp(z) / (double)FIXED_ONE - exp(v)));
+    }
+    printf("piecewise-linear max error over [-8, 8]: tanh %.2g  sigmoid %.2g  exp %.2g\n", tanhError, sigmoidError, expError);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    std::vector<uint8_t> data;
+    if (!readRows(path, data)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    activationErrors();
+    printf("%s: %zu rows, accuracy (%%) after each of %d epochs\n", path, data.size() / ROW_SIZE, EPOCHS);
+
+    static NetworkOf<double, Double::TrainLayer> doubleNet;
+    doubleNet.init(SEED);
+    Double::BatchTrainer doubleTrainer(doubleNet.layers, LAYERS, 1);
+    run("double", doubleTrainer, plan, data);
+
+    static Network floatNet;
+    floatNet.init(SEED);
+    BatchTrainer floatTrainer(floatNet.layers, LAYERS, 1);
+    run("float", floatTrainer, plan, data);
+
+    static Network fixedNet;
+    fixedNet.init(SEED);
+    FixedPointTrainer fixedTrainer(fixedNet.layers, LAYERS, 1);
+    run("Q15", fixedTrainer, plan, data);
+
+    // Federation round trip: the float model written by commit() quantizes back to the same fixed point weights
+    fixedTrainer.commit();
+    BatchTrainer committed(fixedNet.layers, LAYERS, 1);
+    float committedAccuracy = accuracy(committed, plan, data);
+    FixedPointTrainer reloaded(fixedNet.layers, LAYERS, 1);
+    reloaded.commit();
+    bool same = true;
+    std::vector<std::vector<float>> before[LAYERS];
+    for (int l = 0; l < LAYERS; l++) before[l] = fixedNet.weights[l];
+    reloaded.load();
+    reloaded.commit();
+    for (int l = 0; l < LAYERS; l++) same = same && before[l] == fixedNet.weights[l];
+    printf("Q15 weights: %zu bytes (float %zu), float model after commit: %.1f%% accuracy, round trip %s\n",
+        fixedTrainer.getWeightBytes(), fixedTrainer.getWeightBytes() * 2, committedAccuracy * 100, same ? "exact" : "MISMATCH");
+
+    // ReLU would saturate at 1.0 in Q15, such a topology trains in float exactly as BatchTrainer does
+    static Network reluFixed, reluFloat;
+    reluFixed.init(SEED);
+    reluFloat.init(SEED);
+    reluFixed.layers[0].activation = reluFloat.layers[0].activation = TrainActivation_RELU;
+    FixedPointTrainer reluTrainer(reluFixed.layers, LAYERS, 1);
+    BatchTrainer reluReference(reluFloat.layers, LAYERS, 1);
+    run("ReLU Q15", reluTrainer, plan, data);
+    run("ReLU f32", reluReference, plan, data);
+    bool fellBack = !reluTrainer.isFixedPoint();
+    for (int l = 0; l < LAYERS; l++) fellBack = fellBack && reluFixed.weights[l] == reluFloat.weights[l];
+    printf("ReLU topology: %s\n", fellBack ? "trained in float, same weights as BatchTrainer" : "MISMATCH");
+    return same && fellBack ? 0 : 1;
+}
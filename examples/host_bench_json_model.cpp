@@ -0,0 +1,170 @@
+/*
+Host benchmark for ModelJsonParser (runs on the development machine, not on the ESP32).
+
+Writes a JSON model message for the device network (31-144-72-36-18) as the server sends it, with extra keys
+the parser has to skip, and parses it back from a stream that hands out one TCP segment at a time, as the MQTT
+client does. It checks that every value comes back bit-exact, that a partial message only touches its layers
+(with "layerRange" before or after the values) and that broken messages are refused, and shows the parse speed
+and the memory the parser needs next to the network. deserializeJson() needs a JsonDocument of at least 8 bytes
+per value on the ESP32 (ArduinoJson 7 on a 32-bit target), and the old path then copied the values into new
+arrays before building the network.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_json_model.cpp -o /tmp/bench_json && /tmp/bench_json
+*/
+
+#include <string>
+#include "host_bench_common.h"
+#include "ModelJsonParser.h"
+
+static const size_t SEGMENT = 1436; // MQTT over TCP payload per segment
+static const int REPEAT = 20;
+
+// Random biases too, so every value of the message differs
+void randomize(Network& net, uint32_t seed) {
+    srand(seed);
+    for (int l = 0; l < LAYERS; l++) {
+        for (auto& row : net.weights[l]) {
+            for (float& w : row) w = ((float)rand() / RAND_MAX - 0.5f) * 2.0f / sqrtf(TOPOLOGY[l]);
+        }
+        for (float& b : net.bias[l]) b = ((float)rand() / RAND_MAX - 0.5f) * 0.1f;
+    }
+}
+
+struct SegmentStream {
+    const std::string& data;
+    size_t position = 0;
+
+    explicit SegmentStream(const std::string& data) : data(data) {}
+
+    int available() const {
+        size_t left = data.size() - position;
+        return left < SEGMENT ? left : SEGMENT - position % SEGMENT;
+    }
+
+    size_t readBytes(char* out, size_t length) {
+        if (length > data.size() - position) length = data.size() - position;
+        memcpy(out, data.data() + position, length);
+        position += length;
+        return length;
+    }
+};
+
+void appendNumber(std::string& json, float value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%.9g", value);
+    json += text;
+}
+
+// Message as the server sends it, layers first..last only when partial
+std::string modelMessage(const Network& net, int first, int last, bool partial) {
+    std::string json = "{\"client\":\"server\",\"round\":7,\"precision\":\"float\",\"metrics\":{\"accuracy\":0.81,\"history\":[1,2,[3]],\"note\":\"a \\\"quoted\\\" [text]\"},";
+    if (partial) json += "\"layerRange\":[" + std::to_string(first) + "," + std::to_string(last) + "],";
+    json += "\"biases\":[";
+    bool comma = false;
+    for (int l = first; l <= last; l++) {
+        for (float b : net.bias[l]) {
+            if (comma) json += ',';
+            appendNumber(json, b);
+            comma = true;
+        }
+    }
+    json += "],\"weights\":[";
+    comma = false;
+    for (int l = first; l <= last; l++) {
+        for (const auto& row : net.weights[l]) {
+            for (float w : row) {
+                if (comma) json += ',';
+                appendNumber(json, w);
+                comma = true;
+            }
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+bool sameValues(const Network& a, const Network& b, int first, int last) {
+    for (int l = first; l <= last; l++) {
+        if (a.bias[l] != b.bias[l] || a.weights[l] != b.weights[l]) return false;
+    }
+    return true;
+}
+
+bool parse(const std::string& json, Network& net, ModelJsonParser*& parser) {
+    SegmentStream stream(json);
+    parser = new ModelJsonParser(net.layers, LAYERS);
+    return parser->parse(stream);
+}
+
+int main() {
+    static Network sent, received;
+    sent.fill(0);
+    randomize(sent, SEED);
+    size_t values = 0;
+    for (int l = 0; l < LAYERS; l++) values += (size_t)TOPOLOGY[l] * TOPOLOGY[l + 1] + TOPOLOGY[l + 1];
+
+    std::string full = modelMessage(sent, 0, LAYERS - 1, false);
+    received.fill(0);
+    ModelJsonParser* parser;
+    bool ok = parse(full, received, parser) && sameValues(sent, received, 0, LAYERS - 1) && parser->getRound() == 7 && parser->getValues() == values;
+    printf("full model: %zu values in %zu bytes, %s\n", values, full.size(), ok ? "bit-exact" : "MISMATCH");
+    delete parser;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < REPEAT; r++) {
+        parse(full, received, parser);
+        delete parser;
+    }
+    double seconds = secondsSince(start) / REPEAT;
+    printf("parse: %.2f ms, %.1f MB/s, %.1f Mvalues/s\n", seconds * 1000, full.size() / seconds / 1e6, values / seconds / 1e6);
+
+    size_t network = values * sizeof(float);
+    printf("memory next to the network (%zu bytes): parser %zu bytes, old path at least %zu bytes (document) + %zu bytes (copies)\n", network,
+           sizeof(ModelJsonParser), values * 8, network);
+
+    std::string partial = modelMessage(sent, 2, 3, true);
+    received.fill(0.5f);
+    bool partialOk = parse(partial, received, parser) && parser->isPartial() && sameValues(sent, received, 2, 3);
+    static Network untouched;
+    untouched.fill(0.5f);
+    partialOk = partialOk && sameValues(untouched, received, 0, 1);
+    printf("partial model 2-3: %zu bytes, %s\n", partial.size(), partialOk ? "range bit-exact, frozen layers untouched" : "MISMATCH");
+    delete parser;
+
+    // layerRange after the values, which went to the expected range
+    std::string trailing = modelMessage(sent, 2, 3, false);
+    trailing.insert(trailing.size() - 1, ",\"layerRange\":[2,3]");
+    received.fill(0.5f);
+    SegmentStream trailingStream(trailing);
+    parser = new ModelJsonParser(received.layers, LAYERS);
+    parser->expectRange(2, 3);
+    bool trailingOk = parser->parse(trailingStream) && parser->isPartial() && sameValues(sent, received, 2, 3) && sameValues(untouched, received, 0, 1);
+    printf("layerRange last:  %s\n", trailingOk ? "range bit-exact, frozen layers untouched" : "MISMATCH");
+    partialOk = partialOk && trailingOk;
+    delete parser;
+
+    struct Broken {
+        const char* name;
+        std::string json;
+    };
+    std::string missing = full;
+    missing.erase(missing.rfind(','), missing.rfind(']') - missing.rfind(','));
+    std::string late = full;
+    late.insert(late.size() - 1, ",\"layerRange\":[2,3]");
+    const Broken broken[] = {
+        {"value missing", missing},
+        {"double precision", std::string(full).replace(full.find("\"float\""), 7, "\"double\"")},
+        {"values before another range", late},
+        {"cut off", full.substr(0, full.size() / 2)},
+        {"layer out of range", modelMessage(sent, 2, 3, true).replace(partial.find("[2,3]"), 5, "[2,4]")},
+    };
+    bool refused = true;
+    for (const Broken& b : broken) {
+        received.fill(0);
+        bool accepted = parse(b.json, received, parser);
+        printf("%-28s %s (%s)\n", b.name, accepted ? "ACCEPTED" : "refused", accepted ? "" : parser->getError());
+        refused = refused && !accepted;
+        delete parser;
+    }
+    return ok && partialOk && refused ? 0 : 1;
+}
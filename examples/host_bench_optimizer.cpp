@@ -0,0 +1,89 @@
+/*
+Host benchmark for the BatchTrainer optimizers (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) on a data_ready2 subject with
+plain SGD, momentum, Nesterov and Adam, each with float and bfloat16 state. One round is one shuffled
+epoch, as a federated round with epochs = 1. After every round the accuracy over the whole file is
+measured, and the table shows the first round that reached the target, the best accuracy and the bytes
+of optimizer state.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_optimizer.cpp -o /tmp/bench_optimizer && /tmp/bench_optimizer [data_ready2/1/xy_train.bin] [target %] [rounds]
+*/
+
+#include "host_bench_common.h"
+
+static const unsigned int BATCH = 8;
+
+struct Run {
+    const char* name;
+    uint8_t type;
+    bool reduced;
+    float learningRate;
+};
+
+// Momentum sums about 1 / (1 - momentum) gradients, its rate is half of SGD's divided by that
+static const Run RUNS[] = {
+    {"sgd", Optimizer_SGD, false, 0.02f * 2.83f},
+    {"momentum", Optimizer_MOMENTUM, false, 0.02f * 2.83f * 0.05f},
+    {"momentum bf16", Optimizer_MOMENTUM, true, 0.02f * 2.83f * 0.05f},
+    {"nesterov", Optimizer_NESTEROV, false, 0.02f * 2.83f * 0.05f},
+    {"nesterov bf16", Optimizer_NESTEROV, true, 0.02f * 2.83f * 0.05f},
+    {"adam", Optimizer_ADAM, false, 0.0003f},
+    {"adam bf16", Optimizer_ADAM, true, 0.0003f},
+};
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    double target = argc > 2 ? atof(argv[2]) : 80.0;
+    int rounds = argc > 3 ? atoi(argv[3]) : 12;
+    DecodePlan plan;
+    subjectPlan(plan);
+    static Subject subject;
+    if (!loadSubject(path, plan, subject)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+
+    printf("%s: %zu labelled rows, batch %u, target %.1f%% within %d rounds\n", path, subject.labels.size(), BATCH, target, rounds);
+    printf("                 lr      rounds to target   best accuracy   state bytes   s/round\n");
+    for (const Run& run : RUNS) {
+        static Network net;
+        net.init(SEED);
+        BatchTrainer trainer(net.layers, LAYERS, BATCH);
+        OptimizerSettings settings;
+        settings.type = run.type;
+        trainer.enableOptimizer(settings, run.reduced);
+
+        DatasetReader reader(ROW_SIZE);
+        reader.setShuffle(true, SEED);
+        reader.open(subject.data.data(), subject.data.size());
+        int reached = -1;
+        double best = 0, seconds = 0;
+        for (int r = 0; r < rounds; r++) {
+            auto start = std::chrono::steady_clock::now();
+            if (r > 0) reader.rewind();
+            const uint8_t* row;
+            unsigned int count = 0;
+            while ((row = reader.next()) != nullptr) {
+                int label = decode(plan, row, trainer.input(count));
+                if (label < 0) continue;
+                oneHot(label, trainer.target(count));
+                if (++count == BATCH) {
+                    trainer.train(count, run.learningRate, run.learningRate);
+                    count = 0;
+                }
+            }
+            seconds += secondsSince(start);
+
+            double correct = accuracy(trainer, subject);
+            if (correct > best) best = correct;
+            if (reached < 0 && correct >= target) reached = r + 1;
+        }
+        char roundsText[16];
+        if (reached > 0) snprintf(roundsText, sizeof(roundsText), "%d", reached);
+        else snprintf(roundsText, sizeof(roundsText), "> %d", rounds);
+        printf("%-14s  %.4f  %16s   %12.2f%%   %11zu   %7.2f\n", run.name, run.learningRate, roundsText, best,
+               trainer.getOptimizer().getBytes(), seconds / rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+Host benchmark for the two-core layer split (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) with BatchTrainer on one epoch of a
+data_ready2 subject, single-threaded and with enableParallel() (the helper is a std::thread here, a task on
+core 0 on the device), for several batch sizes and split thresholds. Reports rows/s, the speedup, how many
+layers were split and the largest weight difference to the single-threaded run (only the summation order of
+the propagated deltas changes).
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_parallel.cpp -o /tmp/bench_parallel && /tmp/bench_parallel [data_ready2/1/xy_train.bin]
+*/
+
+#include "host_bench_common.h"
+
+static const float LEARNING_RATE = 0.02f;
+
+float maxDifference(const Network& a, const Network& b) {
+    float d = 0;
+    for (int l = 0; l < LAYERS; l++)
+        for (size_t i = 0; i < a.weights[l].size(); i++)
+            for (size_t j = 0; j < a.weights[l][i].size(); j++) d = fmaxf(d, fabsf(a.weights[l][i][j] - b.weights[l][i][j]));
+    return d;
+}
+
+struct Result {
+    double rowsPerSecond;
+    unsigned long splits;
+};
+
+Result train(Network& net, unsigned int batchSize, bool parallel, size_t minWork, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    net.init(SEED);
+    BatchTrainer trainer(net.layers, LAYERS, batchSize);
+    if (parallel) trainer.enableParallel(minWork);
+    float learningRate = LEARNING_RATE * sqrtf((float)batchSize);
+    DatasetReader reader(ROW_SIZE);
+    reader.open(data.data(), data.size());
+    const uint8_t* row;
+    unsigned int count = 0;
+    unsigned long long rows = 0;
+    auto start = std::chrono::steady_clock::now();
+    while ((row = reader.next()) != nullptr) {
+        int label = decode(plan, row, trainer.input(count));
+        if (label < 0) continue;
+        oneHot(label, trainer.target(count));
+        rows++;
+        if (++count == batchSize) {
+            trainer.train(count, learningRate, learningRate);
+            count = 0;
+        }
+    }
+    if (count > 0) trainer.train(count, learningRate, learningRate);
+    double seconds = secondsSince(start);
+    return {rows / seconds, trainer.getParallelLayers()};
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    std::vector<uint8_t> data;
+    if (!readRows(path, data)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    printf("%s: %zu rows, one epoch per run\n", path, data.size() / ROW_SIZE);
+    printf("batch  threshold   single rows/s  split rows/s  speedup  split layers  max weight diff\n");
+    const unsigned int batchSizes[] = {1, 8, 32};
+    const size_t thresholds[] = {0, 2048, 16384};
+    static Network single, split;
+    for (unsigned int b : batchSizes) {
+        Result base = train(single, b, false, 0, plan, data);
+        for (size_t t : thresholds) {
+            Result r = train(split, b, true, t, plan, data);
+            printf("%5u  %9zu  %14.0f  %12.0f  %6.2fx  %12lu  %15.2g\n", b, t, base.rowsPerSecond, r.rowsPerSecond,
+                r.rowsPerSecond / base.rowsPerSecond, r.splits, maxDifference(split, single));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+Host benchmark for partial-model rounds (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) on one data_ready2 subject as the
+global model, then fine-tunes copies of it on a second subject with different trainable layer ranges, as
+federate_start's "trainableLayers" does. For each range it shows the training time per round, the accuracy
+on the second subject after the rounds and the raw uplink bytes (PartialModel payload, or NN.save()'s values
+for the whole network).
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_partial.cpp -o /tmp/bench_partial && /tmp/bench_partial [global xy_train.bin] [local xy_train.bin]
+*/
+
+#include "host_bench_common.h"
+#include "PartialModel.h"
+
+static const int GLOBAL_EPOCHS = 4;
+static const int ROUNDS = 3;
+static const unsigned int BATCH = 8;
+static const float LEARNING_RATE = 0.02f * 2.83f;
+
+// Shuffled epochs over subject, returns the seconds spent
+double train(BatchTrainer& trainer, const DecodePlan& plan, const Subject& subject, int epochs) {
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, SEED);
+    reader.open(subject.data.data(), subject.data.size());
+    const uint8_t* row;
+    auto start = std::chrono::steady_clock::now();
+    for (int e = 0; e < epochs; e++) {
+        if (e > 0) reader.rewind();
+        unsigned int count = 0;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(count));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(count));
+            if (++count == BATCH) {
+                trainer.train(count, LEARNING_RATE, LEARNING_RATE);
+                count = 0;
+            }
+        }
+    }
+    return secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+    const char* globalPath = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    const char* localPath = argc > 2 ? argv[2] : "data_ready2/2/xy_train.bin";
+
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    static Subject global, local;
+    if (!loadSubject(globalPath, plan, global) || !loadSubject(localPath, plan, local)) {
+        printf("run from the repository root, %s or %s not found\n", globalPath, localPath);
+        return 1;
+    }
+
+    static Network pretrained;
+    pretrained.init(SEED);
+    {
+        BatchTrainer trainer(pretrained.layers, LAYERS, BATCH);
+        train(trainer, plan, global, GLOBAL_EPOCHS);
+        printf("global model: %d epochs on %s, %.2f%% on %s before fine-tuning\n", GLOBAL_EPOCHS, globalPath, accuracy(trainer, local), localPath);
+    }
+
+    static const unsigned int RANGES[][2] = {{0, 3}, {1, 3}, {2, 3}, {3, 3}};
+    size_t fullBytes = partialModelBytes(pretrained.layers, 0, LAYERS - 1) - sizeof(PartialModelHeader);
+    printf("%d rounds on %s, batch %u\n", ROUNDS, localPath, BATCH);
+    printf("layers   s/round   vs all   accuracy   uplink bytes   vs all\n");
+    double allSeconds = 0;
+    for (const auto& range : RANGES) {
+        static Network net;
+        net.copyFrom(pretrained);
+        BatchTrainer trainer(net.layers, LAYERS, BATCH);
+        trainer.setTrainableLayers(range[0], range[1]);
+        double seconds = train(trainer, plan, local, ROUNDS) / ROUNDS;
+        if (range[0] == 0) allSeconds = seconds;
+        size_t bytes = range[0] == 0 ? fullBytes : partialModelBytes(net.layers, range[0], range[1]);
+        printf("%u-%u     %7.3f   %5.1f%%    %6.2f%%   %12zu   %5.1f%%\n", range[0], range[1], seconds, 100.0 * seconds / allSeconds,
+               accuracy(trainer, local), bytes, 100.0 * bytes / fullBytes);
+    }
+    return 0;
+}
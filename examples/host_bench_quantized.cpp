@@ -0,0 +1,89 @@
+/*
+Host benchmark for the int8 inference copy (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) for a few epochs on a data_ready2
+subject, calibrates a QuantizedModel on a shuffled slice of the same file (as processModel does after a model
+is accepted) and compares it with the float network on every row: accuracy, agreement of the predicted
+class, latency per row and memory.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_quantized.cpp -o /tmp/bench_quantized && /tmp/bench_quantized [data_ready2/1/xy_train.bin]
+*/
+
+#include "host_bench_common.h"
+#include "QuantizedModel.h"
+
+static const int EPOCHS = 4;
+static const unsigned int BATCH = 8;
+static const float LEARNING_RATE = 0.02f * 2.83f;
+static const unsigned int CALIBRATION_ROWS = 256;
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    DecodePlan plan;
+    subjectPlan(plan);
+    static Subject subject;
+    if (!loadSubject(path, plan, subject)) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+
+    static Network net;
+    net.init(SEED);
+    BatchTrainer trainer(net.layers, LAYERS, BATCH);
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, SEED);
+    reader.open(subject.data.data(), subject.data.size());
+    const uint8_t* row;
+    for (int e = 0; e < EPOCHS; e++) {
+        if (e > 0) reader.rewind();
+        unsigned int count = 0;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(count));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(count));
+            if (++count == BATCH) {
+                trainer.train(count, LEARNING_RATE, LEARNING_RATE);
+                count = 0;
+            }
+        }
+    }
+
+    // Calibration on the first rows of a shuffled pass, like the device
+    QuantizedModel quantized(net.layers, LAYERS);
+    float x[FEATURES];
+    reader.rewind();
+    while (quantized.getCalibrationRows() < CALIBRATION_ROWS && (row = reader.next()) != nullptr) {
+        decode(plan, row, x);
+        quantized.calibrate(x);
+    }
+    quantized.quantize();
+
+    const std::vector<float>& inputs = subject.inputs;
+    const std::vector<int>& labels = subject.labels;
+    size_t rows = labels.size();
+
+    std::vector<int> floatClass(rows), quantizedClass(rows);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rows; r++) {
+        memcpy(trainer.input(0), &inputs[r * FEATURES], FEATURES * sizeof(float));
+        trainer.forward(1);
+        floatClass[r] = argmax(trainer.output(0));
+    }
+    double floatSeconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rows; r++) quantizedClass[r] = argmax(quantized.predict(&inputs[r * FEATURES]));
+    double quantizedSeconds = secondsSince(start);
+
+    size_t floatCorrect = 0, quantizedCorrect = 0, agree = 0;
+    for (size_t r = 0; r < rows; r++) {
+        floatCorrect += floatClass[r] == labels[r];
+        quantizedCorrect += quantizedClass[r] == labels[r];
+        agree += floatClass[r] == quantizedClass[r];
+    }
+    printf("%s: %zu labelled rows, calibrated on %lu\n", path, rows, quantized.getCalibrationRows());
+    printf("          accuracy   us/row   model bytes\n");
+    printf("float     %7.2f%%  %7.2f  %12zu\n", 100.0 * floatCorrect / rows, floatSeconds * 1e6 / rows, quantized.getSourceBytes());
+    printf("int8      %7.2f%%  %7.2f  %12zu\n", 100.0 * quantizedCorrect / rows, quantizedSeconds * 1e6 / rows, quantized.getBytes());
+    printf("accuracy delta %+.2f points, same class on %.2f%% of rows\n", 100.0 * ((double)quantizedCorrect - floatCorrect) / rows, 100.0 * agree / rows);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+Host benchmark for epoch ordering (runs on the development machine, not on the ESP32).
+
+Trains a small 31-32-18 tanh/softmax network with per-row SGD (as the device does) on a real, time-ordered
+subject from data_ready2, once per ordering mode of DatasetReader:
+  - file order (what every epoch used to replay),
+  - block shuffle with 4 KB blocks (DATASET_SHUFFLE, reads stay whole-block),
+  - full row shuffle (one block spanning the whole file, for reference).
+Reports accuracy over the whole subject after each epoch and the first epoch reaching the target.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_shuffle.cpp -o /tmp/bench_shuffle && /tmp/bench_shuffle [data_ready2/1/xy_train.bin]
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "DatasetReader.h"
+#include "DatasetDecoder.h"
+
+static const int FEATURES = 31;
+static const int ROW_SIZE = 1 + FEATURES * 4;
+static const int HIDDEN = 32;
+static const int CLASSES = 18;
+static const int EPOCHS = 15;
+static const float LEARNING_RATE = 0.01f;
+static const float TARGET_ACCURACY = 0.80f;
+static const uint32_t SEED = 10;
+
+struct Mlp {
+    float w1[HIDDEN][FEATURES], b1[HIDDEN];
+    float w2[CLASSES][HIDDEN], b2[CLASSES];
+    float h[HIDDEN], out[CLASSES];
+
+    void init(uint32_t seed) {
+        srand(seed);
+        for (int i = 0; i < HIDDEN; i++) {
+            b1[i] = 0;
+            for (int j = 0; j < FEATURES; j++) w1[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 2.0f / sqrtf(FEATURES);
+        }
+        for (int i = 0; i < CLASSES; i++) {
+            b2[i] = 0;
+            for (int j = 0; j < HIDDEN; j++) w2[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 2.0f / sqrtf(HIDDEN);
+        }
+    }
+
+    int forward(const float* x) {
+        for (int i = 0; i < HIDDEN; i++) {
+            float a = b1[i];
+            for (int j = 0; j < FEATURES; j++) a += w1[i][j] * x[j];
+            h[i] = tanhf(a);
+        }
+        float m = -1e30f, sum = 0;
+        int best = 0;
+        for (int i = 0; i < CLASSES; i++) {
+            float a = b2[i];
+            for (int j = 0; j < HIDDEN; j++) a += w2[i][j] * h[j];
+            out[i] = a;
+            if (a > m) { m = a; best = i; }
+        }
+        for (int i = 0; i < CLASSES; i++) sum += out[i] = expf(out[i] - m);
+        for (int i = 0; i < CLASSES; i++) out[i] /= sum;
+        return best;
+    }
+
+    void backward(const float* x, int label) {
+        float dh[HIDDEN] = {0};
+        for (int i = 0; i < CLASSES; i++) {
+            float d = out[i] - (i == label ? 1.0f : 0.0f);
+            for (int j = 0; j < HIDDEN; j++) {
+                dh[j] += d * w2[i][j];
+                w2[i][j] -= LEARNING_RATE * d * h[j];
+            }
+            b2[i] -= LEARNING_RATE * d;
+        }
+        for (int i = 0; i < HIDDEN; i++) {
+            float d = dh[i] * (1 - h[i] * h[i]);
+            for (int j = 0; j < FEATURES; j++) w1[i][j] -= LEARNING_RATE * d * x[j];
+            b1[i] -= LEARNING_RATE * d;
+        }
+    }
+};
+
+void decode(const DecodePlan& plan, const uint8_t* row, float* x, int& label) {
+    plan.decodeInputs(row, x);
+    for (int k = 0; k < FEATURES; k++) if (!std::isfinite(x[k])) x[k] = 0;
+    label = plan.classIndex(row, CLASSES);
+}
+
+float accuracy(Mlp& net, const DecodePlan& plan, const std::vector<uint8_t>& data) {
+    DatasetReader reader(ROW_SIZE);
+    reader.open(data.data(), data.size());
+    float x[FEATURES];
+    int label, correct = 0, total = 0;
+    const uint8_t* row;
+    while ((row = reader.next()) != nullptr) {
+        decode(plan, row, x, label);
+        if (label < 0) continue;
+        correct += net.forward(x) == label;
+        total++;
+    }
+    return total == 0 ? 0 : (float)correct / total;
+}
+
+void run(const char* name, const DecodePlan& plan, const std::vector<uint8_t>& data, bool shuffled, size_t blockSize) {
+    static Mlp net;
+    net.init(SEED);
+    DatasetReader reader(ROW_SIZE, blockSize);
+    reader.setShuffle(shuffled, SEED);
+    reader.open(data.data(), data.size());
+    float x[FEATURES];
+    int label, reached = 0;
+    printf("%-22s", name);
+    for (int e = 1; e <= EPOCHS; e++) {
+        if (e > 1) reader.rewind();
+        const uint8_t* row;
+        while ((row = reader.next()) != nullptr) {
+            decode(plan, row, x, label);
+            if (label < 0) continue;
+            net.forward(x);
+            net.backward(x, label);
+        }
+        float acc = accuracy(net, plan, data);
+        if (reached == 0 && acc >= TARGET_ACCURACY) reached = e;
+        printf(" %5.1f", acc * 100);
+    }
+    if (reached) printf("  -> %.0f%% at epoch %d\n", TARGET_ACCURACY * 100, reached);
+    else printf("  -> %.0f%% not reached\n", TARGET_ACCURACY * 100);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) {
+        printf("run from the repository root, %s not found\n", path);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    data.resize(data.size() - data.size() % ROW_SIZE);
+
+    DecodePlan plan;
+    plan.begin(FEATURES);
+    plan.setLabel(ColumnType_INT8, 0);
+    for (int k = 0; k < FEATURES; k++) plan.addInput(ColumnType_FLOAT32, 1 + 4 * k);
+    plan.finalize(ROW_SIZE, FEATURES);
+    plan.labelMode = LabelMode_ENCODED;
+
+    printf("%s: %zu rows, accuracy (%%) after each of %d epochs\n", path, data.size() / ROW_SIZE, EPOCHS);
+    run("file order", plan, data, false, 4096);
+    run("block shuffle (4 KB)", plan, data, true, 4096);
+    run("full row shuffle", plan, data, true, data.size());
+    return 0;
+}
@@ -0,0 +1,171 @@
+/*
+Host benchmark for the sparse delta uplink (runs on the development machine, not on the ESP32).
+
+Trains the device network (31-144-72-36-18, tanh/softmax as in main.cpp) on one data_ready2 subject as the
+global model, then runs federated rounds with one client on a second subject: each round the client trains a
+copy of the global model for one epoch and uploads it, and the server rebuilds the new global model from the
+upload. Whole models are compared with top-k deltas of several sizes (SparseDeltaEncoder, decoded with
+applySparseDelta as the server would), with and without error feedback. It shows the uplink bytes per round
+and the accuracy of the global model on the second subject after each round.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_sparse.cpp -o /tmp/bench_sparse && /tmp/bench_sparse [global xy_train.bin] [local xy_train.bin]
+*/
+
+#include "host_bench_common.h"
+#include "PartialModel.h"
+#include "SparseDelta.h"
+
+static const int GLOBAL_EPOCHS = 4;
+static const int ROUNDS = 5;
+static const unsigned int BATCH = 8;
+static const float LEARNING_RATE = 0.02f * 2.83f;
+
+// Parameters in one array in FlatModel order, as the device keeps them
+struct FlatNetwork {
+    std::vector<float> parameters;
+    std::vector<float*> rows[LAYERS];
+    TrainLayer layers[LAYERS];
+
+    void init(uint32_t seed) {
+        size_t count = 0;
+        for (int l = 0; l < LAYERS; l++) count += (size_t)TOPOLOGY[l] * TOPOLOGY[l + 1] + TOPOLOGY[l + 1];
+        parameters.assign(count, 0);
+        bind();
+        srand(seed);
+        for (int l = 0; l < LAYERS; l++) {
+            for (unsigned int i = 0; i < TOPOLOGY[l + 1]; i++) {
+                for (unsigned int j = 0; j < TOPOLOGY[l]; j++) layers[l].weights[i][j] = ((float)rand() / RAND_MAX - 0.5f) * 2.0f / sqrtf(TOPOLOGY[l]);
+            }
+        }
+    }
+
+    void copyFrom(const FlatNetwork& other) {
+        parameters = other.parameters;
+        bind();
+    }
+
+    void bind() {
+        float* w = parameters.data();
+        float* b = w;
+        for (int l = 0; l < LAYERS; l++) b += (size_t)TOPOLOGY[l] * TOPOLOGY[l + 1];
+        for (int l = 0; l < LAYERS; l++) {
+            rows[l].resize(TOPOLOGY[l + 1]);
+            for (unsigned int i = 0; i < TOPOLOGY[l + 1]; i++, w += TOPOLOGY[l]) rows[l][i] = w;
+            layers[l] = {rows[l].data(), b, TOPOLOGY[l], TOPOLOGY[l + 1], ACTIVATIONS[l]};
+            b += TOPOLOGY[l + 1];
+        }
+    }
+};
+
+struct ByteSink {
+    std::vector<uint8_t> bytes;
+    size_t position = 0;
+
+    size_t write(const uint8_t* data, size_t length) {
+        bytes.insert(bytes.end(), data, data + length);
+        return length;
+    }
+
+    size_t readBytes(char* out, size_t length) {
+        if (length > bytes.size() - position) length = bytes.size() - position;
+        memcpy(out, bytes.data() + position, length);
+        position += length;
+        return length;
+    }
+};
+
+void train(FlatNetwork& net, const DecodePlan& plan, const Subject& subject, int epochs, uint32_t seed) {
+    BatchTrainer trainer(net.layers, LAYERS, BATCH);
+    DatasetReader reader(ROW_SIZE);
+    reader.setShuffle(true, seed);
+    reader.open(subject.data.data(), subject.data.size());
+    const uint8_t* row;
+    for (int e = 0; e < epochs; e++) {
+        if (e > 0) reader.rewind();
+        unsigned int count = 0;
+        while ((row = reader.next()) != nullptr) {
+            int label = decode(plan, row, trainer.input(count));
+            if (label < 0) continue;
+            oneHot(label, trainer.target(count));
+            if (++count == BATCH) {
+                trainer.train(count, LEARNING_RATE, LEARNING_RATE);
+                count = 0;
+            }
+        }
+    }
+}
+
+double accuracy(FlatNetwork& net, const Subject& subject) {
+    BatchTrainer trainer(net.layers, LAYERS, 1);
+    return accuracy(trainer, subject);
+}
+
+int main(int argc, char** argv) {
+    const char* globalPath = argc > 1 ? argv[1] : "data_ready2/1/xy_train.bin";
+    const char* localPath = argc > 2 ? argv[2] : "data_ready2/2/xy_train.bin";
+
+    DecodePlan plan;
+    subjectPlan(plan);
+
+    static Subject global, local;
+    if (!loadSubject(globalPath, plan, global) || !loadSubject(localPath, plan, local)) {
+        printf("run from the repository root, %s or %s not found\n", globalPath, localPath);
+        return 1;
+    }
+
+    static FlatNetwork pretrained;
+    pretrained.init(SEED);
+    train(pretrained, plan, global, GLOBAL_EPOCHS, SEED);
+    size_t parameterCount = pretrained.parameters.size();
+    size_t wholeBytes = partialModelBytes(pretrained.layers, 0, LAYERS - 1);
+    printf("global model: %d epochs on %s, %.2f%% on %s, %zu parameters\n", GLOBAL_EPOCHS, globalPath, accuracy(pretrained, local), localPath, parameterCount);
+    printf("%d rounds of 1 epoch on %s, accuracy of the rebuilt global model after each round\n", ROUNDS, localPath);
+
+    struct Variant {
+        const char* name;
+        float fraction; // 0 for whole models
+        bool feedback;
+    };
+    static const Variant VARIANTS[] = {
+        {"whole model", 0, true},
+        {"top 10%", 0.10f, true},
+        {"top 1%", 0.01f, true},
+        {"top 1%, no feedback", 0.01f, false},
+        {"top 0.1%", 0.001f, true},
+    };
+    printf("%-20s  bytes/round   vs whole ", "uplink");
+    for (int r = 1; r <= ROUNDS; r++) printf("  round %d", r);
+    printf("\n");
+    bool decoded = true;
+    for (const Variant& v : VARIANTS) {
+        static FlatNetwork server, client;
+        server.copyFrom(pretrained);
+        SparseDeltaEncoder encoder;
+        encoder.begin(parameterCount);
+        size_t bytes = 0;
+        double accuracies[ROUNDS];
+        for (int r = 0; r < ROUNDS; r++) {
+            client.copyFrom(server);
+            // Without feedback every round starts from an empty residual
+            if (!v.feedback) encoder.reset();
+            encoder.setGlobal(client.parameters.data());
+            train(client, plan, local, 1, SEED + r);
+            if (v.fraction == 0) {
+                bytes += wholeBytes;
+                server.copyFrom(client);
+            } else {
+                ByteSink sink;
+                size_t entries = encoder.select(client.parameters.data(), (size_t)(v.fraction * parameterCount), 0);
+                size_t written = encoder.write(sink);
+                decoded = decoded && written == sparseDeltaBytes(entries) && applySparseDelta(sink, server.parameters.data(), parameterCount);
+                bytes += written;
+            }
+            accuracies[r] = accuracy(server, local);
+        }
+        printf("%-20s  %11zu   %5.1f%%  ", v.name, bytes / ROUNDS, 100.0 * bytes / ROUNDS / wholeBytes);
+        for (double a : accuracies) printf("  %6.2f%%", a);
+        printf("\n");
+    }
+    printf("payloads %s\n", decoded ? "decoded" : "FAILED TO DECODE");
+    return decoded ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/*
+Host benchmark for PayloadStager (runs on the development machine, not on the ESP32).
+
+Stages a 150 KB raw model payload, arriving one TCP segment at a time as from the MQTT client, into a file
+twice: one unbuffered write() per byte as the raw receive handlers did, and through PayloadStager in 4 KB
+blocks. Each write() stands for one VFS call on the device. It shows the write calls and bytes/s of both
+paths and checks the file contents and the CRC-32 computed on the fly, by the stager and by CrcReader.
+
+    g++ -O2 -std=c++17 -pthread -Iinclude examples/host_bench_staging.cpp -o /tmp/bench_staging && /tmp/bench_staging [file]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include "PayloadStager.h"
+
+static const size_t PAYLOAD = 150 * 1024;
+static const size_t SEGMENT = 1436;
+static const size_t BLOCK = 4096;
+static const size_t HEADER = 20; // read before staging, as receiveRawModel does
+
+struct SegmentStream {
+    const std::vector<uint8_t>& data;
+    size_t position = 0;
+
+    explicit SegmentStream(const std::vector<uint8_t>& data) : data(data) {}
+
+    int available() const {
+        size_t left = data.size() - position;
+        return left < SEGMENT ? left : SEGMENT - position % SEGMENT;
+    }
+
+    int read() { return position < data.size() ? data[position++] : -1; }
+
+    size_t readBytes(char* out, size_t length) {
+        if (length > data.size() - position) length = data.size() - position;
+        memcpy(out, data.data() + position, length);
+        position += length;
+        return length;
+    }
+};
+
+struct FdOut {
+    int fd;
+    unsigned int calls = 0;
+
+    size_t write(const uint8_t* data, size_t length) {
+        calls++;
+        ssize_t n = ::write(fd, data, length);
+        return n < 0 ? 0 : n;
+    }
+};
+
+bool fileMatches(const char* path, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> read(data.size() + 1);
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) return false;
+    size_t n = fread(read.data(), 1, read.size(), f);
+    fclose(f);
+    return n == data.size() && memcmp(read.data(), data.data(), n) == 0;
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/tmp/bench_staging.bin";
+    std::vector<uint8_t> payload(PAYLOAD);
+    srand(10);
+    for (uint8_t& b : payload) b = rand();
+
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    bool crcOk = payloadCrc32(0, check, sizeof(check)) == 0xCBF43926UL &&
+                 payloadCrc32(payloadCrc32(0, payload.data(), 1000), payload.data() + 1000, PAYLOAD - 1000) == payloadCrc32(0, payload.data(), PAYLOAD);
+
+    // Byte by byte
+    SegmentStream perByte(payload);
+    FdOut out{open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    auto start = std::chrono::steady_clock::now();
+    while (perByte.available()) {
+        uint8_t b = perByte.read();
+        out.write(&b, 1);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(out.fd);
+    bool perByteOk = fileMatches(path, payload);
+    printf("byte by byte   %7u writes  %12.0f bytes/s  %s\n", out.calls, PAYLOAD / seconds, perByteOk ? "ok" : "MISMATCH");
+
+    // Blocks, after the header was taken from the stream
+    SegmentStream blocks(payload);
+    uint8_t header[HEADER];
+    blocks.readBytes((char*)header, HEADER);
+    FdOut blockOut{open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    PayloadStager stager(BLOCK);
+    bool staged = stager.stage(blocks, blockOut, header, HEADER);
+    close(blockOut.fd);
+    const PayloadStageStats& stats = stager.getStats();
+    bool blockOk = staged && fileMatches(path, payload) && stats.bytes == PAYLOAD && stats.crc == payloadCrc32(0, payload.data(), PAYLOAD);
+    printf("4 KB blocks    %7u writes  %12lu bytes/s  %s, crc32 %08lx\n", stats.writes, stats.bytesPerSecond(), blockOk ? "ok" : "MISMATCH",
+           (unsigned long)stats.crc);
+
+    // Decoded straight from the stream, the same CRC comes from CrcReader
+    SegmentStream direct(payload);
+    direct.readBytes((char*)header, HEADER);
+    CrcReader<SegmentStream> reader(direct, payloadCrc32(0, header, HEADER), HEADER);
+    std::vector<uint8_t> decoded(PAYLOAD - HEADER);
+    reader.readBytes((char*)decoded.data(), decoded.size());
+    crcOk = crcOk && reader.getCrc() == stats.crc && reader.getBytes() == PAYLOAD;
+    printf("crc32 check value %s\n", crcOk ? "ok" : "WRONG");
+    remove(path);
+    return crcOk && perByteOk && blockOk ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/*
+Builds the "dataset" partition image from an xy_train.bin (runs on the development machine, not on the ESP32).
+
+The default dataset (2.5 MB) does not fit in LittleFS next to the dataset partition, so it is flashed straight
+into the partition instead of uploaded with uploadfs. The image is the DatasetPartition header (with the CRC-32
+of the rows) followed by the file. Flash it at the dataset offset from single_app_partition.csv:
+
+    g++ -O2 -std=c++17 -Iinclude examples/host_dataset_image.cpp -o /tmp/dataset_image
+    /tmp/dataset_image data_ready2/1/xy_train.bin /tmp/dataset.img
+    esptool.py --chip esp32 --port /dev/ttyUSB0 write_flash 0x180000 /tmp/dataset.img
+*/
+
+#include <cstdio>
+#include "DatasetPartition.h"
+
+static const size_t PARTITION_SIZE = 0x270000; // dataset size in single_app_partition.csv
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("usage: %s xy_train.bin dataset.img\n", argv[0]);
+        return 1;
+    }
+    DatasetPartition partition;
+    if (!DatasetPartition::stage(argv[1], argv[2]) || !partition.open(argv[2]) || !partition.verify()) {
+        printf("failed to build %s from %s\n", argv[2], argv[1]);
+        return 1;
+    }
+    size_t imageBytes = sizeof(DatasetPartitionHeader) + partition.size();
+    printf("%s: %zu bytes of rows, image %zu of %zu bytes\n", argv[2], partition.size(), imageBytes, PARTITION_SIZE);
+    return imageBytes <= PARTITION_SIZE ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#ifndef ACTIVATIONTABLE_H_
+#define ACTIVATIONTABLE_H_
+
+/**
+ * Interpolated lookup tables for the exp-based activations.
+ *
+ * BatchTrainer (and QuantizedModel through it) uses these instead of
+ * exp()/tanh() when USE_ACTIVATION_TABLE is defined. There are two tables of
+ * ACTIVATION_TABLE_INTERVALS linear pieces each:
+ * - tanh over [-8, 8]. Sigmoid is 0.5 + 0.5 * tanh(x / 2).
+ * - exp over [-16, 0]. ELU and SELU only take exp of negative inputs, and
+ *   softmax only after subtracting the maximum.
+ * Outside the ranges the tables return the limits. The derivatives need no
+ * table because BatchTrainer computes them from the activation outputs.
+ *
+ * Linear interpolation of f with step h is off by at most max|f''| * h^2 / 8.
+ * The bounds below add the clamping error at the range ends to that and
+ * give the largest absolute error of each activation. host_bench_activation
+ * checks them against the exact functions.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#ifndef ACTIVATION_TABLE_INTERVALS
+#define ACTIVATION_TABLE_INTERVALS 512 // pieces per table, two tables of (n + 1) floats
+#endif
+
+#define ACTIVATION_TABLE_TANH_RANGE 8.0f // 1 - tanh(8) = 2.3e-7
+#define ACTIVATION_TABLE_EXP_RANGE 16.0f // exp(-16) = 1.1e-7
+
+struct ActivationTables {
+    float tanhValues[ACTIVATION_TABLE_INTERVALS + 1];
+    float expValues[ACTIVATION_TABLE_INTERVALS + 1];
+
+    ActivationTables() {
+        for (int k = 0; k <= ACTIVATION_TABLE_INTERVALS; k++) {
+            tanhValues[k] = (float)tanh(-ACTIVATION_TABLE_TANH_RANGE + 2.0 * ACTIVATION_TABLE_TANH_RANGE * k / ACTIVATION_TABLE_INTERVALS);
+            expValues[k] = (float)exp(-(double)ACTIVATION_TABLE_EXP_RANGE * k / ACTIVATION_TABLE_INTERVALS);
+        }
+    }
+};
+
+static const ActivationTables activationTables;
+
+namespace ActivationTable {
+
+inline float tanhValue(float x) {
+    float u = (x + ACTIVATION_TABLE_TANH_RANGE) * (ACTIVATION_TABLE_INTERVALS / (2 * ACTIVATION_TABLE_TANH_RANGE));
+    if (!(u > 0)) return x != x ? x : -1.0f;
+    if (u >= ACTIVATION_TABLE_INTERVALS) return 1.0f;
+    int k = (int)u;
+    float a = activationTables.tanhValues[k];
+    return a + (u - k) * (activationTables.tanhValues[k + 1] - a);
+}
+
+inline float sigmoidValue(float x) { return 0.5f + 0.5f * tanhValue(0.5f * x); }
+
+// exp(x) for x <= 0
+inline float expNegative(float x) {
+    float u = -x * (ACTIVATION_TABLE_INTERVALS / ACTIVATION_TABLE_EXP_RANGE);
+    if (!(u < ACTIVATION_TABLE_INTERVALS)) return x != x ? x : 0.0f;
+    if (u <= 0) return 1.0f;
+    int k = (int)u;
+    float a = activationTables.expValues[k];
+    return a + (u - k) * (activationTables.expValues[k + 1] - a);
+}
+
+// Largest absolute error of tanhValue()
+inline double tanhErrorBound() {
+    double h = 2.0 * ACTIVATION_TABLE_TANH_RANGE / ACTIVATION_TABLE_INTERVALS;
+    double interpolation = 0.7698 * h * h / 8; // max |tanh''| = 4 / (3 sqrt(3))
+    double tail = 1 - tanh((double)ACTIVATION_TABLE_TANH_RANGE);
+    return (interpolation > tail ? interpolation : tail) + 1e-6; // plus float rounding of the index and the values
+}
+
+// Largest error of expNegative() relative to exp(x), above the range it returns 0 instead of at most exp(-range)
+inline double expRelativeErrorBound() {
+    double h = (double)ACTIVATION_TABLE_EXP_RANGE / ACTIVATION_TABLE_INTERVALS;
+    return h * h / 8 * exp(h) + 1e-6; // exp'' / exp = 1, the chord is above the curve
+}
+
+inline double expTail() { return exp(-(double)ACTIVATION_TABLE_EXP_RANGE); }
+
+inline double sigmoidErrorBound() { return tanhErrorBound() / 2; }
+
+// scale * (exp(x) - 1) for x <= 0, as in ELU (alpha) and SELU (lambda * alpha)
+inline double expUnitErrorBound(double scale) { return scale * (expRelativeErrorBound() + expTail()); }
+
+// Every term and so the sum is off by the relative bound, plus the terms dropped below the table
+inline double softmaxErrorBound(unsigned int outputs) {
+    double r = expRelativeErrorBound();
+    return 2 * r / (1 - r) + outputs * expTail();
+}
+
+}
+
+#endif /* ACTIVATIONTABLE_H_ */
@@ -0,0 +1,400 @@
+#ifndef BATCHTRAINER_H_
+#define BATCHTRAINER_H_
+
+/**
+ * Mini-batch trainer working in place on the NeuralNetwork weights.
+ *
+ * NeuralNetwork::BackProp updates every weight after each row. BatchTrainer
+ * instead runs a batch of B rows through each layer as one matrix-matrix
+ * product, so every weight row is read once per batch for all B samples, and
+ * the backward pass accumulates the gradient of the whole batch before writing
+ * each weight once. Weight writes drop by a factor of B and the averaged
+ * gradient tolerates larger learning rates.
+ *
+ * The math mirrors the library: squared error loss, activation derivatives
+ * taken from the layer outputs, separate learning rates for weights and
+ * biases. Layers are described by TrainLayer views over the network's own
+ * arrays, so nothing is copied and the trained model is saved as usual.
+ *
+ * With enableParallel() layers with enough work are split by neuron range
+ * between the caller and a helper on the other core (SplitWorker). Each half
+ * owns its weight rows; the deltas propagated to the previous layer are
+ * summed from one buffer per half after the barrier.
+ *
+ * enableOptimizer() replaces the plain gradient step with momentum, Nesterov
+ * or Adam (Optimizer.h), whose state is kept across batches until load().
+ *
+ * With USE_ACTIVATION_TABLE the exp-based activations come from interpolated
+ * tables (ActivationTable.h) instead of exp()/tanh().
+ *
+ * setTrainableLayers() freezes the layers outside a range. Frozen layers after
+ * the range still propagate deltas but are not updated, and the backward pass
+ * stops at the first trainable layer.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "LayerParallel.h"
+#include "Optimizer.h"
+
+#if !defined(IDFLOAT)
+#define DFLOAT float
+#define IDFLOAT float
+#endif
+
+// Same indices as the activation function ids of ModelConfig::actvFunctions
+enum TrainActivation : uint8_t {
+    TrainActivation_SIGMOID,
+    TrainActivation_TANH,
+    TrainActivation_RELU,
+    TrainActivation_LEAKY_RELU,
+    TrainActivation_ELU,
+    TrainActivation_SELU,
+    TrainActivation_SOFTMAX,
+};
+
+#define TRAIN_ALPHA_LEAKY 0.01f
+#define TRAIN_ALPHA_ELU 1.0f
+#define TRAIN_ALPHA_SELU 1.6733f
+#define TRAIN_LAMBDA_SELU 1.0507f
+
+#if defined(USE_ACTIVATION_TABLE)
+#include "ActivationTable.h"
+#define TRAIN_TANH(x) ActivationTable::tanhValue(x)
+#define TRAIN_SIGMOID(x) ActivationTable::sigmoidValue(x)
+#define TRAIN_EXP_NEGATIVE(x) ActivationTable::expNegative(x) // x <= 0
+#else
+#define TRAIN_TANH(x) tanh(x)
+#define TRAIN_SIGMOID(x) (1 / (1 + exp(-(x))))
+#define TRAIN_EXP_NEGATIVE(x) exp(x)
+#endif
+
+struct TrainLayer {
+    IDFLOAT** weights; // [outputs][inputs]
+    IDFLOAT* bias;     // [outputs]
+    unsigned int inputs;
+    unsigned int outputs;
+    uint8_t activation;
+};
+
+class BatchTrainer {
+public:
+    BatchTrainer(const TrainLayer* layers, unsigned int numberOfLayers, unsigned int batchSize)
+        : numberOfLayers(numberOfLayers), batchSize(batchSize > 0 ? batchSize : 1) {
+        this->layers = new TrainLayer[numberOfLayers];
+        memcpy(this->layers, layers, numberOfLayers * sizeof(TrainLayer));
+
+        // Where each layer's weights and biases start in FlatModel order, used to index the optimizer state
+        weightOffsets = new size_t[numberOfLayers];
+        biasOffsets = new size_t[numberOfLayers];
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            weightOffsets[l] = parameterCount;
+            parameterCount += (size_t)layers[l].outputs * layers[l].inputs;
+        }
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            biasOffsets[l] = parameterCount;
+            parameterCount += layers[l].outputs;
+        }
+
+        // One arena: layer inputs/outputs for every sample, targets, two delta buffers and a gradient row
+        size_t activationValues = (size_t)layers[0].inputs;
+        maxWidth = layers[0].inputs;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            activationValues += layers[l].outputs;
+            if (layers[l].outputs > maxWidth) maxWidth = layers[l].outputs;
+        }
+        unsigned int outputs = layers[numberOfLayers - 1].outputs;
+        size_t total = activationValues * this->batchSize + (size_t)outputs * this->batchSize + 2 * (size_t)maxWidth * this->batchSize + maxWidth;
+        arena = (IDFLOAT*)malloc(total * sizeof(IDFLOAT));
+        activations = new IDFLOAT*[numberOfLayers + 1];
+        if (arena == nullptr) return;
+        memset(arena, 0, total * sizeof(IDFLOAT));
+
+        IDFLOAT* p = arena;
+        activations[0] = p;
+        p += (size_t)layers[0].inputs * this->batchSize;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            activations[l + 1] = p;
+            p += (size_t)layers[l].outputs * this->batchSize;
+        }
+        targets = p;
+        p += (size_t)outputs * this->batchSize;
+        deltas[0] = p;
+        p += (size_t)maxWidth * this->batchSize;
+        deltas[1] = p;
+        p += (size_t)maxWidth * this->batchSize;
+        gradient = p;
+    }
+
+    ~BatchTrainer() {
+        splitter.stop();
+        free(arena);
+        free(splitArena);
+        delete[] activations;
+        delete[] weightOffsets;
+        delete[] biasOffsets;
+        delete[] layers;
+    }
+
+    bool isValid() const { return arena != nullptr; }
+    unsigned int getBatchSize() const { return batchSize; }
+
+    // Row b of the batch: the caller writes x into input(b) and the expected output into target(b)
+    IDFLOAT* input(unsigned int b) { return activations[0] + (size_t)b * layers[0].inputs; }
+    IDFLOAT* target(unsigned int b) { return targets + (size_t)b * layers[numberOfLayers - 1].outputs; }
+    // Network output for row b as computed by the last forward pass (before the update)
+    const IDFLOAT* output(unsigned int b) const { return activations[numberOfLayers] + (size_t)b * layers[numberOfLayers - 1].outputs; }
+
+    // Splits layers of at least minWork multiply-adds (outputs x inputs x rows) with a helper on core, false when it did not start
+    bool enableParallel(size_t minWork, int core = 0) {
+        if (splitArena == nullptr) {
+            splitArena = (IDFLOAT*)malloc(((size_t)maxWidth * batchSize + maxWidth) * sizeof(IDFLOAT));
+            if (splitArena == nullptr) return false;
+        }
+        minSplitWork = minWork;
+        return splitter.start(core);
+    }
+
+    unsigned long getParallelLayers() const { return splitter.getSplits(); }
+
+    // State for settings.type, in bfloat16 when reduced, false (plain SGD) when it does not fit
+    bool enableOptimizer(const OptimizerSettings& settings, bool reduced) { return optimizer.begin(settings, parameterCount, reduced); }
+    const OptimizerState& getOptimizer() const { return optimizer; }
+    size_t getParameterCount() const { return parameterCount; }
+
+    // Only layers first..last (inclusive) are updated
+    void setTrainableLayers(unsigned int first, unsigned int last) {
+        lastTrainable = last < numberOfLayers ? last : numberOfLayers - 1;
+        firstTrainable = first <= lastTrainable ? first : lastTrainable;
+    }
+
+    void forward(unsigned int count) {
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            IDFLOAT* out = activations[l + 1];
+            if (shouldSplit(l, count)) {
+                SplitJob job = {this, (unsigned int)l, count, 0, 0, nullptr, nullptr};
+                splitter.run(forwardPart, &job);
+            } else {
+                forwardRows(l, count, 0, layer.outputs);
+            }
+            for (unsigned int b = 0; b < count; b++) activate(layer.activation, out + (size_t)b * layer.outputs, layer.outputs);
+        }
+    }
+
+    // Forward, backward and one averaged update over the first count rows, returns the batch mean squared error
+    DFLOAT train(unsigned int count, DFLOAT learningRateOfWeights, DFLOAT learningRateOfBiases) {
+        if (count == 0) return 0;
+        if (count > batchSize) count = batchSize;
+        forward(count);
+
+        const TrainLayer& last = layers[numberOfLayers - 1];
+        IDFLOAT* delta = deltas[0];
+        DFLOAT error = 0;
+        for (unsigned int b = 0; b < count; b++) {
+            const IDFLOAT* a = activations[numberOfLayers] + (size_t)b * last.outputs;
+            const IDFLOAT* y = target(b);
+            for (unsigned int i = 0; i < last.outputs; i++) {
+                IDFLOAT e = a[i] - y[i];
+                error += e * e;
+                delta[(size_t)b * last.outputs + i] = e * derivative(last.activation, a[i]);
+            }
+        }
+
+        IDFLOAT scaleWeights = learningRateOfWeights / count;
+        IDFLOAT scaleBiases = learningRateOfBiases / count;
+        if (optimizer.isActive()) optimizer.step();
+        int current = 0;
+        for (int l = numberOfLayers - 1; l >= (int)firstTrainable; l--) {
+            const TrainLayer& layer = layers[l];
+            const IDFLOAT* in = activations[l];
+            delta = deltas[current];
+            IDFLOAT* previous = deltas[current ^ 1];
+            bool propagate = l > (int)firstTrainable;
+            size_t propagated = (size_t)count * layer.inputs;
+            if (propagate) memset(previous, 0, propagated * sizeof(IDFLOAT));
+
+            if (shouldSplit(l, count)) {
+                if (propagate) memset(splitArena, 0, propagated * sizeof(IDFLOAT));
+                SplitJob job = {this, (unsigned int)l, count, scaleWeights, scaleBiases, delta, propagate ? previous : nullptr};
+                splitter.run(backwardPart, &job);
+                if (propagate) {
+                    for (size_t k = 0; k < propagated; k++) previous[k] += splitArena[k];
+                }
+            } else {
+                backwardRows(l, count, 0, layer.outputs, scaleWeights, scaleBiases, delta, propagate ? previous : nullptr, gradient);
+            }
+            if ((unsigned int)l <= lastTrainable) weightWrites += (unsigned long long)layer.outputs * layer.inputs;
+
+            if (propagate) {
+                uint8_t activation = layers[l - 1].activation;
+                for (size_t k = 0; k < (size_t)count * layer.inputs; k++) previous[k] *= derivative(activation, in[k]);
+            }
+            current ^= 1;
+        }
+        return error / ((DFLOAT)count * last.outputs);
+    }
+
+    // The weights are updated in place, nothing to read or write back (see FixedPointTrainer::load/commit).
+    // After the weights were replaced the optimizer state no longer matches them and starts over.
+    void load() { optimizer.reset(); }
+    void commit() {}
+
+    unsigned long long getWeightWrites() const { return weightWrites; }
+
+    template <typename T>
+    static void activate(uint8_t activation, T* v, unsigned int n) {
+        switch (activation) {
+            case TrainActivation_SIGMOID: for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_SIGMOID(v[i]); break;
+            case TrainActivation_TANH: for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_TANH(v[i]); break;
+            case TrainActivation_RELU: for (unsigned int i = 0; i < n; i++) v[i] = v[i] > 0 ? v[i] : 0; break;
+            case TrainActivation_LEAKY_RELU: for (unsigned int i = 0; i < n; i++) v[i] = v[i] > 0 ? v[i] : TRAIN_ALPHA_LEAKY * v[i]; break;
+            case TrainActivation_ELU: for (unsigned int i = 0; i < n; i++) v[i] = v[i] > 0 ? v[i] : TRAIN_ALPHA_ELU * (TRAIN_EXP_NEGATIVE(v[i]) - 1); break;
+            case TrainActivation_SELU:
+                for (unsigned int i = 0; i < n; i++) v[i] = TRAIN_LAMBDA_SELU * (v[i] > 0 ? v[i] : TRAIN_ALPHA_SELU * (TRAIN_EXP_NEGATIVE(v[i]) - 1));
+                break;
+            case TrainActivation_SOFTMAX: {
+                T m = v[0], sum = 0;
+                for (unsigned int i = 1; i < n; i++) if (v[i] > m) m = v[i];
+                for (unsigned int i = 0; i < n; i++) sum += v[i] = TRAIN_EXP_NEGATIVE(v[i] - m);
+                for (unsigned int i = 0; i < n; i++) v[i] /= sum;
+                break;
+            }
+            default: break;
+        }
+    }
+
+    // Derivative expressed through the activation output a
+    static IDFLOAT derivative(uint8_t activation, IDFLOAT a) {
+        switch (activation) {
+            case TrainActivation_SIGMOID:
+            case TrainActivation_SOFTMAX: return a * (1 - a);
+            case TrainActivation_TANH: return 1 - a * a;
+            case TrainActivation_RELU: return a > 0 ? 1 : 0;
+            case TrainActivation_LEAKY_RELU: return a > 0 ? 1 : TRAIN_ALPHA_LEAKY;
+            case TrainActivation_ELU: return a > 0 ? 1 : a + TRAIN_ALPHA_ELU;
+            case TrainActivation_SELU: return a > 0 ? TRAIN_LAMBDA_SELU : a + TRAIN_LAMBDA_SELU * TRAIN_ALPHA_SELU;
+            default: return 1;
+        }
+    }
+
+    BatchTrainer(const BatchTrainer&) = delete;
+    BatchTrainer& operator=(const BatchTrainer&) = delete;
+
+private:
+    struct SplitJob {
+        BatchTrainer* trainer;
+        unsigned int layer;
+        unsigned int count;
+        IDFLOAT scaleWeights;
+        IDFLOAT scaleBiases;
+        const IDFLOAT* delta;
+        IDFLOAT* previous;
+    };
+
+    bool shouldSplit(unsigned int l, unsigned int count) const {
+        return splitter.isRunning() && (size_t)layers[l].outputs * layers[l].inputs * count >= minSplitWork && layers[l].outputs >= 2;
+    }
+
+    static void forwardPart(void* context, unsigned int part) {
+        SplitJob* job = (SplitJob*)context;
+        unsigned int n = job->trainer->layers[job->layer].outputs;
+        job->trainer->forwardRows(job->layer, job->count, SplitWorker::partStart(n, part), SplitWorker::partEnd(n, part));
+    }
+
+    // Part 1 propagates into its own buffer and uses its own gradient row
+    static void backwardPart(void* context, unsigned int part) {
+        SplitJob* job = (SplitJob*)context;
+        BatchTrainer* t = job->trainer;
+        unsigned int n = t->layers[job->layer].outputs;
+        IDFLOAT* previous = job->previous == nullptr ? nullptr : (part == 0 ? job->previous : t->splitArena);
+        IDFLOAT* gradient = part == 0 ? t->gradient : t->splitArena + (size_t)t->maxWidth * t->batchSize;
+        t->backwardRows(job->layer, job->count, SplitWorker::partStart(n, part), SplitWorker::partEnd(n, part), job->scaleWeights, job->scaleBiases, job->delta, previous, gradient);
+    }
+
+    // Pre-activations of neurons [first, last) for count rows
+    void forwardRows(unsigned int l, unsigned int count, unsigned int first, unsigned int last) {
+        const TrainLayer& layer = layers[l];
+        const IDFLOAT* in = activations[l];
+        IDFLOAT* out = activations[l + 1];
+        for (unsigned int i = first; i < last; i++) {
+            const IDFLOAT* w = layer.weights[i];
+            for (unsigned int b = 0; b < count; b++) {
+                const IDFLOAT* x = in + (size_t)b * layer.inputs;
+                IDFLOAT z = layer.bias[i];
+                for (unsigned int j = 0; j < layer.inputs; j++) z += w[j] * x[j];
+                out[(size_t)b * layer.outputs + i] = z;
+            }
+        }
+    }
+
+    // Updates weight rows [first, last), adding their share of the propagated deltas to previous when given
+    void backwardRows(unsigned int l, unsigned int count, unsigned int first, unsigned int last, IDFLOAT scaleWeights, IDFLOAT scaleBiases,
+                      const IDFLOAT* delta, IDFLOAT* previous, IDFLOAT* gradient) {
+        const TrainLayer& layer = layers[l];
+        const IDFLOAT* in = activations[l];
+        bool frozen = l > lastTrainable;
+        for (unsigned int i = first; i < last; i++) {
+            IDFLOAT* w = layer.weights[i];
+            IDFLOAT biasGradient = 0;
+            if (frozen) {
+                // Only the propagated deltas are needed
+                if (previous == nullptr) continue;
+                for (unsigned int b = 0; b < count; b++) {
+                    IDFLOAT d = delta[(size_t)b * layer.outputs + i];
+                    if (d == 0) continue;
+                    IDFLOAT* p = previous + (size_t)b * layer.inputs;
+                    for (unsigned int j = 0; j < layer.inputs; j++) p[j] += d * w[j];
+                }
+                continue;
+            }
+            memset(gradient, 0, layer.inputs * sizeof(IDFLOAT));
+            for (unsigned int b = 0; b < count; b++) {
+                IDFLOAT d = delta[(size_t)b * layer.outputs + i];
+                if (d == 0) continue;
+                biasGradient += d;
+                const IDFLOAT* x = in + (size_t)b * layer.inputs;
+                for (unsigned int j = 0; j < layer.inputs; j++) gradient[j] += d * x[j];
+                if (previous != nullptr) {
+                    // Uses the weights from before this batch's update, like BackProp does
+                    IDFLOAT* p = previous + (size_t)b * layer.inputs;
+                    for (unsigned int j = 0; j < layer.inputs; j++) p[j] += d * w[j];
+                }
+            }
+            if (optimizer.isActive()) {
+                optimizer.update(weightOffsets[l] + (size_t)i * layer.inputs, w, gradient, layer.inputs, 1.0f / count, scaleWeights * count);
+                optimizer.update(biasOffsets[l] + i, &layer.bias[i], &biasGradient, 1, 1.0f / count, scaleBiases * count);
+                continue;
+            }
+            for (unsigned int j = 0; j < layer.inputs; j++) w[j] -= scaleWeights * gradient[j];
+            layer.bias[i] -= scaleBiases * biasGradient;
+        }
+    }
+
+    TrainLayer* layers;
+    unsigned int numberOfLayers;
+    unsigned int batchSize;
+    unsigned int maxWidth;
+
+    IDFLOAT* arena = nullptr;
+    IDFLOAT** activations = nullptr; // activations[0] = inputs, activations[l + 1] = outputs of layer l
+    IDFLOAT* targets = nullptr;
+    IDFLOAT* deltas[2] = {nullptr, nullptr};
+    IDFLOAT* gradient = nullptr;
+    unsigned long long weightWrites = 0;
+
+    size_t* weightOffsets = nullptr;
+    size_t* biasOffsets = nullptr;
+    size_t parameterCount = 0;
+    OptimizerState optimizer;
+    unsigned int firstTrainable = 0;
+    unsigned int lastTrainable = ~0u; // every layer until setTrainableLayers()
+
+    SplitWorker splitter;
+    size_t minSplitWork = 0;
+    IDFLOAT* splitArena = nullptr; // the helper's propagated deltas and gradient row
+};
+
+#endif /* BATCHTRAINER_H_ */
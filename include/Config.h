@@ -15,16 +15,48 @@
 #define CONFIGURATION_PATH "/config.json"
 #define DEVICE_DEFINITION_PATH "/device.json"
 #define GATHERED_DATA_PATH "/data.db"
+#define CHECKPOINT_PATH "/checkpoint.bin" // training snapshot when it does not fit in RAM
 #ifdef DATASET_ORIGINAL
 #define X_TRAIN_PATH "/x_train.csv"
 #define Y_TRAIN_PATH "/y_train.csv"
 #define X_TEST_PATH "/x_test.csv"
 #define Y_TEST_PATH "/y_test.csv"
+#define CSV_READER_BUFFER_SIZE 2048 // line buffer per CSV file, must hold the longest line
 #endif
 #ifdef DATASET_BINARY
 #define XY_TRAIN_PATH "/xy_train.bin"
 #define METADATA_JSON_PATH "/metadata.json"
+#define XY_TEST_PATH "/xy_test.bin" // held-out rows with the training columns (convert_dataset.py --test-out), compares the quantized model when present
+#define DATASET_REPACK_X_PATH "/x_train.csv" // repacked into XY_TRAIN_PATH on boot when only the CSV pair is present
+#define DATASET_REPACK_Y_PATH "/y_train.csv"
+#define DATASET_CONVERT_BLOCK_SIZE 8192
 #endif
+#define DATASET_READER_BLOCK_SIZE 4096 // bytes pulled from the dataset per filesystem read
+#define DATASET_READER_DOUBLE_BUFFERED true // fill the next block on core 0 while core 1 trains
+#define DATASET_PREFETCH true // decode rows on core 0 into ready slots, training on core 1 only runs FeedForward/BackProp
+#define DATASET_PREFETCH_SLOTS 32
+#define DATASET_PARTITION true // read rows from the memory-mapped "dataset" partition when it is present
+#define DATASET_PARTITION_LABEL "dataset"
+#define DATASET_PARTITION_SUBTYPE 0x40
+#define DATASET_SHUFFLE true // new block order and in-block row order every epoch, seeded from ModelConfig::randomSeed
+#define DATASET_NORMALIZE false // apply the mean/std footer of a v2 dataset while decoding
+#define TRAINING_PARALLEL false // split wide layers between the training task (core 1) and a helper task on core 0, also routes batch size 1 through BatchTrainer instead of the library
+#define TRAINING_PARALLEL_MIN_WORK 8192 // multiply-adds (neurons x inputs x batch rows) below which a layer stays on one core
+#define QUANTIZED_MODEL true // build an int8 copy of each accepted model for inference (DATASET_BINARY only)
+#define QUANTIZED_CALIBRATION_ROWS 256 // shuffled rows of XY_TRAIN_PATH used to calibrate activation scales
+#define QUANTIZED_EVALUATION_ROWS 1024 // rows after the calibration slice comparing int8 and float
+#define FLAT_MODEL_STORAGE true // keep each model's weights and biases in one aligned block instead of one allocation per neuron
+#define FLAT_MODEL_SLOTS 4 // flat models alive at once (current, new and one being built)
+#define TRAINING_CHECKPOINT true // snapshot the weights while training, roll back when the error turns NaN/Inf
+#define CHECKPOINT_EVERY_ROWS 2000 // rows between snapshots
+#define CHECKPOINT_MAX_ROLLBACKS 3 // rollbacks per round before training gives up
+#define CHECKPOINT_LEARNING_RATE_SCALE 0.5 // learning rate factor applied on each rollback
+#define OPTIMIZER_MIN_FREE_HEAP 65536 // bytes of heap to leave after float optimizer state, below it the state is kept in bfloat16
+#define RAW_RECEIVE_IN_PLACE true // decode raw models from the MQTT stream straight into the target network instead of staging them in flash
+#define RAW_RECEIVE_MIN_FREE_HEAP 32768 // bytes to leave after allocating the target network, below it the payload is staged in flash
+#define RAW_STAGING_BLOCK_SIZE 4096 // LittleFS block size, staged payloads go to flash in whole blocks
+#define RAW_PUBLISH_LAYER_RANGE false // publish whole models in the PartialModel layout, which older servers cannot read (both go out straight from RAM)
+#define RAW_PUBLISH_CHUNK_SIZE 1024 // bytes handed to the MQTT client per write when publishing a raw model
 
 // MQTT
 #define MQTT_PUBLISH_TOPIC "esp32/fl/model/push"
@@ -0,0 +1,234 @@
+#ifndef CSVREADER_H_
+#define CSVREADER_H_
+
+/**
+ * Allocation-free CSV reader for the DATASET_ORIGINAL path.
+ *
+ * The file is read in blocks into one fixed char buffer. Lines are handed out
+ * as pointers into that buffer, terminated in place, and fields are split and
+ * parsed without creating any String, so a row costs no heap allocation at all.
+ * Numbers go through parseCsvNumber(), a small decimal parser that avoids the
+ * locale and errno handling of strtof/strtod.
+ *
+ * On the host it reads from a FILE* so it can be benchmarked against the old
+ * readStringUntil()/substring() code (examples/host_bench_csv.cpp).
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ARDUINO)
+#include <FS.h>
+#else
+#include <stdio.h>
+#endif
+
+#ifndef CSV_READER_BUFFER_SIZE
+#define CSV_READER_BUFFER_SIZE 2048 // bytes, must hold at least one full line
+#endif
+
+// Parses one decimal number starting at p and moves p past it; falls back to strtod for nan/inf
+inline double parseCsvNumber(const char*& p) {
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    while (*p == ' ' || *p == '\t') p++;
+    const char* start = p;
+    bool negative = false;
+    if (*p == '-' || *p == '+') negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+        else exponent++;
+    }
+    if (*p == '.') {
+        p++;
+        for (; *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; exponent--; }
+        }
+    }
+    if (!any) {
+        char* end;
+        double v = strtod(start, &end);
+        p = end;
+        return v;
+    }
+    if (*p == 'e' || *p == 'E') {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (*e == '-' || *e == '+') negativeExponent = *e++ == '-';
+        if (*e >= '0' && *e <= '9') {
+            int value = 0;
+            for (; *e >= '0' && *e <= '9'; e++) if (value < 10000) value = value * 10 + (*e - '0');
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+
+    double v = (double)mantissa;
+    while (exponent > 22) { v *= 1e22; exponent -= 22; }
+    while (exponent < -22) { v /= 1e22; exponent += 22; }
+    v = exponent >= 0 ? v * powersOf10[exponent] : v / powersOf10[-exponent];
+    return negative ? -v : v;
+}
+
+// Splits a line on ',' and parses up to maxFields values into out, returns how many were written
+template <typename T>
+int parseCsvFields(const char* line, T* out, int maxFields) {
+    int n = 0;
+    const char* p = line;
+    while (*p != '\0' && n < maxFields) {
+        out[n++] = (T)parseCsvNumber(p);
+        while (*p != ',' && *p != '\0') p++;
+        if (*p == ',') p++;
+    }
+    return n;
+}
+
+class CsvReader {
+public:
+#if defined(ARDUINO)
+    typedef File FileType;
+#else
+    typedef FILE* FileType;
+#endif
+
+    CsvReader(size_t bufferSize = CSV_READER_BUFFER_SIZE) : capacity(bufferSize) {}
+
+    ~CsvReader() {
+        close();
+        free(buffer);
+    }
+
+    bool open(FileType f) {
+        close();
+        file = f;
+#if defined(ARDUINO)
+        if (!file) return false;
+#else
+        if (file == nullptr) return false;
+#endif
+        if (buffer == nullptr) buffer = (char*)malloc(capacity + 1);
+        if (buffer == nullptr) {
+            closeFile();
+            return false;
+        }
+        opened = true;
+        return rewind();
+    }
+
+#if !defined(ARDUINO)
+    bool open(const char* path) {
+        return open(fopen(path, "rb"));
+    }
+#endif
+
+    void close() {
+        if (!opened) return;
+        opened = false;
+        closeFile();
+    }
+
+    bool rewind() {
+        if (!opened) return false;
+#if defined(ARDUINO)
+        if (!file.seek(0)) return false;
+#else
+        if (fseek(file, 0, SEEK_SET) != 0) return false;
+#endif
+        start = 0;
+        end = 0;
+        eof = false;
+        truncated = false;
+        return true;
+    }
+
+    // Next line without its terminator, valid until the following call; nullptr at the end of the file.
+    // Lines longer than the buffer are truncated to its size and the rest of them is skipped.
+    char* nextLine() {
+        while (true) {
+            if (truncated) {
+                char* newline = (char*)memchr(buffer + start, '\n', end - start);
+                if (newline != nullptr) {
+                    start = newline - buffer + 1;
+                    truncated = false;
+                } else {
+                    start = end;
+                    if (eof) return nullptr;
+                    refill();
+                    continue;
+                }
+            }
+            char* newline = (char*)memchr(buffer + start, '\n', end - start);
+            if (newline != nullptr) return take(newline - buffer, newline - buffer + 1);
+            if (eof) {
+                if (start == end) return nullptr;
+                return take(end, end);
+            }
+            if (start == 0 && end == capacity) {
+                truncated = true;
+                return take(end, end);
+            }
+            refill();
+        }
+    }
+
+    unsigned long long getBytesRead() const { return bytesRead; }
+
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+private:
+    // Terminates the line ending at lineEnd (dropping a trailing '\r') and resumes after next
+    char* take(size_t lineEnd, size_t next) {
+        char* line = buffer + start;
+        if (lineEnd > start && buffer[lineEnd - 1] == '\r') lineEnd--;
+        buffer[lineEnd] = '\0';
+        start = next;
+        return line;
+    }
+
+    // Moves the partial line to the front and tops the buffer up with one read
+    void refill() {
+        if (start > 0) {
+            memmove(buffer, buffer + start, end - start);
+            end -= start;
+            start = 0;
+        }
+#if defined(ARDUINO)
+        size_t n = file.read((uint8_t*)buffer + end, capacity - end);
+#else
+        size_t n = fread(buffer + end, 1, capacity - end, file);
+#endif
+        if (n == 0) eof = true;
+        end += n;
+        bytesRead += n;
+    }
+
+    void closeFile() {
+#if defined(ARDUINO)
+        file.close();
+#else
+        if (file != nullptr) fclose(file);
+        file = nullptr;
+#endif
+    }
+
+    FileType file{};
+    bool opened = false;
+    char* buffer = nullptr;
+    size_t capacity;
+    size_t start = 0;
+    size_t end = 0;
+    bool eof = false;
+    bool truncated = false;
+    unsigned long long bytesRead = 0;
+};
+
+#endif /* CSVREADER_H_ */
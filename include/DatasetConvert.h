@@ -0,0 +1,293 @@
+#ifndef DATASETCONVERT_H_
+#define DATASETCONVERT_H_
+
+/**
+ * Streaming conversion between the binary dataset and the x/y CSV pair.
+ *
+ * Binary -> CSV decodes rows through a DatasetReader and DecodePlan and writes
+ * x values and one-hot y lines. CSV -> binary parses the pair with CsvReader
+ * and writes a v2 container (float32 features, class index per row), which is
+ * how a device repacks a CSV dataset into the faster format on first boot.
+ *
+ * Both directions work in fixed-size blocks (DATASET_CONVERT_BLOCK_SIZE per
+ * output file), so memory use does not depend on the dataset size. They run on
+ * the host against FILE* as well (examples/host_bench_convert.cpp).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CsvReader.h"
+#include "DatasetFormat.h"
+#include "DatasetReader.h"
+
+#ifndef DATASET_CONVERT_BLOCK_SIZE
+#define DATASET_CONVERT_BLOCK_SIZE 8192 // output buffer per file
+#endif
+
+#define DATASET_CONVERT_MAX_FEATURES 256
+
+struct DatasetConvertStats {
+    unsigned long long rows = 0;
+    unsigned long long bytesIn = 0;
+    unsigned long long bytesOut = 0;
+    unsigned long micros = 0;
+
+    // Input and output bytes moved per second
+    unsigned long bytesPerSecond() const {
+        return micros == 0 ? 0 : (unsigned long)((bytesIn + bytesOut) * 1000000ULL / micros);
+    }
+};
+
+// Text of a float with at most 9 significant digits (enough to read back the same float), returns its length
+inline int formatCsvNumber(char* out, float value) {
+    static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13};
+    double v = value;
+    if (!(v == v) || v >= 1e9 || v <= -1e9 || (v != 0 && fabs(v) < 1e-4)) {
+        return snprintf(out, 24, "%.9g", v);
+    }
+    char* p = out;
+    if (v == 0) {
+        *p++ = '0';
+        *p = '\0';
+        return 1;
+    }
+    if (v < 0) {
+        *p++ = '-';
+        v = -v;
+    }
+    // Decimals so that 9 significant digits are kept, leading zeros of values below 1 included
+    int integerDigits = 0;
+    while (integerDigits < 9 && v >= powersOf10[integerDigits]) integerDigits++;
+    int leadingZeros = 0;
+    if (integerDigits == 0) {
+        while (v * powersOf10[leadingZeros + 1] < 1) leadingZeros++;
+    }
+    int decimals = 9 - integerDigits + leadingZeros;
+    uint64_t scaled = (uint64_t)llround(v * powersOf10[decimals]);
+    uint64_t unit = (uint64_t)powersOf10[decimals];
+    uint64_t integer = scaled / unit;
+    uint64_t fraction = scaled % unit;
+
+    char digits[24];
+    int n = 0;
+    do { digits[n++] = '0' + integer % 10; integer /= 10; } while (integer > 0);
+    while (n > 0) *p++ = digits[--n];
+    if (fraction > 0) {
+        *p++ = '.';
+        for (int d = decimals - 1; d >= 0; d--) {
+            *p++ = '0' + (fraction / (uint64_t)powersOf10[d]) % 10;
+            fraction %= (uint64_t)powersOf10[d];
+            if (fraction == 0) break;
+        }
+    }
+    *p = '\0';
+    return p - out;
+}
+
+// Collects small writes into one buffer and hands whole blocks to the filesystem
+class BlockWriter {
+public:
+#if defined(ARDUINO)
+    typedef File FileType;
+#else
+    typedef FILE* FileType;
+#endif
+
+    BlockWriter(size_t blockSize = DATASET_CONVERT_BLOCK_SIZE) : capacity(blockSize) {}
+
+    ~BlockWriter() {
+        close();
+        free(buffer);
+    }
+
+    bool open(FileType f) {
+        close();
+        file = f;
+#if defined(ARDUINO)
+        if (!file) return false;
+#else
+        if (file == nullptr) return false;
+#endif
+        if (buffer == nullptr) buffer = (uint8_t*)malloc(capacity);
+        if (buffer == nullptr) {
+            closeFile();
+            return false;
+        }
+        opened = true;
+        failed = false;
+        used = 0;
+        return true;
+    }
+
+    bool write(const void* data, size_t n) {
+        const uint8_t* p = (const uint8_t*)data;
+        while (n > 0) {
+            if (used == capacity && !flush()) return false;
+            size_t chunk = capacity - used < n ? capacity - used : n;
+            memcpy(buffer + used, p, chunk);
+            used += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    bool write(char c) {
+        if (used == capacity && !flush()) return false;
+        buffer[used++] = (uint8_t)c;
+        return true;
+    }
+
+    bool flush() {
+        if (used == 0) return !failed;
+        size_t n;
+#if defined(ARDUINO)
+        n = file.write(buffer, used);
+#else
+        n = fwrite(buffer, 1, used, file);
+#endif
+        if (n != used) failed = true;
+        bytesWritten += n;
+        used = 0;
+        return !failed;
+    }
+
+    // Overwrites bytes already flushed (e.g. a header written as a placeholder), flushes first
+    bool writeAt(size_t offset, const void* data, size_t n) {
+        if (!flush()) return false;
+#if defined(ARDUINO)
+        size_t end = file.position();
+        if (!file.seek(offset) || file.write((const uint8_t*)data, n) != n) failed = true;
+        file.seek(end);
+#else
+        long end = ftell(file);
+        if (fseek(file, (long)offset, SEEK_SET) != 0 || fwrite(data, 1, n, file) != n) failed = true;
+        fseek(file, end, SEEK_SET);
+#endif
+        return !failed;
+    }
+
+    bool close() {
+        if (!opened) return !failed;
+        flush();
+        opened = false;
+        closeFile();
+        return !failed;
+    }
+
+    unsigned long long getBytesWritten() const { return bytesWritten; }
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+private:
+    void closeFile() {
+#if defined(ARDUINO)
+        file.close();
+#else
+        if (file != nullptr && fclose(file) != 0) failed = true;
+        file = nullptr;
+#endif
+    }
+
+    FileType file{};
+    bool opened = false;
+    bool failed = false;
+    uint8_t* buffer = nullptr;
+    size_t capacity;
+    size_t used = 0;
+    unsigned long long bytesWritten = 0;
+};
+
+// Writes every row of reader as an x line (decoded inputs) and a one-hot y line, rows without a label get all zeros
+inline bool convertDatasetToCsv(DatasetReader& reader, const DecodePlan& plan, unsigned int numberOfClasses, BlockWriter& xOut, BlockWriter& yOut, DatasetConvertStats& stats) {
+    if (plan.numberOfSteps > DATASET_CONVERT_MAX_FEATURES) return false;
+    unsigned long start = readerMicros();
+    float x[DATASET_CONVERT_MAX_FEATURES];
+    char number[24];
+    const uint8_t* row;
+    bool ok = reader.rewind();
+    while (ok && (row = reader.next()) != nullptr) {
+        plan.decodeInputs(row, x);
+        for (uint16_t i = 0; i < plan.numberOfSteps; i++) {
+            if (i > 0) xOut.write(',');
+            xOut.write(number, formatCsvNumber(number, x[i]));
+        }
+        ok = xOut.write('\n');
+
+        int classIndex = plan.classIndex(row, numberOfClasses);
+        for (unsigned int k = 0; k < numberOfClasses; k++) {
+            if (k > 0) yOut.write(',');
+            yOut.write((int)k == classIndex ? '1' : '0');
+        }
+        ok = ok && yOut.write('\n');
+        stats.rows++;
+    }
+    ok = xOut.close() && ok;
+    ok = yOut.close() && ok;
+    stats.bytesIn += reader.getBytesRead();
+    stats.bytesOut += xOut.getBytesWritten() + yOut.getBytesWritten();
+    stats.micros += readerMicros() - start;
+    return ok;
+}
+
+// Packs an x/y CSV pair into a v2 container with float32 features; the class is the largest y column
+inline bool convertCsvToDataset(CsvReader& xIn, CsvReader& yIn, BlockWriter& out, DatasetConvertStats& stats) {
+    unsigned long start = readerMicros();
+    float x[DATASET_CONVERT_MAX_FEATURES];
+    float y[DATASET_CONVERT_MAX_FEATURES];
+    char* xLine = xIn.nextLine();
+    char* yLine = yIn.nextLine();
+    if (xLine == nullptr || yLine == nullptr) return false;
+
+    // The first line fixes the layout: class index byte followed by one float32 per x column
+    int features = parseCsvFields(xLine, x, DATASET_CONVERT_MAX_FEATURES);
+    int classes = parseCsvFields(yLine, y, DATASET_CONVERT_MAX_FEATURES);
+    if (features == 0 || classes == 0 || classes > DATASET_V2_NO_LABEL) return false;
+
+    DatasetV2Header header = {};
+    header.magic = DATASET_V2_MAGIC;
+    header.version = DATASET_V2_VERSION;
+    header.headerBytes = sizeof(DatasetV2Header) + features * sizeof(DatasetV2Column);
+    header.featureCount = features;
+    header.classCount = classes;
+    header.rowSize = 1 + 4 * features;
+    header.labelOffset = 0;
+    header.labelType = ColumnType_UINT8;
+    out.write(&header, sizeof(header));
+    for (int i = 0; i < features; i++) {
+        DatasetV2Column column = {ColumnType_FLOAT32, 0, (uint16_t)(1 + 4 * i), 1.0f, 0.0f};
+        out.write(&column, sizeof(column));
+    }
+
+    bool ok = true;
+    while (ok && xLine != nullptr && yLine != nullptr && *xLine != '\0' && *yLine != '\0') {
+        if (header.rowCount > 0) {
+            for (int i = parseCsvFields(xLine, x, features); i < features; i++) x[i] = 0;
+            for (int k = parseCsvFields(yLine, y, classes); k < classes; k++) y[k] = 0;
+        }
+        int best = 0;
+        for (int k = 1; k < classes; k++) {
+            if (y[k] > y[best]) best = k;
+        }
+        uint8_t label = y[best] > 0 ? (uint8_t)best : DATASET_V2_NO_LABEL;
+        out.write(&label, 1);
+        ok = out.write(x, 4 * features);
+        header.rowCount++;
+        xLine = xIn.nextLine();
+        yLine = yIn.nextLine();
+    }
+
+    ok = ok && out.writeAt(0, &header, sizeof(header));
+    ok = out.close() && ok;
+    stats.rows += header.rowCount;
+    stats.bytesIn += xIn.getBytesRead() + yIn.getBytesRead();
+    stats.bytesOut += out.getBytesWritten();
+    stats.micros += readerMicros() - start;
+    return ok;
+}
+
+#endif /* DATASETCONVERT_H_ */
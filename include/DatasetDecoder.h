@@ -0,0 +1,254 @@
+#ifndef DATASETDECODER_H_
+#define DATASETDECODER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+/**
+ * Compiled decode plan for the binary dataset rows described by metadata.json.
+ *
+ * The schema is resolved once into typed steps (type, byte offset, destination
+ * index) so the per-row decode does no string handling at all. When every input
+ * column is float32 and they sit back-to-back in the row, decoding collapses
+ * into a single memcpy (float build) or a tight widening loop (double build).
+ *
+ * Columns may carry an affine transform, value = (raw - zeroPoint) * scale, which
+ * is how the v2 container stores quantized int8/int16 columns and how feature
+ * normalization is fused into the decode. Contiguous quantized inputs of one
+ * type dequantize in a single pass straight into x.
+ */
+
+enum ColumnType : uint8_t {
+    ColumnType_FLOAT32,
+    ColumnType_INT32,
+    ColumnType_UINT8,
+    ColumnType_INT8,
+    ColumnType_INT16,
+    ColumnType_UNKNOWN,
+};
+
+inline ColumnType columnTypeFromString(const char* type) {
+    if (type == nullptr) return ColumnType_UNKNOWN;
+    if (strcmp(type, "float32") == 0) return ColumnType_FLOAT32;
+    if (strcmp(type, "int32") == 0) return ColumnType_INT32;
+    if (strcmp(type, "uint8") == 0) return ColumnType_UINT8;
+    if (strcmp(type, "int8") == 0) return ColumnType_INT8;
+    if (strcmp(type, "int16") == 0) return ColumnType_INT16;
+    return ColumnType_UNKNOWN;
+}
+
+enum LabelMode : uint8_t {
+    LabelMode_VALUES,  // raw label looked up in labelValues
+    LabelMode_ENCODED, // 1..N, 0 means no label
+    LabelMode_INDEX,   // class index stored directly, out of range means no label
+};
+
+struct DecodeStep {
+    uint8_t type;
+    uint16_t offset;
+    uint16_t dest;
+    float scale;
+    float zeroPoint;
+};
+
+struct DecodePlan {
+    DecodeStep* steps = nullptr;
+    uint16_t numberOfSteps = 0;
+    uint16_t capacity = 0;
+    uint16_t rowSize = 0;
+
+    uint8_t labelType = ColumnType_INT32;
+    uint16_t labelOffset = 0;
+    bool hasLabel = false;
+
+    LabelMode labelMode = LabelMode_VALUES;
+    long* labelValues = nullptr;
+    uint16_t numberOfLabelValues = 0;
+
+    // Fast path: all inputs are unscaled float32 stored contiguously starting at contiguousOffset
+    bool contiguousFloat32 = false;
+    bool scaled = false;
+    // Fused dequantize path: all inputs share this int8/int16 type and sit back-to-back, UNKNOWN otherwise
+    uint8_t contiguousQuantized = ColumnType_UNKNOWN;
+    uint16_t contiguousOffset = 0;
+
+    DecodePlan() {}
+    DecodePlan(const DecodePlan&) = delete;
+    DecodePlan& operator=(const DecodePlan&) = delete;
+
+    ~DecodePlan() {
+        delete[] steps;
+        delete[] labelValues;
+    }
+
+    void begin(uint16_t numberOfColumns) {
+        delete[] steps;
+        steps = new DecodeStep[numberOfColumns];
+        capacity = numberOfColumns;
+        numberOfSteps = 0;
+        rowSize = 0;
+        hasLabel = false;
+        contiguousFloat32 = false;
+        scaled = false;
+    }
+
+    // Columns must be added in schema order, inputs receive consecutive destination indices
+    bool addInput(ColumnType type, uint16_t offset, float scale = 1.0f, float zeroPoint = 0.0f) {
+        if (numberOfSteps >= capacity) return false;
+        steps[numberOfSteps].type = type;
+        steps[numberOfSteps].offset = offset;
+        steps[numberOfSteps].dest = numberOfSteps;
+        steps[numberOfSteps].scale = scale;
+        steps[numberOfSteps].zeroPoint = zeroPoint;
+        if (scale != 1.0f || zeroPoint != 0.0f) scaled = true;
+        numberOfSteps++;
+        return true;
+    }
+
+    // Folds (value - mean) / std into each input's transform, call after finalize()
+    void normalize(const float* mean, const float* std) {
+        for (uint16_t i = 0; i < numberOfSteps; i++) {
+            float sd = std[i] > 0.0f ? std[i] : 1.0f;
+            steps[i].zeroPoint += mean[i] / steps[i].scale;
+            steps[i].scale /= sd;
+        }
+        scaled = true;
+        contiguousFloat32 = false;
+    }
+
+    static uint8_t columnBytes(uint8_t type) {
+        switch (type) {
+            case ColumnType_UINT8:
+            case ColumnType_INT8: return 1;
+            case ColumnType_INT16: return 2;
+            default: return 4;
+        }
+    }
+
+    void setLabel(ColumnType type, uint16_t offset) {
+        labelType = type;
+        labelOffset = offset;
+        hasLabel = true;
+    }
+
+    void setLabelValues(const long* values, uint16_t count) {
+        delete[] labelValues;
+        labelValues = count > 0 ? new long[count] : nullptr;
+        for (uint16_t i = 0; i < count; i++) labelValues[i] = values[i];
+        numberOfLabelValues = count;
+    }
+
+    // Same row size, label and input columns with the same transforms, so rows of either plan decode alike
+    bool sameLayout(const DecodePlan& other) const {
+        if (rowSize != other.rowSize || numberOfSteps != other.numberOfSteps || hasLabel != other.hasLabel) return false;
+        if (hasLabel && (labelType != other.labelType || labelOffset != other.labelOffset || labelMode != other.labelMode)) return false;
+        for (uint16_t i = 0; i < numberOfSteps; i++) {
+            const DecodeStep& a = steps[i];
+            const DecodeStep& b = other.steps[i];
+            if (a.type != b.type || a.offset != b.offset || a.scale != b.scale || a.zeroPoint != b.zeroPoint) return false;
+        }
+        return true;
+    }
+
+    // Drop inputs the network cannot take and detect the contiguous float32 layout
+    void finalize(uint16_t rowBytes, uint16_t maxInputs) {
+        rowSize = rowBytes;
+        if (numberOfSteps > maxInputs) numberOfSteps = maxInputs;
+        contiguousFloat32 = numberOfSteps > 0 && !scaled;
+        for (uint16_t i = 0; i < numberOfSteps && contiguousFloat32; i++) {
+            if (steps[i].type != ColumnType_FLOAT32 || steps[i].offset != steps[0].offset + 4 * i) {
+                contiguousFloat32 = false;
+            }
+        }
+        contiguousOffset = numberOfSteps > 0 ? steps[0].offset : 0;
+
+        contiguousQuantized = ColumnType_UNKNOWN;
+        if (numberOfSteps > 0 && (steps[0].type == ColumnType_INT8 || steps[0].type == ColumnType_INT16)) {
+            contiguousQuantized = steps[0].type;
+            uint8_t width = columnBytes(steps[0].type);
+            for (uint16_t i = 1; i < numberOfSteps; i++) {
+                if (steps[i].type != steps[0].type || steps[i].offset != steps[0].offset + width * i) {
+                    contiguousQuantized = ColumnType_UNKNOWN;
+                    break;
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    void decodeInputs(const uint8_t* row, T* x) const {
+        if (contiguousFloat32) {
+            if (std::is_same<T, float>::value) {
+                memcpy(x, row + contiguousOffset, (size_t)numberOfSteps * 4);
+            } else {
+                const uint8_t* p = row + contiguousOffset;
+                for (uint16_t i = 0; i < numberOfSteps; i++, p += 4) {
+                    float v; memcpy(&v, p, 4); x[i] = (T)v;
+                }
+            }
+            return;
+        }
+        if (contiguousQuantized == ColumnType_INT8) {
+            const int8_t* p = (const int8_t*)(row + contiguousOffset);
+            for (uint16_t i = 0; i < numberOfSteps; i++) {
+                x[i] = (T)(((float)p[i] - steps[i].zeroPoint) * steps[i].scale);
+            }
+            return;
+        }
+        if (contiguousQuantized == ColumnType_INT16) {
+            const uint8_t* p = row + contiguousOffset;
+            for (uint16_t i = 0; i < numberOfSteps; i++, p += 2) {
+                int16_t v; memcpy(&v, p, 2);
+                x[i] = (T)(((float)v - steps[i].zeroPoint) * steps[i].scale);
+            }
+            return;
+        }
+        for (uint16_t i = 0; i < numberOfSteps; i++) {
+            const DecodeStep& s = steps[i];
+            const uint8_t* p = row + s.offset;
+            switch (s.type) {
+                case ColumnType_FLOAT32: { float v; memcpy(&v, p, 4); x[s.dest] = (T)v; break; }
+                case ColumnType_INT32: { int32_t v; memcpy(&v, p, 4); x[s.dest] = (T)v; break; }
+                case ColumnType_UINT8: x[s.dest] = (T)(*p); break;
+                case ColumnType_INT8: x[s.dest] = (T)(int8_t)(*p); break;
+                case ColumnType_INT16: { int16_t v; memcpy(&v, p, 2); x[s.dest] = (T)v; break; }
+                default: x[s.dest] = (T)0; break;
+            }
+        }
+        if (scaled) {
+            for (uint16_t i = 0; i < numberOfSteps; i++) {
+                x[i] = (T)(((float)x[i] - steps[i].zeroPoint) * steps[i].scale);
+            }
+        }
+    }
+
+    long decodeLabel(const uint8_t* row) const {
+        const uint8_t* p = row + labelOffset;
+        switch (labelType) {
+            case ColumnType_INT8: return (int8_t)(*p);
+            case ColumnType_UINT8: return *p;
+            case ColumnType_INT16: { int16_t v; memcpy(&v, p, 2); return v; }
+            default: { int32_t v; memcpy(&v, p, 4); return v; }
+        }
+    }
+
+    // Returns the 0-based class of a row, or -1 when the row carries no (known) label
+    int classIndex(const uint8_t* row, unsigned int numberOfClasses) const {
+        long labelVal = decodeLabel(row);
+        if (labelMode == LabelMode_INDEX) {
+            return (labelVal < 0 || labelVal >= (long)numberOfClasses) ? -1 : (int)labelVal;
+        }
+        if (labelMode == LabelMode_ENCODED) {
+            int encoded = (int)labelVal - 1;
+            return (encoded < 0 || encoded >= (int)numberOfClasses) ? -1 : encoded;
+        }
+        unsigned int n = numberOfLabelValues < numberOfClasses ? numberOfLabelValues : numberOfClasses;
+        for (unsigned int k = 0; k < n; k++) {
+            if (labelValues[k] == labelVal) return (int)k;
+        }
+        return -1;
+    }
+};
+
+#endif /* DATASETDECODER_H_ */
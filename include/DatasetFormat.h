@@ -0,0 +1,97 @@
+#ifndef DATASETFORMAT_H_
+#define DATASETFORMAT_H_
+
+/**
+ * Self-describing binary dataset container (v2).
+ *
+ *     [header 32 B][column table, featureCount x 12 B][rows ...][optional footer]
+ *
+ * The header carries everything the old metadata.json was parsed for, so a
+ * device only needs one small read before streaming rows. Each row stores the
+ * 0-based class index directly (DATASET_V2_NO_LABEL for unlabeled rows), which
+ * removes the label_values / label_map lookup from the hot loop. The optional
+ * footer holds per-feature mean and std as float32 pairs.
+ *
+ * Features may be stored quantized as int8 or int16 with a per-column scale and
+ * zero point; a PAMAP row then shrinks from 125 to 32 (int8) or 63 (int16) bytes
+ * and the decode plan dequantizes straight into the network input.
+ *
+ * All fields are little-endian. convert_dataset.py writes this format from the
+ * data_ready2 layout (metadata.json + xy_train.bin).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "DatasetDecoder.h"
+
+#define DATASET_V2_MAGIC 0x32445441 // "ATD2"
+#define DATASET_V2_VERSION 2
+#define DATASET_V2_NO_LABEL 0xFF
+#define DATASET_V2_FLAG_STATS 0x01
+
+struct DatasetV2Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerBytes;  // header + column table, i.e. offset of the first row
+    uint32_t rowCount;
+    uint16_t featureCount;
+    uint16_t classCount;
+    uint16_t rowSize;
+    uint16_t labelOffset;  // byte offset of the class index inside a row
+    uint8_t labelType;     // ColumnType of the class index
+    uint8_t flags;
+    uint16_t reserved0;
+    uint32_t footerOffset; // offset of the mean/std footer from the start of the file, 0 when absent
+    uint32_t reserved1;
+};
+
+// value = (raw - zeroPoint) * scale
+struct DatasetV2Column {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t offset;
+    float scale;
+    float zeroPoint;
+};
+
+static_assert(sizeof(DatasetV2Header) == 32, "DatasetV2Header must match the on-disk layout");
+static_assert(sizeof(DatasetV2Column) == 12, "DatasetV2Column must match the on-disk layout");
+
+inline bool isDatasetV2(const uint8_t* bytes, size_t length) {
+    if (length < sizeof(DatasetV2Header)) return false;
+    uint32_t magic;
+    memcpy(&magic, bytes, 4);
+    return magic == DATASET_V2_MAGIC;
+}
+
+// Checks the header against itself and the total size of the container
+inline bool validDatasetV2Header(const DatasetV2Header& h, size_t totalBytes) {
+    if (h.magic != DATASET_V2_MAGIC || h.version != DATASET_V2_VERSION) return false;
+    if (h.rowSize == 0 || h.headerBytes != sizeof(DatasetV2Header) + (size_t)h.featureCount * sizeof(DatasetV2Column)) return false;
+    if ((size_t)h.headerBytes + (size_t)h.rowCount * h.rowSize > totalBytes) return false;
+    if ((h.flags & DATASET_V2_FLAG_STATS) && (size_t)h.footerOffset + (size_t)h.featureCount * 8 > totalBytes) return false;
+    return true;
+}
+
+inline size_t datasetV2DataBytes(const DatasetV2Header& h) {
+    return (size_t)h.rowCount * h.rowSize;
+}
+
+// Compiles the column table into a decode plan, labels are class indices so no lookup table is needed
+inline bool buildDatasetV2Plan(const DatasetV2Header& h, const DatasetV2Column* columns, DecodePlan& plan, uint16_t maxInputs) {
+    plan.begin(h.featureCount);
+    for (uint16_t i = 0; i < h.featureCount; i++) {
+        const DatasetV2Column& c = columns[i];
+        if (c.type >= ColumnType_UNKNOWN || (size_t)c.offset + DecodePlan::columnBytes(c.type) > h.rowSize) return false;
+        // A zero or non-finite scale, or a non-finite zero point, would turn every value of the column into 0 or NaN
+        if (c.scale == 0 || !isfinite(c.scale) || !isfinite(c.zeroPoint)) return false;
+        plan.addInput((ColumnType)c.type, c.offset, c.scale, c.zeroPoint);
+    }
+    plan.setLabel((ColumnType)h.labelType, h.labelOffset);
+    plan.labelMode = LabelMode_INDEX;
+    plan.finalize(h.rowSize, maxInputs);
+    return true;
+}
+
+#endif /* DATASETFORMAT_H_ */
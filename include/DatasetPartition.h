@@ -0,0 +1,244 @@
+#ifndef DATASETPARTITION_H_
+#define DATASETPARTITION_H_
+
+/**
+ * Optional raw flash partition holding the training rows.
+ *
+ * The "dataset" partition from single_app_partition.csv starts with a small
+ * header followed by the rows exactly as they appear in xy_train.bin. It is
+ * mapped read-only into the data address space, so training reads rows by
+ * pointer through the flash cache without the filesystem or any copy.
+ *
+ * The header carries the CRC-32 of the rows. A dataset uploaded to LittleFS
+ * is staged only when its CRC differs, checked by reading the partition back
+ * and then removed from LittleFS, so it is never stored twice. A dataset too
+ * large for LittleFS is flashed as an image built on the host
+ * (examples/host_dataset_image.cpp).
+ *
+ * On the host the same image layout is memory-mapped from a regular file with
+ * POSIX mmap, which lets the dataset pipeline be benchmarked on Linux.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "PayloadStager.h"
+
+#if defined(ARDUINO)
+#include <FS.h>
+#include <esp_idf_version.h>
+#include <esp_partition.h>
+#if ESP_IDF_VERSION_MAJOR >= 5
+typedef esp_partition_mmap_handle_t DatasetMmapHandle;
+#define DATASET_MMAP_DATA ESP_PARTITION_MMAP_DATA
+#define datasetMunmap esp_partition_munmap
+#else
+#include <esp_spi_flash.h>
+typedef spi_flash_mmap_handle_t DatasetMmapHandle;
+#define DATASET_MMAP_DATA SPI_FLASH_MMAP_DATA
+#define datasetMunmap spi_flash_munmap
+#endif
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef DATASET_PARTITION_LABEL
+#define DATASET_PARTITION_LABEL "dataset"
+#endif
+#ifndef DATASET_PARTITION_SUBTYPE
+#define DATASET_PARTITION_SUBTYPE 0x40
+#endif
+
+#define DATASET_PARTITION_MAGIC 0x53445441 // "ATDS"
+#define DATASET_PARTITION_VERSION 2
+#define DATASET_PARTITION_STAGE_CHUNK 4096
+
+struct DatasetPartitionHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dataBytes;
+    uint32_t crc; // CRC-32 of the dataBytes that follow
+};
+
+class DatasetPartition {
+public:
+    DatasetPartition() {}
+    ~DatasetPartition() { close(); }
+
+#if defined(ARDUINO)
+    // Maps the partition; false when it is missing or was never staged
+    bool open() {
+        close();
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)DATASET_PARTITION_SUBTYPE, DATASET_PARTITION_LABEL);
+        if (partition == NULL) return false;
+        DatasetPartitionHeader header;
+        if (!readHeader(header)) return false;
+        const void* ptr;
+        if (esp_partition_mmap(partition, 0, sizeof(header) + header.dataBytes, DATASET_MMAP_DATA, &ptr, &handle) != ESP_OK) return false;
+        base = (const uint8_t*)ptr;
+        bytes = header.dataBytes;
+        crc = header.crc;
+        return true;
+    }
+
+    void close() {
+        if (base != nullptr) datasetMunmap(handle);
+        base = nullptr;
+        bytes = 0;
+    }
+
+    static bool exists() {
+        return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)DATASET_PARTITION_SUBTYPE, DATASET_PARTITION_LABEL) != NULL;
+    }
+
+    /**
+     * Makes the partition hold the rows of src. Nothing is written when it
+     * already holds the same bytes (same size and CRC). True only once the
+     * partition was read back and matches, so src can then be removed.
+     */
+    static bool stage(File& src) {
+        const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)DATASET_PARTITION_SUBTYPE, DATASET_PARTITION_LABEL);
+        if (part == NULL || !src) return false;
+        size_t total = src.size();
+        if (total + sizeof(DatasetPartitionHeader) > part->size) return false;
+        uint8_t* chunk = (uint8_t*)malloc(DATASET_PARTITION_STAGE_CHUNK);
+        if (chunk == nullptr) return false;
+
+        uint32_t crc = 0;
+        src.seek(0);
+        size_t n, read = 0;
+        while ((n = src.read(chunk, DATASET_PARTITION_STAGE_CHUNK)) > 0) {
+            crc = payloadCrc32(crc, chunk, n);
+            read += n;
+        }
+        DatasetPartitionHeader header;
+        if (read != total) {
+            free(chunk);
+            return false;
+        }
+        if (esp_partition_read(part, 0, &header, sizeof(header)) == ESP_OK && header.magic == DATASET_PARTITION_MAGIC
+            && header.version == DATASET_PARTITION_VERSION && header.dataBytes == total && header.crc == crc) {
+            free(chunk);
+            return true;
+        }
+
+        // Erase everything needed up front, the header goes in last so a partial copy is never mapped
+        size_t eraseBytes = (total + sizeof(header) + 0xFFF) & ~(size_t)0xFFF;
+        bool ok = esp_partition_erase_range(part, 0, eraseBytes) == ESP_OK;
+        src.seek(0);
+        size_t written = 0;
+        while (ok && written < total && (n = src.read(chunk, DATASET_PARTITION_STAGE_CHUNK)) > 0) {
+            ok = esp_partition_write(part, sizeof(header) + written, chunk, n) == ESP_OK;
+            written += n;
+        }
+        ok = ok && written == total && partitionCrc32(part, total, chunk) == crc;
+        free(chunk);
+        if (!ok) return false;
+
+        header.magic = DATASET_PARTITION_MAGIC;
+        header.version = DATASET_PARTITION_VERSION;
+        header.dataBytes = total;
+        header.crc = crc;
+        return esp_partition_write(part, 0, &header, sizeof(header)) == ESP_OK;
+    }
+#else
+    // Maps an image file laid out like the partition (header followed by rows)
+    bool open(const char* imagePath) {
+        close();
+        fd = ::open(imagePath, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DatasetPartitionHeader)) { close(); return false; }
+        mappingSize = st.st_size;
+        void* ptr = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) { close(); return false; }
+        mapping = ptr;
+        DatasetPartitionHeader header;
+        memcpy(&header, ptr, sizeof(header));
+        if (header.magic != DATASET_PARTITION_MAGIC || header.version != DATASET_PARTITION_VERSION
+            || sizeof(header) + header.dataBytes > mappingSize) {
+            close();
+            return false;
+        }
+        base = (const uint8_t*)ptr;
+        bytes = header.dataBytes;
+        crc = header.crc;
+        return true;
+    }
+
+    void close() {
+        if (mapping != nullptr) munmap(mapping, mappingSize);
+        if (fd >= 0) ::close(fd);
+        mapping = nullptr;
+        fd = -1;
+        base = nullptr;
+        bytes = 0;
+    }
+
+    // Wraps a plain xy_train.bin into a partition image
+    static bool stage(const char* binPath, const char* imagePath) {
+        FILE* in = fopen(binPath, "rb");
+        if (in == nullptr) return false;
+        FILE* out = fopen(imagePath, "wb");
+        if (out == nullptr) { fclose(in); return false; }
+        DatasetPartitionHeader header = {DATASET_PARTITION_MAGIC, DATASET_PARTITION_VERSION, 0, 0};
+        fwrite(&header, sizeof(header), 1, out);
+        uint8_t chunk[DATASET_PARTITION_STAGE_CHUNK];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+            fwrite(chunk, 1, n, out);
+            header.crc = payloadCrc32(header.crc, chunk, n);
+            header.dataBytes += n;
+        }
+        fseek(out, 0, SEEK_SET);
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        fclose(in);
+        return fclose(out) == 0 && ok;
+    }
+#endif
+
+    // First row, rows follow back-to-back
+    const uint8_t* data() const { return base == nullptr ? nullptr : base + sizeof(DatasetPartitionHeader); }
+    size_t size() const { return bytes; }
+    bool isOpen() const { return base != nullptr; }
+
+    // Reads every row once and checks it against the CRC in the header
+    bool verify() const { return base != nullptr && payloadCrc32(0, data(), bytes) == crc; }
+
+    DatasetPartition(const DatasetPartition&) = delete;
+    DatasetPartition& operator=(const DatasetPartition&) = delete;
+
+private:
+#if defined(ARDUINO)
+    bool readHeader(DatasetPartitionHeader& header) {
+        if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) return false;
+        return header.magic == DATASET_PARTITION_MAGIC && header.version == DATASET_PARTITION_VERSION
+            && header.dataBytes + sizeof(header) <= partition->size;
+    }
+
+    static uint32_t partitionCrc32(const esp_partition_t* part, size_t total, uint8_t* chunk) {
+        uint32_t result = 0;
+        for (size_t offset = 0; offset < total; offset += DATASET_PARTITION_STAGE_CHUNK) {
+            size_t n = total - offset < DATASET_PARTITION_STAGE_CHUNK ? total - offset : DATASET_PARTITION_STAGE_CHUNK;
+            if (esp_partition_read(part, sizeof(DatasetPartitionHeader) + offset, chunk, n) != ESP_OK) return ~result;
+            result = payloadCrc32(result, chunk, n);
+        }
+        return result;
+    }
+
+    const esp_partition_t* partition = NULL;
+    DatasetMmapHandle handle = 0;
+#else
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+#endif
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+    uint32_t crc = 0;
+};
+
+#endif /* DATASETPARTITION_H_ */
@@ -0,0 +1,185 @@
+#ifndef DATASETPREFETCH_H_
+#define DATASETPREFETCH_H_
+
+/**
+ * Dataset prefetch pipeline.
+ *
+ * A producer worker (core 0 on the ESP32, a std::thread on the host) reads rows
+ * through a DatasetReader, decodes them with a DecodePlan and publishes ready
+ * x / one-hot y slots into a bounded single-producer single-consumer ring. The
+ * training loop only acquires slots and runs FeedForward/BackProp, so flash
+ * latency is hidden behind compute.
+ *
+ * The hand-off is lock-free: the producer owns head, the consumer owns tail.
+ * A side that finds the ring empty (or full) blocks on a Signal instead of
+ * polling, and the other side only gives it when the waiting flag is set, so
+ * the fast path costs no semaphore call. When the worker cannot be started
+ * the same API decodes inline on the caller.
+ */
+
+#include <atomic>
+#include <stdint.h>
+#include "DatasetDecoder.h"
+#include "DatasetReader.h"
+#include "Worker.h"
+
+#ifndef DATASET_PREFETCH_SLOTS
+#define DATASET_PREFETCH_SLOTS 32
+#endif
+
+template <typename T>
+struct PrefetchSlot {
+    T* x;
+    T* y;
+    int classIndex;
+    bool endOfEpoch;
+};
+
+template <typename T>
+class DatasetPrefetcher {
+public:
+    DatasetPrefetcher(DatasetReader& reader, const DecodePlan& plan, unsigned int numberOfInputs, unsigned int numberOfClasses, unsigned int epochs, unsigned int numberOfSlots = DATASET_PREFETCH_SLOTS)
+        : reader(reader), plan(plan), numberOfInputs(numberOfInputs), numberOfClasses(numberOfClasses), epochs(epochs) {
+        if (numberOfSlots < 2) numberOfSlots = 2;
+        capacity = numberOfSlots;
+        slots = new PrefetchSlot<T>[capacity];
+        // One arena for every slot's x and y, zeroed so inputs the plan does not fill stay at 0
+        arena = new T[(size_t)capacity * (numberOfInputs + numberOfClasses)]();
+        for (unsigned int i = 0; i < capacity; i++) {
+            slots[i].x = arena + (size_t)i * (numberOfInputs + numberOfClasses);
+            slots[i].y = slots[i].x + numberOfInputs;
+        }
+    }
+
+    ~DatasetPrefetcher() {
+        stop();
+        delete[] slots;
+        delete[] arena;
+    }
+
+    // Launches the producer; returns false (and falls back to inline decoding) if the worker could not start
+    bool start(int core = 0) {
+        threaded = worker.start(producerTask, this, "Dataset Prefetch", 4096, core);
+        return threaded;
+    }
+
+    // Next ready slot, or nullptr when every epoch has been consumed (or the pipeline was stopped)
+    PrefetchSlot<T>* acquire() {
+        if (!threaded) {
+            if (finished.load(std::memory_order_relaxed) || !produce(slots[0])) return nullptr;
+            return &slots[0];
+        }
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        bool stalled = false;
+        while (head.load(std::memory_order_acquire) == t) {
+            if (finished.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == t) return nullptr;
+            if (!stalled) {
+                stalls++;
+                stalled = true;
+            }
+            wait(consumerWaiting, filled, [this, t] { return head.load() != t || finished.load(); });
+        }
+        return &slots[t % capacity];
+    }
+
+    // Hands the slot returned by acquire() back to the producer
+    void release() {
+        if (!threaded) return;
+        tail.store(tail.load(std::memory_order_relaxed) + 1);
+        wake(producerWaiting, drained);
+    }
+
+    // Stops the producer early (e.g. training budget reached), safe to call more than once
+    void stop() {
+        stopping.store(true);
+        wake(producerWaiting, drained);
+        worker.join();
+        threaded = false;
+        finished.store(true, std::memory_order_release);
+    }
+
+    // Rows the consumer had to wait for, i.e. I/O was not fully hidden
+    unsigned long getStalls() const { return stalls; }
+
+    DatasetPrefetcher(const DatasetPrefetcher&) = delete;
+    DatasetPrefetcher& operator=(const DatasetPrefetcher&) = delete;
+
+private:
+    // Decodes the next row (or the end-of-epoch marker) into s; false once all epochs are done
+    bool produce(PrefetchSlot<T>& s) {
+        if (epoch >= epochs) return false;
+        const uint8_t* row = reader.next();
+        if (row == nullptr) {
+            s.endOfEpoch = true;
+            s.classIndex = -1;
+            epoch++;
+            if (epoch < epochs) reader.rewind();
+            return true;
+        }
+        s.endOfEpoch = false;
+        plan.decodeInputs(row, s.x);
+        s.classIndex = plan.classIndex(row, numberOfClasses);
+        for (unsigned int k = 0; k < numberOfClasses; k++) {
+            s.y[k] = ((int)k == s.classIndex) ? (T)1 : (T)0;
+        }
+        return true;
+    }
+
+    // Blocks on signal until ready() holds. The flag is raised before ready() is checked again, so a wake() in between is not lost.
+    template <typename Ready>
+    static void wait(std::atomic<bool>& waiting, Signal& signal, Ready ready) {
+        waiting.store(true);
+        if (ready()) {
+            // The other side may have taken the flag already, its give() must be consumed
+            if (!waiting.exchange(false)) signal.take();
+            return;
+        }
+        signal.take();
+    }
+
+    static void wake(std::atomic<bool>& waiting, Signal& signal) {
+        if (waiting.load() && waiting.exchange(false)) signal.give();
+    }
+
+    static void producerTask(void* arg) {
+        DatasetPrefetcher* p = (DatasetPrefetcher*)arg;
+        uint32_t h = p->head.load(std::memory_order_relaxed);
+        while (!p->stopping.load()) {
+            if (h - p->tail.load() >= p->capacity) {
+                wait(p->producerWaiting, p->drained, [p, h] { return h - p->tail.load() < p->capacity || p->stopping.load(); });
+                continue;
+            }
+            if (!p->produce(p->slots[h % p->capacity])) break;
+            h++;
+            p->head.store(h);
+            wake(p->consumerWaiting, p->filled);
+        }
+        p->finished.store(true);
+        wake(p->consumerWaiting, p->filled);
+    }
+
+    DatasetReader& reader;
+    const DecodePlan& plan;
+    unsigned int numberOfInputs;
+    unsigned int numberOfClasses;
+    unsigned int epochs;
+    unsigned int epoch = 0;
+
+    PrefetchSlot<T>* slots;
+    T* arena;
+    unsigned int capacity;
+
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> consumerWaiting{false};
+    std::atomic<bool> producerWaiting{false};
+    Signal filled;  // given to a consumer waiting for a row
+    Signal drained; // given to a producer waiting for a free slot
+    bool threaded = false;
+    unsigned long stalls = 0;
+    Worker worker;
+};
+
+#endif /* DATASETPREFETCH_H_ */
@@ -0,0 +1,424 @@
+#ifndef DATASETREADER_H_
+#define DATASETREADER_H_
+
+/**
+ * Block-buffered reader for fixed-size dataset rows.
+ *
+ * Rows are pulled from the file many at a time into a block buffer and handed
+ * out as pointers, so the filesystem is hit once per block instead of once per
+ * row. With double buffering enabled a background worker fills the second
+ * block while the first one is being consumed.
+ *
+ * The reader can also be opened over a memory-mapped dataset (see
+ * DatasetPartition.h), in which case rows are handed out straight from the
+ * mapping without any copy.
+ *
+ * With shuffling enabled every rewind draws a new permutation of the blocks
+ * and rows inside a block are handed out in a random order, so each epoch sees
+ * a different order while reads stay whole-block and mostly sequential. The
+ * order only depends on the seed and the epoch number.
+ *
+ * The same reader is used by the training path and by anything that evaluates
+ * over the dataset. On the host it reads from a FILE* so it can be benchmarked.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Worker.h"
+
+#if defined(ARDUINO)
+#include <FS.h>
+#else
+#include <stdio.h>
+#include <chrono>
+#endif
+
+#ifndef DATASET_READER_BLOCK_SIZE
+#define DATASET_READER_BLOCK_SIZE 4096 // bytes per block, rounded down to whole rows
+#endif
+
+inline unsigned long readerMicros() {
+#if defined(ARDUINO)
+    return micros();
+#else
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class DatasetReader {
+public:
+#if defined(ARDUINO)
+    typedef File FileType;
+#else
+    typedef FILE* FileType;
+#endif
+
+    DatasetReader(size_t rowSize, size_t blockSize = DATASET_READER_BLOCK_SIZE, bool doubleBuffered = false)
+        : rowSize(rowSize), doubleBuffered(doubleBuffered) {
+        rowsPerBlock = blockSize / rowSize;
+        if (rowsPerBlock == 0) rowsPerBlock = 1;
+        if (rowsPerBlock > 0xFFFF) rowsPerBlock = 0xFFFF;
+        blockBytes = rowsPerBlock * rowSize;
+    }
+
+    ~DatasetReader() {
+        close();
+        free(buffers[0]);
+        free(buffers[1]);
+        free(rowOrder[0]);
+        free(rowOrder[1]);
+        free(blockOrder);
+    }
+
+    // Block + in-block shuffling seeded with seed, takes effect on the next open()
+    void setShuffle(bool enabled, uint32_t seed = 0) {
+        shuffled = enabled;
+        shuffleSeed = seed;
+        shuffleEpoch = 0;
+    }
+
+    // Rows are read from [dataOffset, dataOffset + dataBytes) of the file, so containers with a header
+    // or footer can be streamed as-is. Block buffers are only allocated for file-backed reads.
+    bool open(FileType f, size_t dataOffset = 0, size_t dataBytes = SIZE_MAX) {
+        close();
+        file = f;
+        this->dataOffset = dataOffset;
+        this->dataBytes = dataBytes;
+#if defined(ARDUINO)
+        if (!file) return false;
+#else
+        if (file == nullptr) return false;
+#endif
+        if (buffers[0] == nullptr) buffers[0] = (uint8_t*)malloc(blockBytes);
+        if (doubleBuffered && buffers[1] == nullptr) buffers[1] = (uint8_t*)malloc(blockBytes);
+        if (buffers[0] == nullptr || (doubleBuffered && buffers[1] == nullptr)) {
+            closeFile();
+            return false;
+        }
+        if (shuffled) {
+            size_t total = fileSize();
+            total = total > dataOffset ? total - dataOffset : 0;
+            if (!prepareShuffle((total < dataBytes ? total : dataBytes) / rowSize)) {
+                closeFile();
+                return false;
+            }
+        }
+        opened = true;
+        if (doubleBuffered) {
+            stopping = false;
+            if (!worker.start(fillTask, this, "Dataset Reader", 4096, 0)) {
+                doubleBuffered = false;
+            }
+        }
+        return rewind();
+    }
+
+#if !defined(ARDUINO)
+    bool open(const char* path, size_t dataOffset = 0, size_t dataBytes = SIZE_MAX) {
+        return open(fopen(path, "rb"), dataOffset, dataBytes);
+    }
+#endif
+
+    // Zero-copy mode over a read-only mapping, the mapping must outlive the reader
+    bool open(const uint8_t* data, size_t bytes) {
+        close();
+        if (data == nullptr) return false;
+        mapped = data;
+        mappedBytes = bytes - (bytes % rowSize);
+        if (shuffled && !prepareShuffle(mappedBytes / rowSize)) {
+            mapped = nullptr;
+            return false;
+        }
+        opened = true;
+        return rewind();
+    }
+
+    void close() {
+        if (!opened) return;
+        opened = false;
+        if (mapped != nullptr) {
+            mapped = nullptr;
+            return;
+        }
+        if (worker.isRunning()) {
+            waitPendingFill();
+            stopping = true;
+            fillRequested.give();
+            worker.join();
+        }
+        closeFile();
+    }
+
+    // Restart from the first row, statistics keep accumulating across rewinds
+    bool rewind() {
+        if (!opened) return false;
+        if (startMicros == 0) startMicros = readerMicros();
+        if (mapped != nullptr) {
+            if (shuffled) shuffleBlocks();
+            position = 0;
+            blockRows = 0;
+            exhausted = false;
+            return true;
+        }
+        // The fill task also draws from the generator, it must be idle before the next permutation
+        waitPendingFill();
+        if (shuffled) shuffleBlocks();
+        if (!seekRaw(dataOffset)) return false;
+        remaining = dataBytes;
+        eof = false;
+        exhausted = false;
+        front = 0;
+        position = 0;
+        filled[0] = fillBuffer(0);
+        if (doubleBuffered) requestFill();
+        return true;
+    }
+
+    // Pointer to the next row, valid until the following call to next() or rewind(); nullptr at the end
+    const uint8_t* next() {
+        if (mapped != nullptr) {
+            const uint8_t* row;
+            if (shuffled) {
+                if (position >= blockRows) {
+                    if (nextBlock >= numberOfBlocks) return nullptr;
+                    blockStart = (size_t)blockOrder[nextBlock++] * rowsPerBlock;
+                    blockRows = totalRows - blockStart < rowsPerBlock ? totalRows - blockStart : rowsPerBlock;
+                    shuffleRows(rowOrder[0], blockRows);
+                    position = 0;
+                }
+                row = mapped + (blockStart + rowOrder[0][position++]) * rowSize;
+            } else {
+                if (position + rowSize > mappedBytes) return nullptr;
+                row = mapped + position;
+                position += rowSize;
+            }
+            bytesRead += rowSize;
+            rowsRead++;
+            return row;
+        }
+        if (position + rowSize > filled[front]) {
+            if (exhausted || !advance()) {
+                exhausted = true;
+                return nullptr;
+            }
+        }
+        const uint8_t* row = buffers[front] + (shuffled ? (size_t)rowOrder[front][position / rowSize] * rowSize : position);
+        position += rowSize;
+        rowsRead++;
+        return row;
+    }
+
+    size_t getRowSize() const { return rowSize; }
+    size_t getRowsPerBlock() const { return rowsPerBlock; }
+    unsigned long long getBytesRead() const { return bytesRead; }
+    unsigned long long getRowsRead() const { return rowsRead; }
+    unsigned long getIoMicros() const { return ioMicros; }
+
+    bool isMapped() const { return mapped != nullptr; }
+    bool isShuffled() const { return shuffled; }
+
+    // Filesystem throughput, measured over the time spent inside read calls only (wall clock when mapped)
+    unsigned long bytesPerSecond() const {
+        unsigned long elapsed = mapped != nullptr ? readerMicros() - startMicros : ioMicros;
+        return elapsed == 0 ? 0 : (unsigned long)(bytesRead * 1000000ULL / elapsed);
+    }
+
+    // Rows handed out per wall-clock second since the reader was opened
+    unsigned long rowsPerSecond() const {
+        unsigned long elapsed = readerMicros() - startMicros;
+        return elapsed == 0 ? 0 : (unsigned long)(rowsRead * 1000000ULL / elapsed);
+    }
+
+    DatasetReader(const DatasetReader&) = delete;
+    DatasetReader& operator=(const DatasetReader&) = delete;
+
+protected:
+    bool seekRaw(size_t offset) {
+#if defined(ARDUINO)
+        return file.seek(offset);
+#else
+        return fseek(file, (long)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    size_t fileSize() {
+#if defined(ARDUINO)
+        return file.size();
+#else
+        long current = ftell(file);
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, current, SEEK_SET);
+        return size < 0 ? 0 : (size_t)size;
+#endif
+    }
+
+    void closeFile() {
+#if defined(ARDUINO)
+        file.close();
+#else
+        if (file != nullptr) fclose(file);
+        file = nullptr;
+#endif
+    }
+
+    // Sizes the block permutation and the per-buffer row orders for a dataset of rows rows
+    bool prepareShuffle(size_t rows) {
+        totalRows = rows;
+        numberOfBlocks = (rows + rowsPerBlock - 1) / rowsPerBlock;
+        free(blockOrder);
+        blockOrder = (uint32_t*)malloc((numberOfBlocks > 0 ? numberOfBlocks : 1) * sizeof(uint32_t));
+        for (int i = 0; i < 2; i++) {
+            if (rowOrder[i] == nullptr) rowOrder[i] = (uint16_t*)malloc(rowsPerBlock * sizeof(uint16_t));
+        }
+        nextBlock = numberOfBlocks;
+        return blockOrder != nullptr && rowOrder[0] != nullptr && rowOrder[1] != nullptr;
+    }
+
+    // xorshift32, plenty for ordering rows
+    uint32_t nextRandom() {
+        rngState ^= rngState << 13;
+        rngState ^= rngState >> 17;
+        rngState ^= rngState << 5;
+        return rngState;
+    }
+
+    // New block permutation for the coming epoch, derived from the seed and the epoch number only
+    void shuffleBlocks() {
+        rngState = (shuffleSeed ^ 0x9E3779B9u) + 0x85EBCA6Bu * ++shuffleEpoch;
+        if (rngState == 0) rngState = 1;
+        for (size_t i = 0; i < numberOfBlocks; i++) blockOrder[i] = i;
+        for (size_t i = numberOfBlocks; i > 1; i--) {
+            size_t j = nextRandom() % i;
+            uint32_t t = blockOrder[i - 1]; blockOrder[i - 1] = blockOrder[j]; blockOrder[j] = t;
+        }
+        nextBlock = 0;
+    }
+
+    void shuffleRows(uint16_t* order, size_t rows) {
+        for (size_t i = 0; i < rows; i++) order[i] = i;
+        for (size_t i = rows; i > 1; i--) {
+            size_t j = nextRandom() % i;
+            uint16_t t = order[i - 1]; order[i - 1] = order[j]; order[j] = t;
+        }
+    }
+
+    size_t readRaw(uint8_t* dst, size_t n) {
+#if defined(ARDUINO)
+        return file.read(dst, n);
+#else
+        return fread(dst, 1, n, file);
+#endif
+    }
+
+    // Reads one block, trailing bytes that do not form a whole row are dropped
+    size_t fillBuffer(int index) {
+        if (eof) return 0;
+        if (shuffled) return fillShuffledBuffer(index);
+        size_t want = remaining < blockBytes ? remaining : blockBytes;
+        unsigned long start = readerMicros();
+        size_t n = want == 0 ? 0 : readRaw(buffers[index], want);
+        ioMicros += readerMicros() - start;
+        bytesRead += n;
+        remaining -= n;
+        if (n < blockBytes) eof = true;
+        return n - (n % rowSize);
+    }
+
+    // Reads the next block of the permutation and draws the order of its rows
+    size_t fillShuffledBuffer(int index) {
+        if (nextBlock >= numberOfBlocks) {
+            eof = true;
+            return 0;
+        }
+        size_t block = blockOrder[nextBlock++];
+        size_t rows = totalRows - block * rowsPerBlock < rowsPerBlock ? totalRows - block * rowsPerBlock : rowsPerBlock;
+        unsigned long start = readerMicros();
+        size_t n = seekRaw(dataOffset + block * blockBytes) ? readRaw(buffers[index], rows * rowSize) : 0;
+        ioMicros += readerMicros() - start;
+        bytesRead += n;
+        shuffleRows(rowOrder[index], n / rowSize);
+        return n - (n % rowSize);
+    }
+
+    bool advance() {
+        if (!doubleBuffered) {
+            filled[0] = fillBuffer(0);
+            position = 0;
+            return filled[0] >= rowSize;
+        }
+        waitPendingFill();
+        front ^= 1;
+        position = 0;
+        if (filled[front] < rowSize) return false;
+        requestFill();
+        return true;
+    }
+
+    void requestFill() {
+        pendingFill = true;
+        fillRequested.give();
+    }
+
+    void waitPendingFill() {
+        if (pendingFill) {
+            fillDone.take();
+            pendingFill = false;
+        }
+    }
+
+    static void fillTask(void* arg) {
+        DatasetReader* reader = (DatasetReader*)arg;
+        while (true) {
+            reader->fillRequested.take();
+            if (reader->stopping) break;
+            int back = reader->front ^ 1;
+            reader->filled[back] = reader->fillBuffer(back);
+            reader->fillDone.give();
+        }
+    }
+
+    FileType file{};
+    bool opened = false;
+    const uint8_t* mapped = nullptr;
+    size_t mappedBytes = 0;
+    size_t rowSize;
+    size_t rowsPerBlock;
+    size_t blockBytes;
+    bool doubleBuffered;
+    uint8_t* buffers[2] = {nullptr, nullptr};
+    size_t filled[2] = {0, 0};
+    volatile int front = 0;
+    size_t position = 0;
+    size_t dataOffset = 0;
+    bool shuffled = false;
+    uint32_t shuffleSeed = 0;
+    uint32_t shuffleEpoch = 0;
+    uint32_t rngState = 1;
+    uint32_t* blockOrder = nullptr;
+    uint16_t* rowOrder[2] = {nullptr, nullptr};
+    size_t numberOfBlocks = 0;
+    size_t nextBlock = 0;
+    size_t totalRows = 0;
+    size_t blockStart = 0;
+    size_t blockRows = 0;
+    size_t dataBytes = SIZE_MAX;
+    size_t remaining = SIZE_MAX;
+    volatile bool eof = false;
+    bool exhausted = false;
+
+    bool pendingFill = false;
+    volatile bool stopping = false;
+    Signal fillRequested;
+    Signal fillDone;
+    Worker worker;
+
+    unsigned long long bytesRead = 0;
+    unsigned long long rowsRead = 0;
+    unsigned long ioMicros = 0;
+    unsigned long startMicros = 0;
+};
+
+#endif /* DATASETREADER_H_ */
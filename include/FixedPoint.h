@@ -0,0 +1,531 @@
+#ifndef FIXEDPOINT_H_
+#define FIXEDPOINT_H_
+
+/**
+ * Fixed point training backend (USE_FIXED_POINT).
+ *
+ * The ESP32 has a single precision FPU and no double one, so every multiply
+ * of the 64-bit build is a software routine. FixedPointTrainer keeps its own
+ * int16 copy of the network and trains it with integer arithmetic only:
+ *   - weights and biases in Q3.12 (range +-8), saturated on every update,
+ *   - hidden activations in Q15, deltas in Q7.24 so the ones reaching the
+ *     first layers do not underflow,
+ *   - the network inputs in block floating point: one Q format per batch
+ *     picked from the largest |x|, so raw sensor values keep 15 bits,
+ *   - every inner loop multiplies int16 by int16 into an int32 accumulator.
+ *     Each layer keeps a shift that makes the sum fit: forward from the
+ *     largest row of |w|, backward from the largest delta of the batch.
+ *     The Xtensa core has no 64-bit multiply-accumulate, so this keeps the
+ *     loops at one MULL and one ADD per product. Updates use stochastic
+ *     rounding, so steps smaller than one weight LSB still move the weights
+ *     on average,
+ *   - Sigmoid/Tanh/Softmax (and ELU/SELU) are piecewise linear over small
+ *     tables.
+ *
+ * Activations are Q15, so ReLU, Leaky ReLU, ELU and SELU outputs would
+ * saturate at 1.0 while the float network commit() writes back has no such
+ * limit. A network with any of them would train on a clipped function and
+ * infer on an unclipped one, so FixedPointTrainer hands such a topology to a
+ * BatchTrainer and trains it in float (isFixedPoint() is false). Sigmoid,
+ * Tanh and Softmax never exceed 1.0, the default tanh/softmax topology
+ * trains in fixed point.
+ *
+ * The interface matches BatchTrainer (float rows in, float outputs back), and
+ * the float NeuralNetwork stays the model of record: load() quantizes it
+ * before training and commit() writes the trained weights back, so the
+ * saved and federated model format does not change.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTrainer.h"
+
+#define FIXED_WEIGHT_FRAC 12 // Q3.12 weights and biases
+#define FIXED_ACT_FRAC 15    // Q15 activations
+#define FIXED_ONE (1 << FIXED_ACT_FRAC)
+#define FIXED_DELTA_FRAC 24  // Q7.24 deltas
+#define FIXED_LR_FRAC 24     // learning rates as Q24
+
+inline int16_t fixedSaturate16(int64_t v) {
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+inline int32_t fixedSaturate32(int64_t v) {
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : (int32_t)v);
+}
+
+// Shift that brings values below 2^bits down to below 2^keep
+inline int fixedShiftFor(uint32_t largest, int keep) {
+    int bits = 0;
+    while (bits < 32 && (largest >> bits) != 0) bits++;
+    return bits > keep ? bits - keep : 0;
+}
+
+// ceil(log2(n)), the headroom a sum of n terms needs
+inline int fixedCeilLog2(uint32_t n) {
+    int bits = 0;
+    while (bits < 32 && (1u << bits) < n) bits++;
+    return bits;
+}
+
+// v * 2^shift for either sign of shift
+inline int32_t fixedScale(int64_t v, int shift) {
+    return fixedSaturate32(shift >= 0 ? v << shift : v >> -shift);
+}
+
+inline int16_t fixedFromFloat(float v, int frac) {
+    return fixedSaturate16((int64_t)lrintf(v * (float)(1 << frac)));
+}
+
+inline float fixedToFloat(int32_t v, int frac) {
+    return (float)v / (float)(1 << frac);
+}
+
+// tanh over [0, 4] in steps of 1/8, Q15
+static const int32_t FIXED_TANH_TABLE[33] = {
+    0, 4075, 8025, 11743, 15143, 18173, 20813, 23066, 24956, 26519, 27797, 28830, 29660, 30322, 30847, 31262, 31589,
+    31846, 32048, 32206, 32329, 32426, 32501, 32560, 32606, 32642, 32670, 32691, 32708, 32721, 32732, 32740, 32746};
+// 2^(-k/16) for k = 0..16, Q15
+static const int32_t FIXED_EXP2_TABLE[17] = {
+    32768, 31379, 30048, 28774, 27554, 26386, 25268, 24196, 23170, 22188, 21247, 20347, 19484, 18658, 17867, 17109, 16384};
+#define FIXED_LOG2E_Q12 5909
+
+// tanh of a Q12 value, Q15 result, linear between table points (error below 2e-3)
+inline int32_t fixedTanh(int32_t z) {
+    bool negative = z < 0;
+    uint32_t u = negative ? -(int64_t)z : z;
+    int32_t t;
+    if (u >= (4u << FIXED_WEIGHT_FRAC)) {
+        t = FIXED_TANH_TABLE[32];
+    } else {
+        uint32_t k = u >> 9; // 1/8 in Q12
+        int32_t f = u & 511;
+        t = FIXED_TANH_TABLE[k] + (((FIXED_TANH_TABLE[k + 1] - FIXED_TANH_TABLE[k]) * f) >> 9);
+    }
+    return negative ? -t : t;
+}
+
+// exp of a Q12 value <= 0, Q15 result, as 2^(z log2 e) with a linear 2^-f table (relative error below 5e-4)
+inline int32_t fixedExp(int32_t z) {
+    if (z >= 0) return FIXED_ONE;
+    int64_t u = (-(int64_t)z * FIXED_LOG2E_Q12) >> FIXED_WEIGHT_FRAC; // -z log2 e, Q12
+    int64_t n = u >> FIXED_WEIGHT_FRAC;
+    if (n >= FIXED_ACT_FRAC + 1) return 0;
+    int32_t fraction = u & ((1 << FIXED_WEIGHT_FRAC) - 1);
+    int32_t k = fraction >> 8; // 1/16 in Q12
+    int32_t f = fraction & 255;
+    int32_t v = FIXED_EXP2_TABLE[k] + (((FIXED_EXP2_TABLE[k + 1] - FIXED_EXP2_TABLE[k]) * f) >> 8);
+    return v >> n;
+}
+
+class FixedPointTrainer {
+public:
+    FixedPointTrainer(const TrainLayer* layers, unsigned int numberOfLayers, unsigned int batchSize)
+        : numberOfLayers(numberOfLayers), batchSize(batchSize > 0 ? batchSize : 1) {
+        if (!supports(layers, numberOfLayers)) {
+            fallback = new BatchTrainer(layers, numberOfLayers, batchSize);
+            return;
+        }
+        this->layers = new TrainLayer[numberOfLayers];
+        memcpy(this->layers, layers, numberOfLayers * sizeof(TrainLayer));
+        weightOffsets = new size_t[numberOfLayers + 1];
+        activationOffsets = new size_t[numberOfLayers + 1];
+        forwardShift = new int[numberOfLayers];
+
+        size_t weights = 0, activations = (size_t)layers[0].inputs * this->batchSize;
+        maxWidth = layers[0].inputs;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            weightOffsets[l] = weights;
+            weights += (size_t)layers[l].outputs * (layers[l].inputs + 1); // bias last in each row
+            activationOffsets[l] = l == 0 ? 0 : activationOffsets[l - 1] + (size_t)layers[l - 1].inputs * this->batchSize;
+            activations += (size_t)layers[l].outputs * this->batchSize;
+            if (layers[l].outputs > maxWidth) maxWidth = layers[l].outputs;
+        }
+        weightOffsets[numberOfLayers] = weights;
+        activationOffsets[numberOfLayers] = activationOffsets[numberOfLayers - 1] + (size_t)layers[numberOfLayers - 1].inputs * this->batchSize;
+
+        unsigned int outputs = layers[numberOfLayers - 1].outputs;
+        weightArena = (int16_t*)malloc(weights * sizeof(int16_t));
+        activationArena = (int16_t*)malloc(activations * sizeof(int16_t));
+        deltaArena = (int32_t*)malloc(2 * (size_t)maxWidth * this->batchSize * sizeof(int32_t));
+        gradient = (int32_t*)malloc((size_t)maxWidth * sizeof(int32_t));
+        floatArena = (IDFLOAT*)malloc(((size_t)layers[0].inputs + 2 * outputs) * this->batchSize * sizeof(IDFLOAT));
+        if (!isValid()) return;
+        deltas[0] = deltaArena;
+        deltas[1] = deltaArena + (size_t)maxWidth * this->batchSize;
+        load();
+    }
+
+    ~FixedPointTrainer() {
+        delete fallback;
+        free(weightArena);
+        free(activationArena);
+        free(deltaArena);
+        free(gradient);
+        free(floatArena);
+        delete[] weightOffsets;
+        delete[] activationOffsets;
+        delete[] forwardShift;
+        delete[] layers;
+    }
+
+    // Only activations that stay within [-1, 1] fit the Q15 outputs
+    static bool supports(const TrainLayer* layers, unsigned int numberOfLayers) {
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            uint8_t a = layers[l].activation;
+            if (a != TrainActivation_SIGMOID && a != TrainActivation_TANH && a != TrainActivation_SOFTMAX) return false;
+        }
+        return true;
+    }
+
+    bool isFixedPoint() const { return fallback == nullptr; }
+
+    bool isValid() const {
+        if (fallback != nullptr) return fallback->isValid();
+        return weightArena != nullptr && activationArena != nullptr && deltaArena != nullptr && gradient != nullptr && floatArena != nullptr;
+    }
+    unsigned int getBatchSize() const { return batchSize; }
+
+    IDFLOAT* input(unsigned int b) {
+        if (fallback != nullptr) return fallback->input(b);
+        return floatArena + (size_t)b * layers[0].inputs;
+    }
+    IDFLOAT* target(unsigned int b) {
+        if (fallback != nullptr) return fallback->target(b);
+        return floatArena + (size_t)layers[0].inputs * batchSize + (size_t)b * layers[numberOfLayers - 1].outputs;
+    }
+    const IDFLOAT* output(unsigned int b) const {
+        if (fallback != nullptr) return fallback->output(b);
+        return outputs() + (size_t)b * layers[numberOfLayers - 1].outputs;
+    }
+
+    // Quantizes the float network the layers point to
+    void load() {
+        if (fallback != nullptr) return fallback->load();
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            uint32_t largest = 0;
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                int16_t* row = weightRow(l, i);
+                uint32_t magnitude = 0;
+                for (unsigned int j = 0; j < layer.inputs; j++) {
+                    row[j] = fixedFromFloat(layer.weights[i][j], FIXED_WEIGHT_FRAC);
+                    magnitude += abs(row[j]);
+                }
+                row[layer.inputs] = fixedFromFloat(layer.bias[i], FIXED_WEIGHT_FRAC);
+                magnitude += abs(row[layer.inputs]);
+                if (magnitude > largest) largest = magnitude;
+            }
+            setForwardShift(l, largest);
+        }
+    }
+
+    // Writes the fixed point weights back into the float network
+    void commit() {
+        if (fallback != nullptr) return fallback->commit();
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                const int16_t* row = weightRow(l, i);
+                for (unsigned int j = 0; j < layer.inputs; j++) layer.weights[i][j] = fixedToFloat(row[j], FIXED_WEIGHT_FRAC);
+                layer.bias[i] = fixedToFloat(row[layer.inputs], FIXED_WEIGHT_FRAC);
+            }
+        }
+    }
+
+    void forward(unsigned int count) {
+        if (fallback != nullptr) return fallback->forward(count);
+        quantizeInputs(count);
+        int inputFrac = inputFracBits;
+        int32_t z[maxWidth];
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            const int16_t* in = activationArena + activationOffsets[l];
+            int16_t* out = activationArena + activationOffsets[l + 1];
+            // Products are Q(12 + inputFrac) before the layer's shift, activations take Q12 pre-activations
+            int productShift = forwardShift[l];
+            int shift = inputFrac - productShift;
+            for (unsigned int b = 0; b < count; b++) {
+                const int16_t* x = in + (size_t)b * layer.inputs;
+                for (unsigned int i = 0; i < layer.outputs; i++) {
+                    const int16_t* w = weightRow(l, i);
+                    int32_t acc = fixedScale(w[layer.inputs], shift);
+                    if (productShift == 0) {
+                        for (unsigned int j = 0; j < layer.inputs; j++) acc += (int32_t)w[j] * x[j];
+                    } else {
+                        for (unsigned int j = 0; j < layer.inputs; j++) acc += ((int32_t)w[j] * x[j]) >> productShift;
+                    }
+                    z[i] = fixedScale(acc, -shift);
+                }
+                activate(layer.activation, z, out + (size_t)b * layer.outputs, layer.outputs);
+            }
+            inputFrac = FIXED_ACT_FRAC;
+        }
+        IDFLOAT* result = outputs();
+        const int16_t* last = activationArena + activationOffsets[numberOfLayers];
+        for (size_t k = 0; k < (size_t)count * layers[numberOfLayers - 1].outputs; k++) result[k] = fixedToFloat(last[k], FIXED_ACT_FRAC);
+    }
+
+    // Same contract as BatchTrainer::train, the error is computed from the Q15 outputs
+    DFLOAT train(unsigned int count, DFLOAT learningRateOfWeights, DFLOAT learningRateOfBiases) {
+        if (fallback != nullptr) return fallback->train(count, learningRateOfWeights, learningRateOfBiases);
+        if (count == 0) return 0;
+        if (count > batchSize) count = batchSize;
+        forward(count);
+
+        const TrainLayer& last = layers[numberOfLayers - 1];
+        const int16_t* a = activationArena + activationOffsets[numberOfLayers];
+        int32_t* delta = deltas[0];
+        uint32_t squaredError = 0; // Q15, one term is below 2^17
+        for (unsigned int b = 0; b < count; b++) {
+            const IDFLOAT* y = target(b);
+            for (unsigned int i = 0; i < last.outputs; i++) {
+                size_t k = (size_t)b * last.outputs + i;
+                int32_t e = (int32_t)a[k] - fixedFromFloat(y[i], FIXED_ACT_FRAC);
+                uint32_t m = e < 0 ? -e : e;
+                squaredError += (m * m) >> FIXED_ACT_FRAC;
+                delta[k] = (int32_t)(((int64_t)e * derivative(last.activation, a[k])) >> (2 * FIXED_ACT_FRAC - FIXED_DELTA_FRAC));
+            }
+        }
+
+        int64_t rateWeights = (int64_t)llround(learningRateOfWeights * (double)(1 << FIXED_LR_FRAC) / count);
+        int64_t rateBiases = (int64_t)llround(learningRateOfBiases * (double)(1 << FIXED_LR_FRAC) / count);
+        int current = 0;
+        for (int l = numberOfLayers - 1; l >= (int)firstTrainable; l--) {
+            const TrainLayer& layer = layers[l];
+            const int16_t* in = activationArena + activationOffsets[l];
+            int inputFrac = l == 0 ? inputFracBits : FIXED_ACT_FRAC;
+            delta = deltas[current];
+            int32_t* previous = deltas[current ^ 1];
+            bool propagate = l > (int)firstTrainable;
+            bool frozen = (unsigned int)l > lastTrainable;
+
+            // Deltas are cut to 15 bits so delta * weight fits in int32, the sum over outputs gets its own headroom
+            uint32_t largest = 0;
+            for (size_t k = 0; k < (size_t)count * layer.outputs; k++) {
+                uint32_t m = delta[k] < 0 ? -(int64_t)delta[k] : delta[k];
+                if (m > largest) largest = m;
+            }
+            int propagateShift = fixedShiftFor(largest, 15);
+            int outputShift = fixedCeilLog2(layer.outputs);
+            int gradientShift = fixedCeilLog2(count);
+            if (propagate) memset(previous, 0, (size_t)count * layer.inputs * sizeof(int32_t));
+
+            uint32_t largestRow = 0;
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                int16_t* w = weightRow(l, i);
+                // The rate is folded into the row's deltas, cut to 15 bits so delta * input fits in int32
+                int rowShift = 0;
+                int64_t biasGradient = 0;
+                if (!frozen) {
+                    memset(gradient, 0, (size_t)layer.inputs * sizeof(int32_t));
+                    uint64_t rowLargest = 0;
+                    for (unsigned int b = 0; b < count; b++) {
+                        int64_t d = delta[(size_t)b * layer.outputs + i];
+                        uint64_t m = (uint64_t)(d < 0 ? -d : d) * (uint64_t)rateWeights;
+                        if (m > rowLargest) rowLargest = m;
+                    }
+                    while ((rowLargest >> rowShift) >= (1u << 15)) rowShift++;
+                }
+                for (unsigned int b = 0; b < count; b++) {
+                    int32_t d = delta[(size_t)b * layer.outputs + i];
+                    if (d == 0) continue;
+                    if (!frozen) {
+                        biasGradient += d;
+                        int32_t g = (int32_t)(((int64_t)d * rateWeights) >> rowShift);
+                        const int16_t* x = in + (size_t)b * layer.inputs;
+                        if (gradientShift == 0) {
+                            for (unsigned int j = 0; j < layer.inputs; j++) gradient[j] += g * x[j];
+                        } else {
+                            for (unsigned int j = 0; j < layer.inputs; j++) gradient[j] += (g * x[j]) >> gradientShift;
+                        }
+                    }
+                    if (propagate) {
+                        int32_t dp = d >> propagateShift;
+                        int32_t* p = previous + (size_t)b * layer.inputs;
+                        for (unsigned int j = 0; j < layer.inputs; j++) p[j] += (dp * w[j]) >> outputShift;
+                    }
+                }
+                if (frozen) continue;
+                // gradient is Q(24 + 24 + inputFrac) of rate * gradient before the row's shifts, weights are Q12
+                int shift = FIXED_DELTA_FRAC + FIXED_LR_FRAC + inputFrac - FIXED_WEIGHT_FRAC - rowShift - gradientShift;
+                uint32_t magnitude = 0;
+                for (unsigned int j = 0; j < layer.inputs; j++) {
+                    w[j] = fixedSaturate16(w[j] - roundStochastic(gradient[j], shift));
+                    magnitude += abs(w[j]);
+                }
+                int32_t step = fixedSaturate32((biasGradient * rateBiases) >> (FIXED_DELTA_FRAC + FIXED_LR_FRAC - FIXED_WEIGHT_FRAC - 16));
+                w[layer.inputs] = fixedSaturate16(w[layer.inputs] - roundStochastic(step, 16));
+                magnitude += abs(w[layer.inputs]);
+                if (magnitude > largestRow) largestRow = magnitude;
+            }
+            if (!frozen) {
+                weightWrites += (unsigned long long)layer.outputs * layer.inputs;
+                setForwardShift(l, largestRow);
+            }
+
+            if (propagate) {
+                // Q(24 - propagateShift + 12 - outputShift) sums back to Q24 deltas
+                uint8_t activation = layers[l - 1].activation;
+                int back = FIXED_ACT_FRAC + FIXED_WEIGHT_FRAC - propagateShift - outputShift;
+                for (size_t k = 0; k < (size_t)count * layer.inputs; k++) {
+                    previous[k] = fixedScale((int64_t)previous[k] * derivative(activation, in[k]), -back);
+                }
+            }
+            current ^= 1;
+        }
+        return (DFLOAT)((double)squaredError / FIXED_ONE / ((double)count * last.outputs));
+    }
+
+    // Only layers first..last (inclusive) are updated, as in BatchTrainer
+    void setTrainableLayers(unsigned int first, unsigned int last) {
+        if (fallback != nullptr) return fallback->setTrainableLayers(first, last);
+        lastTrainable = last < numberOfLayers ? last : numberOfLayers - 1;
+        firstTrainable = first <= lastTrainable ? first : lastTrainable;
+    }
+
+    // Layers are not split between cores in fixed point, always false
+    bool enableParallel(size_t minWork, int core = 0) {
+        if (fallback != nullptr) return fallback->enableParallel(minWork, core);
+        return false;
+    }
+    unsigned long getParallelLayers() const { return fallback != nullptr ? fallback->getParallelLayers() : 0; }
+    // Updates stay plain SGD in fixed point, the state stays empty
+    bool enableOptimizer(const OptimizerSettings& settings, bool reduced) {
+        if (fallback != nullptr) return fallback->enableOptimizer(settings, reduced);
+        return settings.type == Optimizer_SGD;
+    }
+    const OptimizerState& getOptimizer() const { return fallback != nullptr ? fallback->getOptimizer() : optimizer; }
+    size_t getParameterCount() const { return fallback != nullptr ? fallback->getParameterCount() : 0; }
+
+    unsigned long long getWeightWrites() const { return fallback != nullptr ? fallback->getWeightWrites() : weightWrites; }
+    int getInputFracBits() const { return inputFracBits; }
+    size_t getWeightBytes() const { return fallback != nullptr ? 0 : weightOffsets[numberOfLayers] * sizeof(int16_t); }
+
+    // Activation of Q12 pre-activations into Q15 outputs
+    static void activate(uint8_t activation, const int32_t* z, int16_t* out, unsigned int n) {
+        switch (activation) {
+            case TrainActivation_SIGMOID:
+                for (unsigned int i = 0; i < n; i++) out[i] = fixedSaturate16((fixedTanh(z[i] / 2) + FIXED_ONE) >> 1);
+                break;
+            case TrainActivation_TANH:
+                for (unsigned int i = 0; i < n; i++) out[i] = fixedSaturate16(fixedTanh(z[i]));
+                break;
+            case TrainActivation_RELU:
+                for (unsigned int i = 0; i < n; i++) out[i] = z[i] > 0 ? fixedSaturate16((int64_t)z[i] << (FIXED_ACT_FRAC - FIXED_WEIGHT_FRAC)) : 0;
+                break;
+            case TrainActivation_LEAKY_RELU:
+                for (unsigned int i = 0; i < n; i++) {
+                    int64_t v = (int64_t)z[i] << (FIXED_ACT_FRAC - FIXED_WEIGHT_FRAC);
+                    out[i] = fixedSaturate16(z[i] > 0 ? v : v / 100);
+                }
+                break;
+            case TrainActivation_ELU:
+                for (unsigned int i = 0; i < n; i++) {
+                    out[i] = z[i] > 0 ? fixedSaturate16((int64_t)z[i] << (FIXED_ACT_FRAC - FIXED_WEIGHT_FRAC)) : fixedSaturate16(fixedExp(z[i]) - FIXED_ONE);
+                }
+                break;
+            case TrainActivation_SELU:
+                for (unsigned int i = 0; i < n; i++) {
+                    int64_t v = z[i] > 0 ? (int64_t)z[i] << (FIXED_ACT_FRAC - FIXED_WEIGHT_FRAC) : (int64_t)(TRAIN_ALPHA_SELU * (fixedExp(z[i]) - FIXED_ONE));
+                    out[i] = fixedSaturate16((int64_t)(TRAIN_LAMBDA_SELU * v));
+                }
+                break;
+            case TrainActivation_SOFTMAX: {
+                int32_t m = z[0];
+                for (unsigned int i = 1; i < n; i++) if (z[i] > m) m = z[i];
+                int32_t e[n];
+                int64_t sum = 0;
+                for (unsigned int i = 0; i < n; i++) sum += e[i] = fixedExp(z[i] - m);
+                for (unsigned int i = 0; i < n; i++) out[i] = fixedSaturate16(((int64_t)e[i] << FIXED_ACT_FRAC) / sum);
+                break;
+            }
+            default:
+                for (unsigned int i = 0; i < n; i++) out[i] = fixedSaturate16((int64_t)z[i] << (FIXED_ACT_FRAC - FIXED_WEIGHT_FRAC));
+                break;
+        }
+    }
+
+    // Derivative through the Q15 output a, Q15 result
+    static int32_t derivative(uint8_t activation, int32_t a) {
+        switch (activation) {
+            case TrainActivation_SIGMOID:
+            case TrainActivation_SOFTMAX: return (a * (FIXED_ONE - a)) >> FIXED_ACT_FRAC;
+            case TrainActivation_TANH: return FIXED_ONE - ((a * a) >> FIXED_ACT_FRAC);
+            case TrainActivation_RELU: return a > 0 ? FIXED_ONE : 0;
+            case TrainActivation_LEAKY_RELU: return a > 0 ? FIXED_ONE : FIXED_ONE / 100;
+            case TrainActivation_ELU: return a > 0 ? FIXED_ONE : a + FIXED_ONE;
+            case TrainActivation_SELU: return a > 0 ? (int32_t)(TRAIN_LAMBDA_SELU * FIXED_ONE) : a + (int32_t)(TRAIN_LAMBDA_SELU * TRAIN_ALPHA_SELU * FIXED_ONE);
+            default: return FIXED_ONE;
+        }
+    }
+
+    FixedPointTrainer(const FixedPointTrainer&) = delete;
+    FixedPointTrainer& operator=(const FixedPointTrainer&) = delete;
+
+private:
+    IDFLOAT* outputs() const { return floatArena + ((size_t)layers[0].inputs + layers[numberOfLayers - 1].outputs) * batchSize; }
+
+    int16_t* weightRow(unsigned int l, unsigned int i) const {
+        return weightArena + weightOffsets[l] + (size_t)i * (layers[l].inputs + 1);
+    }
+
+    // |x| <= 2^15, so a row whose |w| (bias included) sums below 2^(16 + shift) keeps its dot product within int32
+    void setForwardShift(unsigned int l, uint32_t largestRow) { forwardShift[l] = fixedShiftFor(largestRow, 16); }
+
+    // One Q format for the whole batch, as many fraction bits as the largest |x| allows
+    void quantizeInputs(unsigned int count) {
+        size_t n = (size_t)count * layers[0].inputs;
+        float largest = 0;
+        for (size_t k = 0; k < n; k++) {
+            float v = fabsf((float)floatArena[k]);
+            if (v > largest) largest = v;
+        }
+        int frac = FIXED_ACT_FRAC;
+        while (frac > 0 && largest * (float)(1 << frac) >= 32767.0f) frac--;
+        inputFracBits = frac;
+        int16_t* x = activationArena;
+        for (size_t k = 0; k < n; k++) x[k] = fixedFromFloat((float)floatArena[k], frac);
+    }
+
+    // value >> shift, rounded up with probability equal to the dropped fraction
+    int32_t roundStochastic(int32_t value, int shift) {
+        if (shift <= 0) return fixedScale(value, -shift);
+        if (shift > 31) {
+            // Only the top 31 dropped bits take part in the rounding
+            value >>= shift - 31;
+            shift = 31;
+        }
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        uint32_t fraction = (uint32_t)value & ((1u << shift) - 1);
+        return (value >> shift) + (int32_t)((fraction + (rng >> (32 - shift))) >> shift);
+    }
+
+    BatchTrainer* fallback = nullptr; // float training for topologies with unbounded activations
+    TrainLayer* layers = nullptr;
+    unsigned int numberOfLayers;
+    unsigned int batchSize;
+    unsigned int maxWidth = 0;
+    size_t* weightOffsets = nullptr;
+    size_t* activationOffsets = nullptr; // activationOffsets[0] = inputs, activationOffsets[l + 1] = outputs of layer l
+    int* forwardShift = nullptr;         // per layer, see setForwardShift()
+
+    int16_t* weightArena = nullptr;
+    int16_t* activationArena = nullptr;
+    int32_t* deltaArena = nullptr;
+    int32_t* deltas[2] = {nullptr, nullptr};
+    int32_t* gradient = nullptr; // one row, Q(48 + inputFrac) before the row's shifts
+    IDFLOAT* floatArena = nullptr; // float inputs, targets and outputs for the caller
+    int inputFracBits = FIXED_ACT_FRAC;
+    uint32_t rng = 0x9E3779B9;
+    unsigned long long weightWrites = 0;
+    OptimizerState optimizer;
+    unsigned int firstTrainable = 0;
+    unsigned int lastTrainable = ~0u;
+};
+
+#endif /* FIXEDPOINT_H_ */
@@ -0,0 +1,114 @@
+#ifndef FLATMODEL_H_
+#define FLATMODEL_H_
+
+/**
+ * One aligned block holding every weight and bias of a network.
+ *
+ * The library allocates one array per neuron, which scatters a model over
+ * the heap in hundreds of small allocations. A FlatModel keeps all
+ * parameters together in the order the federation messages use: the weights
+ * of every layer ([layer][output][input]), then the biases of every layer.
+ * The topology and activations follow, so the block can be handed to the
+ * library's pre-trained constructor, which keeps pointers into it instead of
+ * allocating rows. Saving, sending, checkpointing and delta computation then
+ * walk one array.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTrainer.h"
+
+#ifndef IDFLOAT
+#define IDFLOAT float
+#endif
+
+#ifndef FLAT_MODEL_ALIGNMENT
+#define FLAT_MODEL_ALIGNMENT 16 // bytes, a power of two
+#endif
+
+class FlatModel {
+public:
+    // topology holds numberOfLayers + 1 sizes, activations one per layer
+    FlatModel(const unsigned int* topology, const uint8_t* activations, unsigned int numberOfLayers) : numberOfLayers(numberOfLayers) {
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            weightCount += (size_t)topology[l] * topology[l + 1];
+            biasCount += topology[l + 1];
+        }
+        size_t parameterBytes = (weightCount + biasCount) * sizeof(IDFLOAT);
+        size_t topologyOffset = align(parameterBytes, sizeof(unsigned int));
+        size_t activationOffset = topologyOffset + (numberOfLayers + 1) * sizeof(unsigned int);
+        bytes = activationOffset + numberOfLayers;
+
+        raw = (uint8_t*)malloc(bytes + FLAT_MODEL_ALIGNMENT - 1);
+        if (raw == nullptr) return;
+        block = (uint8_t*)align((uintptr_t)raw, FLAT_MODEL_ALIGNMENT);
+        layerTopology = (unsigned int*)(block + topologyOffset);
+        layerActivations = block + activationOffset;
+        memcpy(layerTopology, topology, (numberOfLayers + 1) * sizeof(unsigned int));
+        memcpy(layerActivations, activations, numberOfLayers);
+    }
+
+    ~FlatModel() { free(raw); }
+
+    bool isValid() const { return raw != nullptr; }
+
+    // All parameters, weights first, then biases
+    IDFLOAT* parameters() { return (IDFLOAT*)block; }
+    const IDFLOAT* parameters() const { return (const IDFLOAT*)block; }
+    size_t getParameterCount() const { return weightCount + biasCount; }
+
+    IDFLOAT* weights() { return parameters(); }
+    IDFLOAT* biases() { return parameters() + weightCount; }
+    size_t getWeightCount() const { return weightCount; }
+    size_t getBiasCount() const { return biasCount; }
+
+    unsigned int* topology() { return layerTopology; }
+    uint8_t* activations() { return layerActivations; }
+    unsigned int getNumberOfLayers() const { return numberOfLayers; }
+
+    // Bytes of the block, parameters plus topology
+    size_t getBytes() const { return bytes; }
+
+    // True when layers have this model's topology and activations
+    bool matches(const TrainLayer* layers, unsigned int count) const {
+        if (count != numberOfLayers) return false;
+        for (unsigned int l = 0; l < count; l++) {
+            if (layers[l].inputs != layerTopology[l] || layers[l].outputs != layerTopology[l + 1] || layers[l].activation != layerActivations[l]) return false;
+        }
+        return true;
+    }
+
+    // Copies the parameters of a row-allocated network into the block
+    void gather(const TrainLayer* layers) {
+        IDFLOAT* w = weights();
+        IDFLOAT* b = biases();
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                memcpy(w, layer.weights[i], layer.inputs * sizeof(IDFLOAT));
+                w += layer.inputs;
+            }
+            memcpy(b, layer.bias, layer.outputs * sizeof(IDFLOAT));
+            b += layer.outputs;
+        }
+    }
+
+    FlatModel(const FlatModel&) = delete;
+    FlatModel& operator=(const FlatModel&) = delete;
+
+private:
+    static size_t align(size_t v, size_t alignment) { return (v + alignment - 1) & ~(alignment - 1); }
+
+    uint8_t* raw = nullptr;
+    uint8_t* block = nullptr;
+    unsigned int* layerTopology = nullptr;
+    uint8_t* layerActivations = nullptr;
+    unsigned int numberOfLayers;
+    size_t weightCount = 0;
+    size_t biasCount = 0;
+    size_t bytes = 0;
+};
+
+#endif /* FLATMODEL_H_ */
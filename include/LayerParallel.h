@@ -0,0 +1,92 @@
+#ifndef LAYERPARALLEL_H_
+#define LAYERPARALLEL_H_
+
+/**
+ * Two-way split of layer work between the calling task and one helper.
+ *
+ * Training runs on core 1 while core 0 mostly waits for MQTT messages. A
+ * SplitWorker keeps one helper task pinned to core 0 (a std::thread on the
+ * host) parked on a Signal. run() hands it part 1 of a job, runs part 0 on the
+ * caller and returns once both halves finished, which is the per-layer
+ * barrier. Without a helper both parts run on the caller.
+ *
+ * Core 0 is shared during training. The helper runs at priority 1 next to
+ * the MQTT task ("Atlantico Device", which polls every 100 ms) and the
+ * dataset prefetcher (or the double-buffer filler). All three block on a
+ * Signal when idle, and WiFi/lwIP preempt them at higher priorities. A busy
+ * helper can hold back an MQTT poll by one time slice per ready peer, so
+ * training logs the longest gap between MQTT polls.
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include "Worker.h"
+
+class SplitWorker {
+public:
+    typedef void (*SplitFunction)(void* context, unsigned int part);
+
+    SplitWorker() {}
+    ~SplitWorker() { stop(); }
+
+    bool start(int core = 0, unsigned int priority = 1) {
+        if (helper.isRunning()) return true;
+        stopping = false;
+        return helper.start(helperTask, this, "Layer Split", 4096, core, priority);
+    }
+
+    void stop() {
+        if (!helper.isRunning()) return;
+        stopping = true;
+        startSignal.give();
+        helper.join();
+    }
+
+    bool isRunning() const { return helper.isRunning(); }
+
+    // fn(context, 0) on the caller and fn(context, 1) on the helper, returns when both are done
+    void run(SplitFunction fn, void* context) {
+        if (!helper.isRunning()) {
+            fn(context, 0);
+            fn(context, 1);
+            return;
+        }
+        job = fn;
+        jobContext = context;
+        startSignal.give();
+        fn(context, 0);
+        doneSignal.take();
+        splits++;
+    }
+
+    // Number of jobs that ran on both cores
+    unsigned long getSplits() const { return splits; }
+
+    // First index of part in [0, n) split in two
+    static unsigned int partStart(unsigned int n, unsigned int part) { return part == 0 ? 0 : n / 2; }
+    static unsigned int partEnd(unsigned int n, unsigned int part) { return part == 0 ? n / 2 : n; }
+
+    SplitWorker(const SplitWorker&) = delete;
+    SplitWorker& operator=(const SplitWorker&) = delete;
+
+private:
+    static void helperTask(void* self) {
+        SplitWorker* s = (SplitWorker*)self;
+        for (;;) {
+            s->startSignal.take();
+            if (s->stopping) break;
+            s->job(s->jobContext, 1);
+            s->doneSignal.give();
+        }
+    }
+
+    Worker helper;
+    Signal startSignal;
+    Signal doneSignal;
+    SplitFunction job = nullptr;
+    void* jobContext = nullptr;
+    std::atomic<bool> stopping{false};
+    unsigned long splits = 0;
+};
+
+#endif /* LAYERPARALLEL_H_ */
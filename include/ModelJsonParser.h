@@ -0,0 +1,287 @@
+#ifndef MODELJSONPARSER_H_
+#define MODELJSONPARSER_H_
+
+/**
+ * Pull parser for the JSON model messages of the pull and resume topics.
+ *
+ * deserializeJson() builds the whole message as a JsonDocument, and the old
+ * code then copied it into new weight and bias arrays before building the
+ * network, so the model was in memory about three times. This parser reads
+ * the stream in small chunks and writes every number of "weights" and
+ * "biases" straight into an already allocated network through its
+ * TrainLayer views. Its memory use does not depend on the model size.
+ *
+ * Understood keys:
+ * - "precision": must match IDFLOAT ("float" or "double").
+ * - "round"
+ * - "layerRange": [first, last] for a partial model (see PartialModel.h).
+ *   Values that come before it are written over the expected range
+ *   (expectRange(), the whole network by default), and it then has to name
+ *   that range. A message without it holds the whole network.
+ * - "weights" and "biases": in block order, numbers or (double builds)
+ *   numeric strings.
+ * Other keys are skipped whatever they hold. The counts are checked at the
+ * end. After a failed parse the range already written holds a mix of old
+ * and new values.
+ *
+ * In needs available() and readBytes(char*, size_t), as Stream has.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTrainer.h"
+#include "PartialModel.h"
+#include "Worker.h"
+
+#ifndef MODEL_JSON_CHUNK
+#define MODEL_JSON_CHUNK 128 // bytes read from the stream at once
+#endif
+#ifndef MODEL_JSON_YIELD_VALUES
+#define MODEL_JSON_YIELD_VALUES 2048 // values between pauses that let the idle task feed the watchdog
+#endif
+
+class ModelJsonParser {
+public:
+    ModelJsonParser(const TrainLayer* layers, unsigned int numberOfLayers)
+        : layers(layers), numberOfLayers(numberOfLayers), lastLayer(numberOfLayers - 1) {}
+
+    template <typename In>
+    bool parse(In& in) {
+        skipSpace(in);
+        if (!expect(in, '{')) return fail("not an object");
+        skipSpace(in);
+        if (peek(in) == '}') return fail("empty message");
+        while (true) {
+            skipSpace(in);
+            if (!readString(in, key, sizeof(key))) return fail("bad key");
+            skipSpace(in);
+            if (!expect(in, ':')) return fail("missing ':'");
+            skipSpace(in);
+            if (!readMember(in)) return false;
+            skipSpace(in);
+            int c = next(in);
+            if (c == '}') break;
+            if (c != ',') return fail("missing ',' or '}'");
+        }
+        if (!precisionMatches) return fail("missing or different precision");
+        if (!rangeDeclared && isPartial()) return fail("no layerRange for the expected partial model");
+        if (weightsRead != partialWeightCount(layers, firstLayer, lastLayer) || biasesRead != partialBiasCount(layers, firstLayer, lastLayer)) return fail("value count does not match the topology");
+        return true;
+    }
+
+    // Range the values go to when they come before "layerRange"
+    void expectRange(unsigned int first, unsigned int last) {
+        firstLayer = first;
+        lastLayer = last;
+    }
+
+    const char* getError() const { return error; }
+    int getRound() const { return round; }
+    bool isPartial() const { return firstLayer > 0 || lastLayer < numberOfLayers - 1; }
+    unsigned int getFirstLayer() const { return firstLayer; }
+    unsigned int getLastLayer() const { return lastLayer; }
+    size_t getValues() const { return weightsRead + biasesRead; }
+    size_t getBytes() const { return bytes; }
+
+    ModelJsonParser(const ModelJsonParser&) = delete;
+    ModelJsonParser& operator=(const ModelJsonParser&) = delete;
+
+private:
+    template <typename In>
+    int peek(In& in) {
+        if (position == length) {
+            size_t want = in.available();
+            if (want == 0) want = 1; // let readBytes wait for the rest of the message
+            if (want > sizeof(buffer)) want = sizeof(buffer);
+            length = in.readBytes((char*)buffer, want);
+            position = 0;
+            bytes += length;
+            if (length == 0) return -1;
+        }
+        return buffer[position];
+    }
+
+    template <typename In>
+    int next(In& in) {
+        int c = peek(in);
+        if (c >= 0) position++;
+        return c;
+    }
+
+    template <typename In>
+    bool expect(In& in, char c) { return next(in) == c; }
+
+    template <typename In>
+    void skipSpace(In& in) {
+        int c;
+        while ((c = peek(in)) == ' ' || c == '\n' || c == '\r' || c == '\t') position++;
+    }
+
+    // String into out (cut at size - 1 characters, escapes kept as written)
+    template <typename In>
+    bool readString(In& in, char* out, size_t size) {
+        if (!expect(in, '"')) return false;
+        size_t n = 0;
+        while (true) {
+            int c = next(in);
+            if (c < 0) return false;
+            if (c == '"') break;
+            if (c == '\\') {
+                if (n + 1 < size) out[n++] = c;
+                c = next(in);
+                if (c < 0) return false;
+            }
+            if (n + 1 < size) out[n++] = c;
+        }
+        out[n] = 0;
+        return true;
+    }
+
+    // Number or numeric string into token
+    template <typename In>
+    bool readNumber(In& in) {
+        if (peek(in) == '"') return readString(in, token, sizeof(token));
+        size_t n = 0;
+        int c;
+        while ((c = peek(in)) >= 0 && (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9'))) {
+            if (n + 1 >= sizeof(token)) return false;
+            token[n++] = c;
+            position++;
+        }
+        token[n] = 0;
+        return n > 0;
+    }
+
+    IDFLOAT tokenValue() const {
+        return sizeof(IDFLOAT) > sizeof(float) ? (IDFLOAT)strtod(token, NULL) : (IDFLOAT)strtof(token, NULL);
+    }
+
+    template <typename In>
+    bool readMember(In& in) {
+        if (strcmp(key, "precision") == 0) {
+            char precision[8];
+            if (!readString(in, precision, sizeof(precision))) return fail("bad precision");
+            precisionMatches = strcmp(precision, sizeof(IDFLOAT) > sizeof(float) ? "double" : "float") == 0;
+            return true;
+        }
+        if (strcmp(key, "round") == 0) {
+            if (!readNumber(in)) return fail("bad round");
+            round = atoi(token);
+            return true;
+        }
+        if (strcmp(key, "layerRange") == 0) {
+            long range[2];
+            for (int k = 0; k < 2; k++) {
+                skipSpace(in);
+                if (!expect(in, k == 0 ? '[' : ',')) return fail("bad layerRange");
+                skipSpace(in);
+                if (!readNumber(in)) return fail("bad layerRange");
+                range[k] = atol(token);
+            }
+            skipSpace(in);
+            if (!expect(in, ']') || range[0] < 0 || range[0] > range[1] || range[1] >= (long)numberOfLayers) return fail("bad layerRange");
+            rangeDeclared = true;
+            if (valuesRead) return (unsigned int)range[0] == firstLayer && (unsigned int)range[1] == lastLayer ? true : fail("layerRange does not match the values before it");
+            firstLayer = range[0];
+            lastLayer = range[1];
+            return true;
+        }
+        bool weights = strcmp(key, "weights") == 0;
+        if (weights || strcmp(key, "biases") == 0) return readValues(in, weights);
+        return skipValue(in);
+    }
+
+    // Array of numbers written in order over the range's weights or biases
+    template <typename In>
+    bool readValues(In& in, bool weights) {
+        if (!expect(in, '[')) return fail("values are not an array");
+        valuesRead = true;
+        unsigned int l = firstLayer, i = 0, j = 0;
+        size_t& count = weights ? weightsRead : biasesRead;
+        skipSpace(in);
+        if (peek(in) == ']') {
+            position++;
+            return true;
+        }
+        while (true) {
+            skipSpace(in);
+            if (!readNumber(in)) return fail("bad number");
+            if (l > lastLayer) return fail("more values than the topology holds");
+            IDFLOAT value = tokenValue();
+            if (weights) {
+                layers[l].weights[i][j] = value;
+                if (++j == layers[l].inputs) {
+                    j = 0;
+                    if (++i == layers[l].outputs) {
+                        i = 0;
+                        l++;
+                    }
+                }
+            } else {
+                layers[l].bias[i] = value;
+                if (++i == layers[l].outputs) {
+                    i = 0;
+                    l++;
+                }
+            }
+            if (++count % MODEL_JSON_YIELD_VALUES == 0) workerPause();
+            skipSpace(in);
+            int c = next(in);
+            if (c == ']') return true;
+            if (c != ',') return fail("missing ',' or ']'");
+        }
+    }
+
+    // Any value, nested arrays and objects included
+    template <typename In>
+    bool skipValue(In& in) {
+        int depth = 0;
+        do {
+            skipSpace(in);
+            int c = peek(in);
+            if (c < 0) return fail("message ended early");
+            if (c == '"') {
+                if (!readString(in, token, sizeof(token))) return fail("bad string");
+            } else if (c == '{' || c == '[') {
+                depth++;
+                position++;
+            } else if (c == '}' || c == ']') {
+                depth--;
+                position++;
+            } else if (c == ',' || c == ':') {
+                position++;
+            } else {
+                // Number, true, false or null
+                while ((c = peek(in)) >= 0 && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\n' && c != '\r' && c != '\t') position++;
+            }
+        } while (depth > 0);
+        return true;
+    }
+
+    bool fail(const char* message) {
+        if (error == nullptr) error = message;
+        return false;
+    }
+
+    const TrainLayer* layers;
+    unsigned int numberOfLayers;
+    unsigned int firstLayer = 0;
+    unsigned int lastLayer;
+    uint8_t buffer[MODEL_JSON_CHUNK];
+    size_t position = 0;
+    size_t length = 0;
+    size_t bytes = 0;
+    char key[24];
+    char token[48];
+    size_t weightsRead = 0;
+    size_t biasesRead = 0;
+    bool valuesRead = false;    // the range can no longer move
+    bool rangeDeclared = false; // "layerRange" was in the message
+    bool precisionMatches = false;
+    int round = -1;
+    const char* error = nullptr;
+};
+
+#endif /* MODELJSONPARSER_H_ */
@@ -3,6 +3,16 @@
 // #include <SPIFFS.h>
 #include "LittleFS.h"
 #include <ArduinoJson.h>
+#include "DatasetDecoder.h"
+#include "DatasetReader.h"
+#include "DatasetPrefetch.h"
+#include "DatasetPartition.h"
+#include "CsvReader.h"
+#include "TrainingCheckpoint.h"
+#include "DatasetConvert.h"
+#include "PayloadStager.h"
+#include "StreamFile.h"
+#include "SparseDelta.h"
 #include <PicoMQTT.h>
 #include <WiFi.h>
 #include <vector>
@@ -16,9 +26,16 @@ PicoMQTT::Client mqtt(MQTT_BROKER, 1883, "esp", nullptr, nullptr, 5000UL, 30000U
 model* tempModel;
 unsigned long datasetSize = 0;
 unsigned long previousTransmit = 0, previousConstruct = 0, timeSinceLastServerMessage = 0;;
+unsigned long mqttLastPoll = 0, mqttLongestGap = 0; // see processMessages()
+uint8_t rawPublishChunk[RAW_PUBLISH_CHUNK_SIZE]; // reused by every raw model publish
+SparseDeltaEncoder sparseUplink; // global model of the round and the deltas not sent yet
 int currentRound = -1;
 bool waitingForMe = false;
 bool unsubscribeFromResume = false;
+bool requestFullModel = false; // sent from processMessages(), a partial model came without the layers it needs
+bool reportReceivedModel = false; // sent from processMessages(), the server checks what arrived of its last raw model
+uint32_t receivedModelCrc = 0;
+size_t receivedModelBytes = 0;
 bool sendingMessage = false;
 
 File xTest, yTest;
@@ -71,6 +88,19 @@ void printModelConfig(ModelConfig *modelConfig) {
                 D_println();
                 D_println("Learning Rate of Weights: " + String(modelConfig->learningRateOfWeights));
                 D_println("Learning Rate of Biases: " + String(modelConfig->learningRateOfBiases));
+                if (modelConfig->timeBudget > 0 || modelConfig->maxRows > 0) {
+                    D_println("Training budget: " + String(modelConfig->timeBudget) + " ms, " + String(modelConfig->maxRows) + " rows");
+                }
+                if (modelConfig->batchSize > 1) {
+                    D_println("Batch size: " + String(modelConfig->batchSize));
+                }
+                if (modelConfig->optimizer.type != Optimizer_SGD) {
+                    D_println("Optimizer: " + String(optimizerName(modelConfig->optimizer.type)));
+                }
+                unsigned int firstLayer, lastLayer;
+                if (partialLayerRange(*modelConfig, firstLayer, lastLayer)) {
+                    D_println("Trainable layers: " + String(firstLayer) + " to " + String(lastLayer));
+                }
                 if (modelConfig->randomSeed != 0) {
                     randomSeed(modelConfig->randomSeed);
                     D_println("Random Seed: " + String(modelConfig->randomSeed));
@@ -101,6 +131,18 @@ void bootUp(bool initBaseModel) {
     }
     D_println(CLIENT_NAME);
 
+#ifdef DATASET_BINARY
+    bool repacked = false;
+    if (!LittleFS.exists(XY_TRAIN_PATH) && LittleFS.exists(DATASET_REPACK_X_PATH) && LittleFS.exists(DATASET_REPACK_Y_PATH)) {
+        repacked = convertXYToBinary(DATASET_REPACK_X_PATH, DATASET_REPACK_Y_PATH, XY_TRAIN_PATH);
+    }
+    if (DATASET_PARTITION && stageDatasetPartition() && repacked) {
+        // The CSV pair now lives in the partition, left in place it would be repacked on every boot
+        LittleFS.remove(DATASET_REPACK_X_PATH);
+        LittleFS.remove(DATASET_REPACK_Y_PATH);
+    }
+#endif
+
     D_println("Booting up...");
 
     bool configurationLoaded = loadDeviceConfig();
@@ -126,9 +168,10 @@ void bootUp(bool initBaseModel) {
     fixedMemoryUsage.loadConfig = info.total_free_bytes;
 
     if (initBaseModel) {
+        releaseQuantizedModel();
         if (LittleFS.exists(MODEL_PATH)) {
             if (currentModel != NULL) {
-            delete currentModel;
+            deleteModel(currentModel);
         }
         currentModel = loadModelFromFlash(MODEL_PATH);
         if (configurationLoaded) {
@@ -142,11 +185,9 @@ void bootUp(bool initBaseModel) {
                 // Code should not be here unless something has gone wrong, but we can still recover be training the model again
             }
             if (currentModel != NULL) {
-                delete currentModel;
+                deleteModel(currentModel);
             }
-            currentModel = new NeuralNetwork(localModelConfig->layers, localModelConfig->numberOfLayers, localModelConfig->actvFunctions);
-            currentModel->LearningRateOfBiases = localModelConfig->learningRateOfBiases;
-            currentModel->LearningRateOfWeights = localModelConfig->learningRateOfWeights;
+            currentModel = createModel(*localModelConfig);
             if (currentModelMetrics != NULL) {
                 delete currentModelMetrics;
             }
@@ -212,337 +253,1010 @@ NeuralNetwork* loadModelFromFlash(const String& file) {
     else {
         NeuralNetwork* r = new NeuralNetwork(modelFile);
         modelFile.close();
+        if (localModelConfig != NULL) {
+            r = flattenModel(r, *localModelConfig);
+        }
         D_println("Model loaded successfully");
         return r;
     }
 }
 
-model* transformDataToModel(Stream& stream) {
-    D_println("Transforming data to model...");
-    printTiming(true);
-    printMemory();
-    // TODO o tamanho padrão pode ser pequeno demais para caber todos os pesos e biases
-    unsigned long startTime = millis();
-    JsonDocument doc;
+bool trainingBudgetReached(const ModelConfig& config, unsigned long startTime, unsigned long rows) {
+    if (config.maxRows > 0 && rows >= config.maxRows) return true;
+    return config.timeBudget > 0 && millis() - startTime >= config.timeBudget;
+}
+
+unsigned int argmax(const DFLOAT* values, unsigned int count) {
+    unsigned int best = 0;
+    for (unsigned int k = 1; k < count; k++) {
+        if (values[k] > values[best]) best = k;
+    }
+    return best;
+}
+
+// One confusion matrix cell per row, the actual class is the largest target
+void countPrediction(multiClassClassifierMetrics* metrics, const IDFLOAT* y, const DFLOAT* predictions) {
+    metrics->add(argmax(y, metrics->numberOfClasses), argmax(predictions, metrics->numberOfClasses));
+}
 
-    // ! This is triggering the Watchdog from ESP32 since it takes a long time to deserialize.
-    DeserializationError result = deserializeJson(doc, stream);
-    doc.shrinkToFit();
+void countPrediction(multiClassClassifierMetrics* metrics, unsigned int actual, const DFLOAT* predictions) {
+    metrics->add(actual, argmax(predictions, metrics->numberOfClasses));
+}
+
+// Row-major counts where a run of n empty cells is written as -n, most of an 18x18 matrix is zero
+void writeConfusion(JsonArray out, const multiClassClassifierMetrics& metrics) {
+    size_t cells = (size_t)metrics.numberOfClasses * metrics.numberOfClasses;
+    long zeros = 0;
+    for (size_t k = 0; k < cells; k++) {
+        if (metrics.confusion[k] == 0) {
+            zeros++;
+            continue;
+        }
+        if (zeros > 0) out.add(-zeros);
+        zeros = 0;
+        out.add(metrics.confusion[k]);
+    }
+    if (zeros > 0) out.add(-zeros);
+}
 
-    if (result != DeserializationError::Ok) {
-        D_println(result.code());
-        D_println("JSON failed to deserialize");
+// Parsed aside and copied only when it fills the matrix exactly, a mismatch leaves the matrix untouched
+bool readConfusion(JsonArray in, multiClassClassifierMetrics& metrics) {
+    size_t cells = (size_t)metrics.numberOfClasses * metrics.numberOfClasses;
+    uint32_t* parsed = new uint32_t[cells];
+    size_t k = 0;
+    bool fits = true;
+    for (JsonVariant v : in) {
+        long n = v.as<long>();
+        if (n < 0) {
+            if (k - n > cells) {
+                fits = false;
+                break;
+            }
+            memset(parsed + k, 0, -n * sizeof(uint32_t));
+            k -= n;
+        } else {
+            if (k >= cells) {
+                fits = false;
+                break;
+            }
+            parsed[k++] = n;
+        }
+    }
+    fits = fits && k == cells;
+    if (fits) memcpy(metrics.confusion, parsed, cells * sizeof(uint32_t));
+    delete[] parsed;
+    return fits;
+}
+
+TrainLayer* describeLayers(NeuralNetwork& NN, const ModelConfig& config) {
+    TrainLayer* layers = new TrainLayer[NN.numberOflayers];
+    for (unsigned int n = 0; n < NN.numberOflayers; n++) {
+        layers[n].weights = NN.layers[n].weights;
+        layers[n].bias = NN.layers[n].bias;
+        layers[n].inputs = NN.layers[n]._numberOfInputs;
+        layers[n].outputs = NN.layers[n]._numberOfOutputs;
+        layers[n].activation = config.actvFunctions[n];
+    }
+    return layers;
+}
+
+FlatModel* getFlatModel(const NeuralNetwork* NN) {
+    if (NN == NULL) return NULL;
+    for (unsigned int s = 0; s < FLAT_MODEL_SLOTS; s++) {
+        if (flatModelSlots[s].network == NN) return flatModelSlots[s].storage;
+    }
+    return NULL;
+}
+
+// Builds a network over storage's block and records the pair, NULL if no slot is free or the library copied the parameters
+NeuralNetwork* adoptFlatModel(FlatModel* storage, const ModelConfig& config) {
+    FlatModelSlot* slot = NULL;
+    for (unsigned int s = 0; s < FLAT_MODEL_SLOTS && slot == NULL; s++) {
+        if (flatModelSlots[s].network == NULL) slot = &flatModelSlots[s];
+    }
+    if (slot == NULL) return NULL;
+    NeuralNetwork* NN = new NeuralNetwork(storage->topology(), storage->weights(), storage->biases(), config.numberOfLayers, storage->activations());
+    if (NN->layers[0].weights[0] != storage->weights()) {
+        delete NN;
         return NULL;
     }
-    const char* precision = doc["precision"];
-#if defined(USE_64_BIT_DOUBLE)
-    if (strcmp(precision, "double") != 0) {
-        // error loading the model, precision missmatch
+    NN->LearningRateOfBiases = config.learningRateOfBiases;
+    NN->LearningRateOfWeights = config.learningRateOfWeights;
+    slot->network = NN;
+    slot->storage = storage;
+    D_println("Model parameters in one block of " + String((unsigned long)storage->getBytes()) + " bytes");
+    return NN;
+}
+
+NeuralNetwork* flattenModel(NeuralNetwork* NN, const ModelConfig& config) {
+    if (!FLAT_MODEL_STORAGE || NN == NULL || getFlatModel(NN) != NULL || config.numberOfLayers != NN->numberOflayers + 1) {
+        return NN;
+    }
+    FlatModel* storage = new FlatModel(config.layers, config.actvFunctions, NN->numberOflayers);
+    TrainLayer* layers = describeLayers(*NN, config);
+    bool usable = storage->isValid() && storage->matches(layers, NN->numberOflayers);
+    if (usable) {
+        storage->gather(layers);
+    }
+    delete[] layers;
+    NeuralNetwork* flat = usable ? adoptFlatModel(storage, config) : NULL;
+    if (flat == NULL) {
+        // Keep the row-allocated model
+        delete storage;
+        return NN;
+    }
+    flat->LearningRateOfBiases = NN->LearningRateOfBiases;
+    flat->LearningRateOfWeights = NN->LearningRateOfWeights;
+    delete NN;
+    return flat;
+}
+
+NeuralNetwork* createModel(const ModelConfig& config) {
+    NeuralNetwork* NN = new NeuralNetwork(config.layers, config.numberOfLayers, config.actvFunctions);
+    NN->LearningRateOfBiases = config.learningRateOfBiases;
+    NN->LearningRateOfWeights = config.learningRateOfWeights;
+    return flattenModel(NN, config);
+}
+
+void deleteModel(NeuralNetwork* NN) {
+    if (NN == globalBase) globalBase = NULL;
+    FlatModel* storage = getFlatModel(NN);
+    delete NN;
+    if (storage != NULL) {
+        for (unsigned int s = 0; s < FLAT_MODEL_SLOTS; s++) {
+            if (flatModelSlots[s].storage == storage) flatModelSlots[s] = {};
+        }
+        delete storage;
+    }
+}
+
+bool partialLayerRange(const ModelConfig& config, unsigned int& first, unsigned int& last) {
+    unsigned int layers = config.numberOfLayers - 1;
+    last = config.lastTrainableLayer < 0 || config.lastTrainableLayer >= (int)layers ? layers - 1 : config.lastTrainableLayer;
+    first = config.firstTrainableLayer < 0 ? 0 : min((unsigned int)config.firstTrainableLayer, last);
+    return first > 0 || last < layers - 1;
+}
+
+// Batch size 1 with plain SGD on every layer is left to the library's BackProp
+bool needsBatchTrainer(const ModelConfig& config) {
+    unsigned int firstLayer, lastLayer;
+    return config.batchSize > 1 || config.optimizer.type != Optimizer_SGD || partialLayerRange(config, firstLayer, lastLayer) || FIXED_POINT_TRAINING || TRAINING_PARALLEL;
+}
+
+bool sameTopology(const NeuralNetwork* NN, const ModelConfig& config) {
+    if (NN == NULL || NN->numberOflayers + 1 != config.numberOfLayers) return false;
+    for (unsigned int n = 0; n < NN->numberOflayers; n++) {
+        if (NN->layers[n]._numberOfInputs != config.layers[n] || NN->layers[n]._numberOfOutputs != config.layers[n + 1]) return false;
+    }
+    return true;
+}
+
+// Layer range a federated training round sends, false when it sends the whole network
+bool partialExchange(const NeuralNetwork& NN, unsigned int& first, unsigned int& last) {
+    if (federateState != FederateState_TRAINING || federateModelConfig == NULL || !sameTopology(&NN, *federateModelConfig)) return false;
+    return partialLayerRange(*federateModelConfig, first, last);
+}
+
+// Takes the network a received model is written over. A partial model needs the one holding the last global model, since only
+// its frozen layers are known to be global (a copy of currentModel has local ones), NULL when there is none. A whole model
+// reuses newModel's storage or gets a new network.
+NeuralNetwork* takePartialModelBase(const ModelConfig& config, bool frozenLayers) {
+    NeuralNetwork* base = NULL;
+    if (sameTopology(newModel, config) && (!frozenLayers || newModel == globalBase)) {
+        base = newModel;
+    } else {
+        if (newModel != NULL) deleteModel(newModel);
+        if (!frozenLayers) base = createModel(config);
+    }
+    newModel = NULL;
+    return base;
+}
+
+// A partial model over the global base has to replace every layer this device trained, the rest of the base is global
+bool partialCoversTrained(const ModelConfig& config, unsigned int first, unsigned int last) {
+    unsigned int trainedFirst, trainedLast;
+    partialLayerRange(config, trainedFirst, trainedLast);
+    return first <= trainedFirst && last >= trainedLast;
+}
+
+// Network for a raw payload in PartialModel format whose header was already read from stream, NULL on error
+template <typename In>
+NeuralNetwork* modelFromPartialPayload(In& stream, const PartialModelHeader& header, const ModelConfig& config) {
+    bool whole = header.firstLayer == 0 && header.lastLayer + 1 == header.numberOfLayers;
+    NeuralNetwork* base = takePartialModelBase(config, !whole);
+    if (base == NULL || (!whole && !partialCoversTrained(config, header.firstLayer, header.lastLayer))) {
+        D_println("No global model to apply layers " + String(header.firstLayer) + " to " + String(header.lastLayer) + " to, requesting a full model");
+        if (base != NULL) deleteModel(base);
+        requestFullModel = true;
         return NULL;
     }
-#else
-    if (strcmp(precision, "float") != 0) {
-        // error loading the model, precision missmatch
+    TrainLayer* layers = describeLayers(*base, config);
+    bool usable = partialModelMatches(header, layers, base->numberOflayers) && readPartialModel(stream, header, layers);
+    delete[] layers;
+    if (!usable) {
+        D_println("Partial model does not match the configured topology");
+        deleteModel(base);
         return NULL;
     }
-#endif
-    JsonArray biases = doc["biases"];
-    JsonArray weights = doc["weights"];
-    IDFLOAT* bias = new IDFLOAT[biases.size()];
-    IDFLOAT* weight = new IDFLOAT[weights.size()];
+    if (!whole) D_println("Partial model applied to layers " + String(header.firstLayer) + " to " + String(header.lastLayer));
+    return base;
+}
 
-    for (int i = 0; i < biases.size(); i++) {
-#if defined(USE_64_BIT_DOUBLE)
-        // If using double precision and values were serialized as strings
-        if (biases[i].is<const char*>()) {
-            bias[i] = strtod(biases[i].as<const char*>(), NULL);
-        }
-        else {
-            bias[i] = biases[i].as<IDFLOAT>();
-        }
-#else
-        bias[i] = biases[i].as<IDFLOAT>();
-#endif
+// Raw decoding can skip flash when the heap holds the target network. A PartialModel payload is read straight into last round's
+// network when it has the configured topology, or into one new flat model. NN.save() payloads are read by the library's load()
+// into a new row-wise network that flattenModel then copies, so they need room for the model twice. Larger models are staged.
+bool rawReceiveInPlace(const ModelConfig& config, bool partialLayout) {
+    if (!RAW_RECEIVE_IN_PLACE) return false;
+    if (partialLayout && sameTopology(newModel, config)) return true;
+    size_t bytes = 0;
+    for (unsigned int n = 0; n + 1 < config.numberOfLayers; n++) {
+        bytes += ((size_t)config.layers[n] * config.layers[n + 1] + config.layers[n + 1]) * sizeof(IDFLOAT);
+    }
+    if (!partialLayout) bytes *= 2;
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= bytes + RAW_RECEIVE_MIN_FREE_HEAP;
+}
+
+// Replaces newModel with a network read by the library's load(), the NN.save() layout. newModel is NULL when it fails.
+bool loadSavedModel(File& file, const ModelConfig& config) {
+    if (newModel != NULL) {
+        deleteModel(newModel);
+    }
+    newModel = new NeuralNetwork(config.layers, config.numberOfLayers, config.actvFunctions);
+    newModel->LearningRateOfBiases = config.learningRateOfBiases;
+    newModel->LearningRateOfWeights = config.learningRateOfWeights;
+    if (!newModel->load(file)) {
+        deleteModel(newModel);
+        newModel = NULL;
+        return false;
     }
+    newModel = flattenModel(newModel, config);
+    return true;
+}
 
-    for (int i = 0; i < weights.size(); i++) {
-#if defined(USE_64_BIT_DOUBLE)
-        // If using double precision and values were serialized as strings
-        if (weights[i].is<const char*>()) {
-            weight[i] = strtod(weights[i].as<const char*>(), NULL);
+bool receiveRawModel(Stream& stream, const ModelConfig& config) {
+    unsigned long startTime = millis();
+    PartialModelHeader header;
+    size_t headerBytes = stream.readBytes((char*)&header, sizeof(header));
+    size_t payloadBytes = headerBytes + stream.available();
+    bool inPlace = headerBytes == sizeof(header) && rawReceiveInPlace(config, header.magic == PARTIAL_MODEL_MAGIC);
+    bool loaded;
+    if (inPlace) {
+        CrcReader<Stream> reader(stream, payloadCrc32(0, (const uint8_t*)&header, headerBytes), headerBytes);
+        if (header.magic == PARTIAL_MODEL_MAGIC) {
+            newModel = modelFromPartialPayload(reader, header, config);
+            loaded = newModel != NULL;
+        } else {
+            // The library reads its own layout, through a File over the rest of the stream
+            File file = streamFile(reader, (const uint8_t*)&header, headerBytes, payloadBytes);
+            loaded = loadSavedModel(file, config);
         }
-        else {
-            weight[i] = weights[i].as<IDFLOAT>();
+        receivedModelCrc = reader.getCrc();
+        receivedModelBytes = reader.getBytes();
+    } else {
+        // A new file instead of truncating last round's, and a failed receive before any write when the payload cannot fit
+        LittleFS.remove(TEMPORARY_NEW_MODEL_PATH);
+        if (LittleFS.totalBytes() - LittleFS.usedBytes() < payloadBytes + RAW_STAGING_BLOCK_SIZE) {
+            D_println("Not enough flash to stage a " + String((unsigned long)payloadBytes) + " byte model");
+            return false;
         }
-#else
-        weight[i] = weights[i].as<IDFLOAT>();
-#endif
+        File file = LittleFS.open(TEMPORARY_NEW_MODEL_PATH, "w+");
+        if (!file) {
+            D_println("Error opening file for writing");
+            return false;
+        }
+        PayloadStager stager(RAW_STAGING_BLOCK_SIZE);
+        if (!stager.stage(stream, file, (const uint8_t*)&header, headerBytes)) {
+            D_println("Error staging model in flash");
+            file.close();
+            return false;
+        }
+        const PayloadStageStats& staged = stager.getStats();
+        char crc[9];
+        snprintf(crc, sizeof(crc), "%08lx", (unsigned long)staged.crc);
+        D_println("Staged " + String((unsigned long)staged.bytes) + " bytes in " + String(staged.writes) + " writes at " + String(staged.bytesPerSecond()) + " bytes/s, crc32 " + crc);
+        receivedModelCrc = staged.crc;
+        receivedModelBytes = staged.bytes;
+        file.seek(0);
+
+        // A layer range from a fine-tuning round goes over the frozen layers kept on the device
+        if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == PARTIAL_MODEL_MAGIC) {
+            newModel = modelFromPartialPayload(file, header, config);
+            loaded = newModel != NULL;
+        } else {
+            file.seek(0);
+            loaded = loadSavedModel(file, config);
+        }
+        file.close();
     }
+    reportReceivedModel = true;
+    if (loaded) {
+        D_println("Raw model ready in " + String(millis() - startTime) + " ms, " + String((unsigned long)payloadBytes) + " bytes " + (inPlace ? "decoded from the stream" : "staged in flash"));
+    }
+    return loaded;
+}
 
+model* transformDataToModel(Stream& stream, const ModelConfig& config, NeuralNetwork*& NN) {
+    D_println("Transforming data to model...");
+    printTiming(true);
+    printMemory();
+    unsigned long startTime = millis();
+    // The values go straight into the network, no JsonDocument or intermediate arrays. Only a partial message keeps layers of
+    // the network it is written over, a whole one reuses newModel's storage without copying anything into it.
+    unsigned int firstLayer = 0, lastLayer = config.numberOfLayers - 2;
+    bool partialExpected = newModel != NULL && newModel == globalBase && sameTopology(newModel, config) && partialLayerRange(config, firstLayer, lastLayer);
+    NN = takePartialModelBase(config, partialExpected);
+    TrainLayer* layers = describeLayers(*NN, config);
+    ModelJsonParser* parser = new ModelJsonParser(layers, NN->numberOflayers);
+    if (partialExpected) parser->expectRange(firstLayer, lastLayer);
+    bool parsed = parser->parse(stream);
+    delete[] layers;
+    bool covered = !parser->isPartial() || (partialExpected && partialCoversTrained(config, parser->getFirstLayer(), parser->getLastLayer()));
+    if (!parsed || !covered) {
+        D_println("JSON failed to parse: " + String(parsed ? "no global model to apply a partial model to, requesting a full model" : parser->getError()));
+        // A failed parse leaves the global base half written
+        if (parsed || partialExpected) requestFullModel = true;
+        delete parser;
+        deleteModel(NN);
+        NN = NULL;
+        return NULL;
+    }
+    if (parser->isPartial()) {
+        D_println("Partial model applied to layers " + String(parser->getFirstLayer()) + " to " + String(parser->getLastLayer()));
+    }
     model* m = new model;
-    m->biases = bias;
-    m->weights = weight;
     m->parsingTime = millis() - startTime;
-    m->round = -1;
-    if (doc["round"].is<int>()) {
-        m->round = doc["round"].as<int>();
-    }
+    m->round = parser->getRound();
+    D_println(String((unsigned long)parser->getValues()) + " values from " + String((unsigned long)parser->getBytes()) + " bytes in " + String(m->parsingTime) + " ms");
+    delete parser;
     printTiming();
     D_println("Transformation complete.");
     return m;
 }
 
-#ifdef DATASET_BINARY
-multiClassClassifierMetrics* trainModelFromBinaryDataset(NeuralNetwork& NN, ModelConfig& config, const String& bin_file, const String& meta_file) {
-    D_println("Training model from binary dataset...");
-    printTiming(true);
+ModelTrainer* createBatchTrainer(NeuralNetwork& NN, const ModelConfig& config) {
+    TrainLayer* layers = describeLayers(NN, config);
+    ModelTrainer* trainer = new ModelTrainer(layers, NN.numberOflayers, config.batchSize);
+#if defined(USE_FIXED_POINT)
+    if (!trainer->isFixedPoint()) {
+        D_println("Unbounded activations would saturate at 1.0 in fixed point, training in float");
+    }
+#endif
+    delete[] layers;
+    if (!trainer->isValid()) {
+        delete trainer;
+        return NULL;
+    }
+    // Core 0 mostly waits for MQTT messages, wide layers get split with a helper task there
+    if (TRAINING_PARALLEL && !trainer->enableParallel(TRAINING_PARALLEL_MIN_WORK, 0)) {
+        D_println("Layer split helper not started, training on one core");
+    }
+    unsigned int firstLayer, lastLayer;
+    if (partialLayerRange(config, firstLayer, lastLayer)) {
+        trainer->setTrainableLayers(firstLayer, lastLayer);
+        D_println("Training layers " + String(firstLayer) + " to " + String(lastLayer) + ", the others are frozen");
+    }
+    if (config.optimizer.type != Optimizer_SGD) {
+        // Float state when it leaves OPTIMIZER_MIN_FREE_HEAP free, bfloat16 otherwise, plain SGD when neither fits
+        size_t stateBytes = OptimizerState::bytesFor(config.optimizer.type, trainer->getParameterCount(), false);
+        bool reduced = heap_caps_get_free_size(MALLOC_CAP_8BIT) < stateBytes + OPTIMIZER_MIN_FREE_HEAP;
+        bool enabled = trainer->enableOptimizer(config.optimizer, reduced);
+        if (!enabled && !reduced) enabled = trainer->enableOptimizer(config.optimizer, true);
+        if (!enabled) {
+            D_println("No " + String(optimizerName(config.optimizer.type)) + " state for this trainer, training with SGD");
+        } else {
+            const OptimizerState& optimizer = trainer->getOptimizer();
+            D_println("Optimizer " + String(optimizerName(optimizer.getType())) + ", " + (optimizer.isReduced() ? "bfloat16" : "float") + " state (" + String((unsigned long)optimizer.getBytes()) + " bytes)");
+        }
+    }
+    return trainer;
+}
 
-    unsigned long initTime = millis();
-    datasetSize = 0;
+bool trainBatch(NeuralNetwork& NN, ModelTrainer& trainer, unsigned int count, multiClassClassifierMetrics* metrics) {
+    DFLOAT error = trainer.train(count, NN.LearningRateOfWeights, NN.LearningRateOfBiases);
+    if (!isfinite((double)error)) return false;
+    metrics->addLoss(error, count);
+    for (unsigned int b = 0; b < count; b++) {
+        countPrediction(metrics, trainer.target(b), trainer.output(b));
+    }
+    return true;
+}
 
-    // Load metadata
+TrainingCheckpoint* createCheckpoint(NeuralNetwork& NN, const ModelConfig& config, File& checkpointFile) {
+    if (!TRAINING_CHECKPOINT) return NULL;
+    TrainLayer* layers = describeLayers(NN, config);
+    FlatModel* flat = getFlatModel(&NN);
+    TrainingCheckpoint* checkpoint = new TrainingCheckpoint(layers, NN.numberOflayers, flat != NULL ? flat->parameters() : NULL);
+    delete[] layers;
+    if (!checkpoint->allocate()) {
+        // Not enough RAM for a second copy of the weights, keep the snapshot in flash
+        checkpointFile = LittleFS.open(CHECKPOINT_PATH, "w+");
+        if (!checkpointFile) {
+            D_println("No room for a training checkpoint, divergence will abort the round");
+            delete checkpoint;
+            return NULL;
+        }
+        checkpoint->useFile(checkpointFile);
+    }
+    D_println("Checkpoint every " + String(CHECKPOINT_EVERY_ROWS) + " rows in " + (checkpoint->inFile() ? "flash" : "RAM") + " (" + String((unsigned long)checkpoint->getBytes()) + " bytes)");
+    return checkpoint;
+}
+
+void saveCheckpoint(TrainingCheckpoint* checkpoint, ModelTrainer* trainer) {
+    if (checkpoint == NULL) return;
+    // The fixed point trainer keeps its own weights, write them to the model first
+    if (trainer != NULL) trainer->commit();
+    if (!checkpoint->save()) D_println("[ERR] Failed to save the training checkpoint");
+}
+
+bool rollBack(NeuralNetwork& NN, TrainingCheckpoint* checkpoint, ModelTrainer* trainer, multiClassClassifierMetrics* metrics) {
+    if (checkpoint == NULL || metrics->rollbacks >= CHECKPOINT_MAX_ROLLBACKS || !checkpoint->restore()) return false;
+    if (trainer != NULL) trainer->load();
+    NN.LearningRateOfWeights *= CHECKPOINT_LEARNING_RATE_SCALE;
+    NN.LearningRateOfBiases *= CHECKPOINT_LEARNING_RATE_SCALE;
+    metrics->rollbacks++;
+    metrics->learningRateScale *= CHECKPOINT_LEARNING_RATE_SCALE;
+    D_println("[ERR] Rolled back to the last checkpoint (" + String(metrics->rollbacks) + "/" + String(CHECKPOINT_MAX_ROLLBACKS) + "), learning rate x" + String((double)metrics->learningRateScale, 4));
+    return true;
+}
+
+void closeCheckpoint(TrainingCheckpoint* checkpoint, File& checkpointFile) {
+    if (checkpoint == NULL) return;
+    D_println("Checkpoints saved: " + String(checkpoint->getSaves()) + ", restored: " + String(checkpoint->getRestores()));
+    bool inFile = checkpoint->inFile();
+    delete checkpoint;
+    if (inFile) {
+        checkpointFile.close();
+        LittleFS.remove(CHECKPOINT_PATH);
+    }
+}
+
+#ifdef DATASET_BINARY
+bool stageDatasetPartition() {
+    if (!DatasetPartition::exists()) {
+        D_println("No dataset partition, training reads from LittleFS");
+        return false;
+    }
+    if (!LittleFS.exists(XY_TRAIN_PATH)) {
+        // Nothing to stage, the partition may have been flashed directly
+        return true;
+    }
+    File binF = LittleFS.open(XY_TRAIN_PATH, "r");
+    unsigned long startTime = millis();
+    bool result = DatasetPartition::stage(binF);
+    binF.close();
+    D_println("Dataset partition staged: " + String(result) + " (" + String(millis() - startTime) + " ms)");
+    if (result) {
+        // The partition was read back and matches, keeping the LittleFS copy would only store the dataset twice
+        LittleFS.remove(XY_TRAIN_PATH);
+    }
+    return result;
+}
+
+bool loadDatasetPlanFromMetadata(const String& meta_file, unsigned int numberOfInputs, DecodePlan& plan) {
     if (!LittleFS.exists(meta_file)) {
         D_println("Metadata file not found");
-        return NULL;
+        return false;
     }
     File metaF = LittleFS.open(meta_file, "r");
     if (!metaF) {
         D_println("Failed to open metadata file");
-        return NULL;
+        return false;
     }
     JsonDocument doc;
     DeserializationError derr = deserializeJson(doc, metaF);
     metaF.close();
     if (derr) {
         D_println("Failed to parse metadata JSON");
-        return NULL;
+        return false;
     }
 
     JsonArray schema = doc["schema"];
     const char* label_col = doc["label_column"] | "activityID";
-    JsonArray label_vals = doc["label_values"];
-    std::vector<long> label_values;
-    for (auto v : label_vals) label_values.push_back(v.as<long>());
-    bool encoded_labels = doc.containsKey("label_map");
 
-    struct Col { String name; String type; int bytes; int offset; };
-    std::vector<Col> cols;
+    // Compile the schema into a typed decode plan once, the row loop never touches the JSON again
+    plan.begin(schema.size());
     int row_size = 0;
     for (JsonObject c : schema) {
-        Col col;
-        col.name = String((const char*)c["name"]);
-        col.type = String((const char*)c["type"]);
-        col.bytes = c["bytes"] | 0;
-        col.offset = c["offset"] | 0;
-        cols.push_back(col);
-        row_size += col.bytes;
-    }
-
-    // Debug: print parsed schema and computed row size
-    D_println("[DBG] Parsed schema columns: " + String(cols.size()));
-    D_println("[DBG] Computed row_size: " + String(row_size));
-
-    // Determine input and label indices
-    std::vector<int> input_indices;
-    int label_index = -1;
-    for (size_t i = 0; i < cols.size(); ++i) {
-        if (cols[i].name == String(label_col)) {
-            label_index = (int)i;
-        } else if (cols[i].name == String("timestamp")) {
+        const char* name = c["name"] | "";
+        ColumnType type = columnTypeFromString(c["type"] | "");
+        int offset = c["offset"] | 0;
+        row_size += c["bytes"] | 0;
+        if (strcmp(name, label_col) == 0) {
+            plan.setLabel(type, offset);
+        } else if (strcmp(name, "timestamp") == 0) {
             // skip timestamp by default
             continue;
         } else {
-            input_indices.push_back((int)i);
+            plan.addInput(type, offset);
         }
     }
-    if (label_index < 0) {
+    unsigned int parsedInputs = plan.numberOfSteps;
+    plan.finalize(row_size, numberOfInputs);
+
+    plan.labelMode = doc.containsKey("label_map") ? LabelMode_ENCODED : LabelMode_VALUES;
+    JsonArray label_vals = doc["label_values"];
+    std::vector<long> label_values;
+    for (auto v : label_vals) label_values.push_back(v.as<long>());
+    plan.setLabelValues(label_values.data(), label_values.size());
+
+    // Debug: print parsed schema and computed row size
+    D_println("[DBG] Parsed schema columns: " + String(schema.size()));
+    D_println("[DBG] Computed row_size: " + String(row_size));
+
+    if (!plan.hasLabel) {
         D_println("Label column not found in schema");
-        return NULL;
+        return false;
     }
 
     // Debug: report input / label mapping
-    D_println("[DBG] Input feature count: " + String(input_indices.size()));
-    D_println("[DBG] Label column index: " + String(label_index) + " (name='" + String(label_col) + "')");
+    D_println("[DBG] Input feature count: " + String(parsedInputs));
+    D_println("[DBG] Label column offset: " + String(plan.labelOffset) + " (name='" + String(label_col) + "')");
+    return true;
+}
 
-    File binF = LittleFS.open(bin_file, "r");
-    if (!binF) {
-        D_println("Failed to open binary file");
+bool loadDatasetPlanFromV2(const uint8_t* mapped, size_t mappedBytes, File& binF, unsigned int numberOfInputs, DecodePlan& plan, DatasetV2Header& header) {
+    size_t total = mapped != nullptr ? mappedBytes : binF.size();
+    if (mapped != nullptr) {
+        if (!isDatasetV2(mapped, mappedBytes)) return false;
+        memcpy(&header, mapped, sizeof(header));
+    } else {
+        binF.seek(0);
+        if (binF.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != DATASET_V2_MAGIC) return false;
+    }
+    if (!validDatasetV2Header(header, total)) {
+        D_println("Invalid v2 dataset header");
+        return false;
+    }
+
+    // The column table follows the header, one allocation for the table and the optional footer
+    size_t tableBytes = (size_t)header.featureCount * sizeof(DatasetV2Column);
+    size_t statsBytes = (header.flags & DATASET_V2_FLAG_STATS) ? (size_t)header.featureCount * 2 * sizeof(float) : 0;
+    uint8_t* meta = new uint8_t[tableBytes + statsBytes];
+    bool ok = true;
+    if (mapped != nullptr) {
+        memcpy(meta, mapped + sizeof(header), tableBytes);
+        if (statsBytes > 0) memcpy(meta + tableBytes, mapped + header.footerOffset, statsBytes);
+    } else {
+        ok = binF.read(meta, tableBytes) == tableBytes;
+        if (ok && statsBytes > 0) ok = binF.seek(header.footerOffset) && binF.read(meta + tableBytes, statsBytes) == statsBytes;
+    }
+    ok = ok && buildDatasetV2Plan(header, (const DatasetV2Column*)meta, plan, numberOfInputs);
+    if (ok && statsBytes > 0 && DATASET_NORMALIZE) {
+        // Footer is mean[featureCount] followed by std[featureCount]
+        const float* mean = (const float*)(meta + tableBytes);
+        plan.normalize(mean, mean + header.featureCount);
+    }
+    delete[] meta;
+
+    D_println("[DBG] v2 dataset: " + String(header.rowCount) + " rows, " + String(header.featureCount) + " features, "
+        + String(header.classCount) + " classes, row_size " + String(header.rowSize) + (statsBytes > 0 ? ", with stats" : ""));
+    return ok;
+}
+
+// Opens the dataset partition (or bin_file) and builds its decode plan, the rows start at dataOffset and span dataBytes.
+// Without usePartition only bin_file is read, as for the held-out rows.
+bool openDatasetSource(const String& bin_file, const String& meta_file, unsigned int numberOfInputs, DatasetPartition& partition, File& binF, DecodePlan& plan, size_t& dataOffset, size_t& dataBytes, bool usePartition = true) {
+    // Prefer the memory-mapped dataset partition, fall back to the LittleFS file when it is missing or empty
+    if (usePartition && DATASET_PARTITION && partition.open()) {
+        D_println("Reading dataset from mapped partition (" + String((unsigned long)partition.size()) + " bytes)");
+    } else {
+        binF = LittleFS.open(bin_file, "r");
+        if (!binF) {
+            D_println("Failed to open binary file");
+            return false;
+        }
+    }
+
+    // A v2 container describes itself in its header, older files still need metadata.json
+    DatasetV2Header header = {};
+    dataOffset = 0;
+    dataBytes = SIZE_MAX;
+    if (loadDatasetPlanFromV2(partition.data(), partition.size(), binF, numberOfInputs, plan, header)) {
+        dataOffset = header.headerBytes;
+        dataBytes = datasetV2DataBytes(header);
+    } else if (header.magic == DATASET_V2_MAGIC || !loadDatasetPlanFromMetadata(meta_file, numberOfInputs, plan)) {
+        if (binF) binF.close();
+        return false;
+    }
+    return true;
+}
+
+bool openDatasetReader(DatasetReader& reader, DatasetPartition& partition, File& binF, size_t dataOffset, size_t dataBytes) {
+    if (partition.isOpen()) {
+        size_t available = partition.size() - dataOffset;
+        return reader.open(partition.data() + dataOffset, dataBytes < available ? dataBytes : available);
+    }
+    return reader.open(binF, dataOffset, dataBytes);
+}
+
+multiClassClassifierMetrics* trainModelFromBinaryDataset(NeuralNetwork& NN, ModelConfig& config, const String& bin_file, const String& meta_file) {
+    D_println("Training model from binary dataset...");
+    printTiming(true);
+
+    unsigned long initTime = millis();
+    datasetSize = 0;
+    mqttLongestGap = 0;
+
+    unsigned int numberOfInputs = NN.layers[0]._numberOfInputs;
+    unsigned int numberOfClasses = NN.layers[NN.numberOflayers - 1]._numberOfOutputs;
+
+    DatasetPartition partition;
+    File binF;
+    DecodePlan plan;
+    size_t dataOffset, dataBytes;
+    if (!openDatasetSource(bin_file, meta_file, numberOfInputs, partition, binF, plan, dataOffset, dataBytes)) {
         return NULL;
     }
+    unsigned int parsedInputs = plan.numberOfSteps;
+    D_println("[DBG] Contiguous float32 fast path: " + String(plan.contiguousFloat32 ? "yes" : "no"));
 
-    // Allocate buffers and arrays
-    uint8_t* rowbuf = (uint8_t*)malloc(row_size);
-    if (!rowbuf) {
-        D_println("Failed to allocate row buffer");
-        binF.close();
+    // With prefetching the producer task already reads on core 0, a second filler task would only compete with it
+    DatasetReader reader(plan.rowSize, DATASET_READER_BLOCK_SIZE, !DATASET_PREFETCH && DATASET_READER_DOUBLE_BUFFERED);
+    // Time-ordered recordings converge poorly in file order, shuffle blocks and rows with the round's seed.
+    // The seed is fixed per federation, the round is mixed in so every round sees new permutations.
+    reader.setShuffle(DATASET_SHUFFLE, config.randomSeed + 0x9E3779B9u * (uint32_t)(currentRound + 1));
+    if (!openDatasetReader(reader, partition, binF, dataOffset, dataBytes)) {
+        D_println("Failed to open binary file");
         return NULL;
     }
 
-    IDFLOAT* x = new IDFLOAT[NN.layers[0]._numberOfInputs];
-    IDFLOAT* y = new IDFLOAT[NN.layers[NN.numberOflayers - 1]._numberOfOutputs];
+    // Rows are decoded into ready x / y slots, on core 0 when prefetching and inline otherwise
+    DatasetPrefetcher<IDFLOAT> prefetcher(reader, plan, numberOfInputs, numberOfClasses, config.epochs);
+    if (DATASET_PREFETCH && !prefetcher.start(0)) {
+        D_println("Failed to start prefetch task, decoding inline");
+    }
 
     // Debug: report NN expected sizes vs parsed sizes
-    D_println("[DBG] NN expected input size: " + String(NN.layers[0]._numberOfInputs) + ", parsed feature count: " + String(input_indices.size()));
-    D_println("[DBG] NN output size (num classes): " + String(NN.layers[NN.numberOflayers - 1]._numberOfOutputs));
+    D_println("[DBG] NN expected input size: " + String(numberOfInputs) + ", parsed feature count: " + String(parsedInputs));
+    D_println("[DBG] NN output size (num classes): " + String(numberOfClasses));
 
     multiClassClassifierMetrics* metrics = new multiClassClassifierMetrics;
-    metrics->numberOfClasses = NN.layers[NN.numberOflayers - 1]._numberOfOutputs;
-    metrics->metrics = new classClassifierMetricts[metrics->numberOfClasses];
+    metrics->begin(numberOfClasses);
 
     // Limit verbose prints: show detailed parse for first N rows, then periodic summaries
     const int DBG_FIRST_ROWS = 5;
     const int DBG_EVERY_N = 5000;
-    for (int epoch = 0; epoch < config.epochs; ++epoch) {
-        D_println("Epoch: " + String(epoch+1));
-        binF.seek(0);
-
-        while (binF.available() >= row_size) {
-            size_t n = binF.read(rowbuf, row_size);
-            if (n != (size_t)row_size) break;
-            datasetSize++;
+    unsigned int epoch = 0;
+    D_println("Epoch: " + String(epoch+1));
+
+    // Batch size 1 trains each row through the library's BackProp, larger batches use one averaged update
+    ModelTrainer* batch = NULL;
+    unsigned int batchCount = 0;
+    bool diverged = false;
+    if (needsBatchTrainer(config)) {
+        batch = createBatchTrainer(NN, config);
+        if (batch == NULL) D_println("Not enough memory for batch size " + String(config.batchSize) + ", training per row");
+        else D_println("Batch trainer, batch size " + String(config.batchSize));
+    }
+
+    // Snapshots every CHECKPOINT_EVERY_ROWS rows, a NaN/Inf error restores the last one with a smaller learning rate
+    File checkpointFile;
+    TrainingCheckpoint* checkpoint = createCheckpoint(NN, config, checkpointFile);
+    saveCheckpoint(checkpoint, batch);
+    unsigned long checkpointRows = 0;
+
+    PrefetchSlot<IDFLOAT>* slot;
+    while ((slot = prefetcher.acquire()) != nullptr) {
+        if (slot->endOfEpoch) {
+            prefetcher.release();
+            // Batches do not span epochs
+            if (batchCount > 0) {
+                diverged = !trainBatch(NN, *batch, batchCount, metrics) && !rollBack(NN, checkpoint, batch, metrics);
+                batchCount = 0;
+                if (diverged) break;
+            }
+            if (++epoch < config.epochs) {
+                D_println("Epoch: " + String(epoch+1));
+            }
+            continue;
+        }
+        // Only a row that would be trained over budget counts, a budget that ends with the last epoch is not cut short
+        if (trainingBudgetReached(config, initTime, datasetSize)) {
+            metrics->budgetReached = true;
+            prefetcher.stop();
+            break;
+        }
+        IDFLOAT* x = slot->x;
+        IDFLOAT* y = slot->y;
+        datasetSize++;
+
+        // Debug: print sample parsed X for first rows and periodic samples
+        if ((int)datasetSize <= DBG_FIRST_ROWS || (datasetSize % DBG_EVERY_N) == 0) {
+            D_println("[DBG] Row #" + String(datasetSize) + " parsed -- first few features:");
+            String s = "";
+            for (size_t xi = 0; xi < plan.numberOfSteps; ++xi) {
+                s += String((double)x[xi], 6);
+                if (xi + 1 < plan.numberOfSteps) s += ", ";
+                if (xi > 30) { s += ", ..."; break; }
+            }
+            D_println(s);
+        }
 
-            // parse inputs
-            for (size_t i = 0; i < input_indices.size(); ++i) {
-                int ci = input_indices[i];
-                Col &c = cols[ci];
-                float val = 0.0f;
-                if (c.type == "float32") {
-                    float v; memcpy(&v, rowbuf + c.offset, 4); val = v;
-                } else if (c.type == "int32") {
-                    int32_t v; memcpy(&v, rowbuf + c.offset, 4); val = (float)v; // timestamp skipped earlier
-                } else if (c.type == "uint8") {
-                    uint8_t v = *(uint8_t*)(rowbuf + c.offset); val = (float)v;
-                } else if (c.type == "int8") {
-                    int8_t v = *(int8_t*)(rowbuf + c.offset); val = (float)v;
-                }
-                #if defined(USE_64_BIT_DOUBLE)
-                x[i] = (IDFLOAT)val;
-                #else
-                x[i] = (IDFLOAT)val;
-                #endif
+        // Debug: print y (one-hot) for the same sample rows
+        if ((int)datasetSize <= DBG_FIRST_ROWS || (datasetSize % DBG_EVERY_N) == 0) {
+            String ys = "[DBG] y: ";
+            for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
+                ys += String((int)y[k]);
+                if (k < metrics->numberOfClasses - 1) ys += ",";
             }
+            D_println(ys);
+        }
 
-            // Debug: print sample parsed X for first rows and periodic samples
-            if ((int)datasetSize <= DBG_FIRST_ROWS || (datasetSize % DBG_EVERY_N) == 0) {
-                D_println("[DBG] Row #" + String(datasetSize) + " parsed -- first few features:");
-                String s = "";
-                for (size_t xi = 0; xi < input_indices.size(); ++xi) {
-                    s += String((double)x[xi], 6);
-                    if (xi < input_indices.size() - 1) s += ", ";
-                    if (xi > 30) { s += ", ..."; break; }
+        if (batch != NULL) {
+            memcpy(batch->input(batchCount), x, numberOfInputs * sizeof(IDFLOAT));
+            memcpy(batch->target(batchCount), y, numberOfClasses * sizeof(IDFLOAT));
+            prefetcher.release();
+            if (++batchCount == batch->getBatchSize()) {
+                batchCount = 0;
+                if (!trainBatch(NN, *batch, batch->getBatchSize(), metrics)) {
+                    if (rollBack(NN, checkpoint, batch, metrics)) continue;
+                    diverged = true;
+                    break;
+                }
+                if (checkpoint != NULL && datasetSize - checkpointRows >= CHECKPOINT_EVERY_ROWS) {
+                    saveCheckpoint(checkpoint, batch);
+                    checkpointRows = datasetSize;
                 }
-                D_println(s);
             }
+            continue;
+        }
 
-            // parse label and build one-hot y
-            long labelVal = 0;
-            Col &lc = cols[label_index];
-            if (lc.type == "int8") { int8_t v; memcpy(&v, rowbuf + lc.offset, 1); labelVal = v; }
-            else if (lc.type == "uint8") { uint8_t v; memcpy(&v, rowbuf + lc.offset, 1); labelVal = v; }
-            else if (lc.type == "int32") { int32_t v; memcpy(&v, rowbuf + lc.offset, 4); labelVal = v; }
-            else { int32_t v; memcpy(&v, rowbuf + lc.offset, 4); labelVal = v; }
-
-            if (encoded_labels) {
-                // labelVal is encoded as 1..N where 0 means "no label".
-                int encoded = (int)labelVal - 1; // convert to 0-based index
-                if (encoded < 0 || encoded >= (int)metrics->numberOfClasses) {
-                    // no label or out-of-range -> all zeros
-                    for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) y[k] = (IDFLOAT)0.0;
-                } else {
-                    for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
-                        y[k] = (k == encoded) ? (IDFLOAT)1.0 : (IDFLOAT)0.0;
-                    }
+        // Train model
+        IDFLOAT* predictions = NN.FeedForward(x);
+        NN.BackProp(y);
+        DFLOAT error = NN.getMeanSqrdError(1);
+
+        // Detect gradient explosion / NaN or Inf in error and dump context
+        {
+            double mse = (double)error;
+            if (!isfinite(mse) || isnan(mse)) {
+                D_println("[ERR] Gradient explosion detected (meanSqrdError is NaN/Inf)");
+                D_println("[ERR] Epoch: " + String(epoch+1) + "  Row#: " + String(datasetSize));
+
+                // Print a short slice of x
+                String sx = "[ERR] x: ";
+                int max_x_print = 12;
+                for (size_t xi = 0; xi < plan.numberOfSteps && (int)xi < max_x_print; ++xi) {
+                    sx += String((double)x[xi], 6);
+                    if (xi + 1 < plan.numberOfSteps) sx += ", ";
                 }
-            } else {
+                if (plan.numberOfSteps > (size_t)max_x_print) sx += ", ...";
+                D_println(sx);
+
+                // Print y one-hot
+                String sy = "[ERR] y: ";
                 for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
-                    y[k] = (label_values[k] == labelVal) ? (IDFLOAT)1.0 : (IDFLOAT)0.0;
+                    sy += String((int)y[k]);
+                    if (k < metrics->numberOfClasses - 1) sy += ",";
                 }
-            }
+                D_println(sy);
 
-            // Debug: print y (one-hot) for the same sample rows
-            if ((int)datasetSize <= DBG_FIRST_ROWS || (datasetSize % DBG_EVERY_N) == 0) {
-                String ys = "[DBG] y: ";
+                // Print predictions
+                String sp = "[ERR] predictions: ";
                 for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
-                    ys += String((int)y[k]);
-                    if (k < metrics->numberOfClasses - 1) ys += ",";
+                    sp += String((double)predictions[k], 6);
+                    if (k < metrics->numberOfClasses - 1) sp += ",";
                 }
-                D_println(ys);
-            }
+                D_println(sp);
 
-            // Train model
-            IDFLOAT* predictions = NN.FeedForward(x);
-            NN.BackProp(y);
-            metrics->meanSqrdError = NN.getMeanSqrdError(1);
-
-            // Detect gradient explosion / NaN or Inf in error and dump context
-            {
-                double mse = (double)metrics->meanSqrdError;
-                if (!isfinite(mse) || isnan(mse)) {
-                    D_println("[ERR] Gradient explosion detected (meanSqrdError is NaN/Inf)");
-                    D_println("[ERR] Epoch: " + String(epoch+1) + "  Row#: " + String(datasetSize));
-
-                    // Print a short slice of x
-                    String sx = "[ERR] x: ";
-                    int max_x_print = 12;
-                    for (size_t xi = 0; xi < input_indices.size() && (int)xi < max_x_print; ++xi) {
-                        sx += String((double)x[xi], 6);
-                        if (xi < input_indices.size() - 1) sx += ", ";
-                    }
-                    if (input_indices.size() > (size_t)max_x_print) sx += ", ...";
-                    D_println(sx);
-
-                    // Print y one-hot
-                    String sy = "[ERR] y: ";
-                    for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
-                        sy += String((int)y[k]);
-                        if (k < metrics->numberOfClasses - 1) sy += ",";
-                    }
-                    D_println(sy);
-
-                    // Print predictions
-                    String sp = "[ERR] predictions: ";
-                    for (unsigned int k = 0; k < metrics->numberOfClasses; ++k) {
-                        sp += String((double)predictions[k], 6);
-                        if (k < metrics->numberOfClasses - 1) sp += ",";
-                    }
-                    D_println(sp);
-
-                    // Cleanup and return early to avoid further corruption
-                    metrics->trainingTime = millis() - initTime;
-                    metrics->epochs = config.epochs;
-                    delete[] x;
-                    delete[] y;
-                    free(rowbuf);
-                    binF.close();
-                    D_println("[ERR] Aborting training due to gradient explosion.");
-                    return metrics;
-                }
+                prefetcher.release();
+                if (rollBack(NN, checkpoint, batch, metrics)) continue;
+                diverged = true;
+                break;
             }
+        }
 
-            // Update metrics
-            for (int i = 0; i < metrics->numberOfClasses; i++) {
-                if (y[i] == 1) {
-                    if (predictions[i] >= 0.5) metrics->metrics[i].truePositives++;
-                    else metrics->metrics[i].falseNegatives++;
-                } else {
-                    if (predictions[i] >= 0.5) metrics->metrics[i].falsePositives++;
-                    else metrics->metrics[i].trueNegatives++;
-                }
-            }
+        // Update metrics
+        metrics->addLoss(error, 1);
+        if (slot->classIndex >= 0) countPrediction(metrics, (unsigned int)slot->classIndex, predictions);
+        else countPrediction(metrics, y, predictions);
+        prefetcher.release();
+        if (checkpoint != NULL && datasetSize - checkpointRows >= CHECKPOINT_EVERY_ROWS) {
+            saveCheckpoint(checkpoint, batch);
+            checkpointRows = datasetSize;
         }
     }
 
+    // Rows left over by a budget stop still get their update
+    if (batchCount > 0 && !diverged) diverged = !trainBatch(NN, *batch, batchCount, metrics) && !rollBack(NN, checkpoint, batch, metrics);
+    // Out of rollbacks, return the last good weights rather than the diverged ones
+    if (diverged && checkpoint != NULL && checkpoint->restore() && batch != NULL) batch->load();
+    closeCheckpoint(checkpoint, checkpointFile);
+    if (batch != NULL) {
+        D_println("Weight writes: " + String((unsigned long)batch->getWeightWrites()));
+        D_println("Layers split between cores: " + String(batch->getParallelLayers()));
+        batch->commit();
+        delete batch;
+    }
+    if (diverged) {
+        D_println("[ERR] Gradient explosion detected (meanSqrdError is NaN/Inf), " + String(metrics->rollbacks) + " rollbacks");
+        D_println("[ERR] Epoch: " + String(epoch+1) + "  Row#: " + String(datasetSize));
+        metrics->trainingTime = millis() - initTime;
+        metrics->epochs = config.epochs;
+        metrics->datasetBytesPerSecond = reader.bytesPerSecond();
+        metrics->datasetRowsPerSecond = reader.rowsPerSecond();
+        D_println("[ERR] Aborting training due to gradient explosion.");
+        return metrics;
+    }
+
     metrics->trainingTime = millis() - initTime;
-    metrics->epochs = config.epochs;
+    // A budget stop counts the epoch that was in progress
+    metrics->epochs = epoch < config.epochs ? epoch + 1 : config.epochs;
+    metrics->datasetBytesPerSecond = reader.bytesPerSecond();
+    metrics->datasetRowsPerSecond = reader.rowsPerSecond();
+    if (metrics->budgetReached) {
+        D_println("Training budget reached after " + String(datasetSize) + " rows, " + String(metrics->trainingTime) + " ms");
+    }
+    D_println("Dataset I/O: " + String(metrics->datasetBytesPerSecond) + " bytes/s, " + String(metrics->datasetRowsPerSecond) + " rows/s");
+    D_println("Prefetch stalls: " + String(prefetcher.getStalls()));
+    D_println("Longest gap between MQTT polls: " + String(mqttLongestGap) + " ms");
 
-    delete[] x;
-    delete[] y;
-    free(rowbuf);
-    binF.close();
     printTiming();
     D_println("Binary training complete.");
     return metrics;
 }
+
+bool convertBinaryToXY(const char* binPath, const char* metaPath, const char* xOutPath, const char* yOutPath) {
+    D_println("Converting binary dataset to CSV...");
+    File binF = LittleFS.open(binPath, "r");
+    if (!binF) {
+        D_println("Failed to open binary file");
+        return false;
+    }
+
+    // Every feature is written, not only the ones the current network takes
+    DecodePlan plan;
+    DatasetV2Header header = {};
+    size_t dataOffset = 0;
+    size_t dataBytes = SIZE_MAX;
+    unsigned int numberOfClasses;
+    if (loadDatasetPlanFromV2(nullptr, 0, binF, DATASET_CONVERT_MAX_FEATURES, plan, header)) {
+        dataOffset = header.headerBytes;
+        dataBytes = datasetV2DataBytes(header);
+        numberOfClasses = header.classCount;
+    } else if (header.magic != DATASET_V2_MAGIC && loadDatasetPlanFromMetadata(metaPath, DATASET_CONVERT_MAX_FEATURES, plan)) {
+        numberOfClasses = plan.numberOfLabelValues;
+    } else {
+        binF.close();
+        return false;
+    }
+
+    DatasetReader reader(plan.rowSize);
+    BlockWriter xOut, yOut;
+    if (!reader.open(binF, dataOffset, dataBytes) || !xOut.open(LittleFS.open(xOutPath, "w")) || !yOut.open(LittleFS.open(yOutPath, "w"))) {
+        D_println("Failed to open conversion files");
+        return false;
+    }
+    DatasetConvertStats stats;
+    bool result = convertDatasetToCsv(reader, plan, numberOfClasses, xOut, yOut, stats);
+    D_println("Converted " + String((unsigned long)stats.rows) + " rows in " + String(stats.micros / 1000) + " ms ("
+        + String(stats.bytesPerSecond() / 1048576.0, 2) + " MB/s), result: " + String(result));
+    return result;
+}
+
+bool convertXYToBinary(const char* xPath, const char* yPath, const char* outPath) {
+    D_println("Repacking CSV dataset into binary...");
+    CsvReader xIn, yIn;
+    BlockWriter out;
+    if (!xIn.open(LittleFS.open(xPath, "r")) || !yIn.open(LittleFS.open(yPath, "r"))) {
+        D_println("Failed to open CSV dataset");
+        return false;
+    }
+    // Written under a temporary name so an interrupted repack never leaves a truncated dataset behind
+    String tempPath = String(outPath) + ".tmp";
+    if (!out.open(LittleFS.open(tempPath, "w"))) {
+        D_println("Failed to create binary dataset");
+        return false;
+    }
+    DatasetConvertStats stats;
+    bool result = convertCsvToDataset(xIn, yIn, out, stats);
+    if (result) {
+        LittleFS.remove(outPath);
+        result = LittleFS.rename(tempPath.c_str(), outPath);
+    } else {
+        LittleFS.remove(tempPath);
+    }
+    D_println("Repacked " + String((unsigned long)stats.rows) + " rows in " + String(stats.micros / 1000) + " ms ("
+        + String(stats.bytesPerSecond() / 1048576.0, 2) + " MB/s), result: " + String(result));
+    return result;
+}
+
+bool quantizeCurrentModel(const ModelConfig& config, const String& bin_file, const String& meta_file) {
+    D_println("Quantizing current model...");
+    releaseQuantizedModel();
+    NeuralNetwork& NN = *currentModel;
+    unsigned int numberOfInputs = NN.layers[0]._numberOfInputs;
+    unsigned int numberOfClasses = NN.layers[NN.numberOflayers - 1]._numberOfOutputs;
+
+    DatasetPartition partition;
+    File binF;
+    DecodePlan plan;
+    size_t dataOffset, dataBytes;
+    if (!openDatasetSource(bin_file, meta_file, numberOfInputs, partition, binF, plan, dataOffset, dataBytes)) {
+        return false;
+    }
+    // Shuffled so the calibration slice covers more than the first recorded activity
+    DatasetReader reader(plan.rowSize);
+    reader.setShuffle(true, config.randomSeed);
+    if (!openDatasetReader(reader, partition, binF, dataOffset, dataBytes)) {
+        return false;
+    }
+
+    TrainLayer* layers = describeLayers(NN, config);
+    QuantizedModel* quantized = new QuantizedModel(layers, NN.numberOflayers);
+    delete[] layers;
+    if (!quantized->isValid()) {
+        D_println("Not enough memory for the quantized model");
+        delete quantized;
+        return false;
+    }
+
+    DFLOAT x[numberOfInputs];
+    memset(x, 0, sizeof(x));
+    const uint8_t* row;
+    while (quantized->getCalibrationRows() < QUANTIZED_CALIBRATION_ROWS && (row = reader.next()) != NULL) {
+        plan.decodeInputs(row, x);
+        quantized->calibrate(x);
+    }
+    if (!quantized->quantize()) {
+        D_println("No rows to calibrate the quantized model");
+        delete quantized;
+        return false;
+    }
+
+    // Held-out rows compare both models when there are any, otherwise the rows after the calibration slice,
+    // which the model was trained on, so the accuracies are training-set accuracies
+    QuantizationReport report = {};
+    DatasetPartition noPartition;
+    File testF;
+    DecodePlan testPlan;
+    size_t testOffset, testBytes;
+    DatasetReader testReader(plan.rowSize);
+    if (LittleFS.exists(XY_TEST_PATH) && openDatasetSource(XY_TEST_PATH, meta_file, numberOfInputs, noPartition, testF, testPlan, testOffset, testBytes, false)) {
+        if (testPlan.sameLayout(plan)) {
+            report.heldOut = openDatasetReader(testReader, noPartition, testF, testOffset, testBytes);
+        } else {
+            D_println("Held-out rows in " XY_TEST_PATH " do not match the training columns, comparing on training rows");
+            testF.close();
+        }
+    }
+    DatasetReader& evaluation = report.heldOut ? testReader : reader;
+    unsigned long floatMicros = 0, quantizedMicros = 0;
+    while (report.rows < QUANTIZED_EVALUATION_ROWS && (row = evaluation.next()) != NULL) {
+        int label = plan.classIndex(row, numberOfClasses);
+        if (label < 0) continue;
+        plan.decodeInputs(row, x);
+
+        unsigned long start = micros();
+        DFLOAT* predictions = NN.FeedForward(x);
+        floatMicros += micros() - start;
+        unsigned int floatClass = 0;
+        for (unsigned int k = 1; k < numberOfClasses; k++) if (predictions[k] > predictions[floatClass]) floatClass = k;
+
+        start = micros();
+        predictions = quantized->predict(x);
+        quantizedMicros += micros() - start;
+        unsigned int quantizedClass = 0;
+        for (unsigned int k = 1; k < numberOfClasses; k++) if (predictions[k] > predictions[quantizedClass]) quantizedClass = k;
+
+        report.floatCorrect += floatClass == (unsigned int)label;
+        report.quantizedCorrect += quantizedClass == (unsigned int)label;
+        report.rows++;
+    }
+    if (report.rows > 0) {
+        report.floatMicros = (float)floatMicros / report.rows;
+        report.quantizedMicros = (float)quantizedMicros / report.rows;
+    }
+    report.floatBytes = quantized->getSourceBytes();
+    report.quantizedBytes = quantized->getBytes();
+    quantizationReport = report;
+    currentQuantizedModel = quantized;
+
+    D_println("Quantized model on " + String(report.rows) + (report.heldOut ? " held-out" : " training") + " rows: accuracy float " + String(report.floatAccuracy() * 100, 2) + "%, int8 " + String(report.quantizedAccuracy() * 100, 2) + "%");
+    D_println("Latency float " + String(report.floatMicros, 1) + " us, int8 " + String(report.quantizedMicros, 1) + " us per row");
+    D_println("Memory float " + String((unsigned long)report.floatBytes) + " bytes, int8 " + String((unsigned long)report.quantizedBytes) + " bytes");
+    return true;
+}
 #endif
 
 #ifdef DATASET_ORIGINAL
@@ -554,123 +1268,122 @@ multiClassClassifierMetrics* trainModelFromOriginalDataset(NeuralNetwork& NN, Mo
 
     datasetSize = 0;
 
-    File xFile = LittleFS.open(x_file, "r");
-    File yFile = LittleFS.open(y_file, "r");
-
-    if (!xFile || !yFile) {
+    // Lines are read into fixed buffers and parsed in place, no String is allocated per row or value
+    CsvReader xReader, yReader;
+    if (!xReader.open(LittleFS.open(x_file, "r")) || !yReader.open(LittleFS.open(y_file, "r"))) {
         D_println("Error opening file");
         return NULL;
     }
 
-    // Dynamic buffer allocation
-    String xLine, yLine;
     // TODO mover para o heap caso estoure a memória
     IDFLOAT x[NN.layers[0]._numberOfInputs], y[NN.layers[NN.numberOflayers - 1]._numberOfOutputs];
 
     multiClassClassifierMetrics* metrics = new multiClassClassifierMetrics;
-    metrics->numberOfClasses = NN.layers[NN.numberOflayers - 1]._numberOfOutputs;
-    metrics->metrics = new classClassifierMetricts[metrics->numberOfClasses];
+    metrics->begin(NN.layers[NN.numberOflayers - 1]._numberOfOutputs);
+
+    ModelTrainer* batch = NULL;
+    unsigned int batchCount = 0;
+    bool diverged = false;
+    if (needsBatchTrainer(config)) {
+        batch = createBatchTrainer(NN, config);
+        if (batch == NULL) D_println("Not enough memory for batch size " + String(config.batchSize) + ", training per row");
+    }
+
+    // Same divergence handling as the binary path, a NaN/Inf error restores the last checkpoint with a smaller learning rate
+    File checkpointFile;
+    TrainingCheckpoint* checkpoint = createCheckpoint(NN, config, checkpointFile);
+    saveCheckpoint(checkpoint, batch);
+    unsigned long checkpointRows = 0;
 
     for (int t = 0; t < config.epochs; t++) {
         D_println("Epoch: " + String(t + 1));
 
         // Read from file
-        while (xFile.available() && yFile.available()) {
-            // Read full lines using String which handles dynamic memory
-            xLine = xFile.readStringUntil('\n');
-            yLine = yFile.readStringUntil('\n');
-            datasetSize++;
-
-            if (xLine.length() == 0 || yLine.length() == 0) {
+        char* xLine;
+        char* yLine;
+        while ((xLine = xReader.nextLine()) != nullptr && (yLine = yReader.nextLine()) != nullptr) {
+            if (*xLine == '\0' || *yLine == '\0') {
                 break;
             }
-
-            // Parse x values
-            int j = 0;
-            int startPos = 0;
-            int commaPos = xLine.indexOf(',');
-            while (commaPos >= 0 && j < NN.layers[0]._numberOfInputs) {
-                String valueStr = xLine.substring(startPos, commaPos);
-                #if defined(USE_64_BIT_DOUBLE)
-                x[j++] = strtod(valueStr.c_str(), NULL);
-                #else
-                x[j++] = strtof(valueStr.c_str(), NULL);
-                #endif
-                startPos = commaPos + 1;
-                commaPos = xLine.indexOf(',', startPos);
-            }
-            // Handle last value
-            if (startPos < xLine.length() && j < NN.layers[0]._numberOfInputs) {
-                String valueStr = xLine.substring(startPos);
-                #if defined(USE_64_BIT_DOUBLE)
-                x[j++] = strtod(valueStr.c_str(), NULL);
-                #else
-                x[j++] = strtof(valueStr.c_str(), NULL);
-                #endif
+            if (trainingBudgetReached(config, initTime, datasetSize)) {
+                metrics->budgetReached = true;
+                break;
             }
+            datasetSize++;
 
-            // Parse y values
-            int k = 0;
-            startPos = 0;
-            commaPos = yLine.indexOf(',');
-            while (commaPos >= 0 && k < NN.layers[NN.numberOflayers - 1]._numberOfOutputs) {
-                String valueStr = yLine.substring(startPos, commaPos);
-                #if defined(USE_64_BIT_DOUBLE)
-                y[k++] = strtod(valueStr.c_str(), NULL);
-                #else
-                y[k++] = strtof(valueStr.c_str(), NULL);
-                #endif
-                startPos = commaPos + 1;
-                commaPos = yLine.indexOf(',', startPos);
-            }
-            // Handle last value
-            if (startPos < yLine.length() && k < NN.layers[NN.numberOflayers - 1]._numberOfOutputs) {
-                String valueStr = yLine.substring(startPos);
-                #if defined(USE_64_BIT_DOUBLE)
-                y[k++] = strtod(valueStr.c_str(), NULL);
-                #else
-                y[k++] = strtof(valueStr.c_str(), NULL);
-                #endif
+            if (batch != NULL) {
+                // Parsed straight into the batch rows
+                parseCsvFields(xLine, batch->input(batchCount), NN.layers[0]._numberOfInputs);
+                parseCsvFields(yLine, batch->target(batchCount), NN.layers[NN.numberOflayers - 1]._numberOfOutputs);
+                if (++batchCount == batch->getBatchSize()) {
+                    batchCount = 0;
+                    if (!trainBatch(NN, *batch, batch->getBatchSize(), metrics)) {
+                        if (rollBack(NN, checkpoint, batch, metrics)) continue;
+                        diverged = true;
+                        break;
+                    }
+                    if (checkpoint != NULL && datasetSize - checkpointRows >= CHECKPOINT_EVERY_ROWS) {
+                        saveCheckpoint(checkpoint, batch);
+                        checkpointRows = datasetSize;
+                    }
+                }
+                continue;
             }
 
+            parseCsvFields(xLine, x, NN.layers[0]._numberOfInputs);
+            parseCsvFields(yLine, y, NN.layers[NN.numberOflayers - 1]._numberOfOutputs);
+
             // Train model
             IDFLOAT* predictions = NN.FeedForward(x);
             NN.BackProp(y);
-            metrics->meanSqrdError = NN.getMeanSqrdError(1);
+            DFLOAT error = NN.getMeanSqrdError(1);
+            if (!isfinite((double)error)) {
+                if (rollBack(NN, checkpoint, batch, metrics)) continue;
+                diverged = true;
+                break;
+            }
+            metrics->addLoss(error, 1);
 
             // Calculate metrics
-            // ! for non binary classification, the metrics are not calculated correctly
-            for (int i = 0; i < metrics->numberOfClasses; i++) {
-                if (y[i] == 1) {
-                    if (predictions[i] >= 0.5) {
-                        metrics->metrics[i].truePositives++;
-                    }
-                    else {
-                        metrics->metrics[i].falseNegatives++;
-                    }
-                }
-                else {
-                    if (predictions[i] >= 0.5) {
-                        metrics->metrics[i].falsePositives++;
-                    }
-                    else {
-                        metrics->metrics[i].trueNegatives++;
-                    }
-                }
+            countPrediction(metrics, y, predictions);
+            if (checkpoint != NULL && datasetSize - checkpointRows >= CHECKPOINT_EVERY_ROWS) {
+                saveCheckpoint(checkpoint, batch);
+                checkpointRows = datasetSize;
             }
+        }
 
-
+        // Batches do not span epochs
+        if (batchCount > 0 && !diverged) {
+            diverged = !trainBatch(NN, *batch, batchCount, metrics) && !rollBack(NN, checkpoint, batch, metrics);
         }
+        batchCount = 0;
 
-        yFile.seek(0);
-        xFile.seek(0);
+        if (diverged) {
+            D_println("[ERR] Gradient explosion detected (meanSqrdError is NaN/Inf), " + String(metrics->rollbacks) + " rollbacks");
+            D_println("[ERR] Epoch: " + String(t + 1) + "  Row#: " + String(datasetSize));
+            D_println("[ERR] Aborting training due to gradient explosion.");
+            break;
+        }
+        if (metrics->budgetReached) {
+            // A budget stop counts the epoch that was in progress
+            metrics->epochs = t + 1;
+            D_println("Training budget reached after " + String(datasetSize) + " rows, " + String(millis() - initTime) + " ms");
+            break;
+        }
+        yReader.rewind();
+        xReader.rewind();
     }
 
+    // Out of rollbacks, return the last good weights rather than the diverged ones
+    if (diverged && checkpoint != NULL && checkpoint->restore() && batch != NULL) batch->load();
+    closeCheckpoint(checkpoint, checkpointFile);
+    if (batch != NULL) batch->commit();
+    delete batch;
     metrics->trainingTime = millis() - initTime;
-    metrics->epochs = config.epochs;
+    if (!metrics->budgetReached) metrics->epochs = config.epochs;
 
-    xFile.close();
-    yFile.close();
+    xReader.close();
+    yReader.close();
     printTiming();
     D_println("Training complete.");
     return metrics;
@@ -679,16 +1392,37 @@ multiClassClassifierMetrics* trainModelFromOriginalDataset(NeuralNetwork& NN, Mo
 
 void setupFederatedModel() {
     if (newModel != NULL) {
-        delete newModel;
+        deleteModel(newModel);
     }
 
-    newModel = new NeuralNetwork(federateModelConfig->layers, federateModelConfig->numberOfLayers, federateModelConfig->actvFunctions);
-    newModel->LearningRateOfBiases = federateModelConfig->learningRateOfBiases;
-    newModel->LearningRateOfWeights = federateModelConfig->learningRateOfWeights;
+    newModel = createModel(*federateModelConfig);
     newModelState = ModelState_READY_TO_TRAIN;
+    // The server has not seen this model, the first upload is a whole one
+    sparseUplink.reset();
+}
+
+// Marks NN as the last global model received, and keeps it for a federated round that uploads sparse deltas
+void keepGlobalModel(NeuralNetwork& NN) {
+    globalBase = &NN;
+    if (federateState != FederateState_TRAINING || federateModelConfig == NULL) return;
+    FlatModel* flat = getFlatModel(&NN);
+    unsigned int firstLayer, lastLayer;
+    if ((federateModelConfig->sparseUplink <= 0 && federateModelConfig->sparseThreshold <= 0) || flat == NULL || partialExchange(NN, firstLayer, lastLayer)) {
+        sparseUplink.release();
+        return;
+    }
+    if (!sparseUplink.begin(flat->getParameterCount())) {
+        D_println("Not enough memory for the sparse uplink, sending whole models");
+        return;
+    }
+    sparseUplink.setGlobal(flat->parameters());
 }
 
 void processMessages() {
+    // Longest gap between polls, training reports it to show what the tasks sharing core 0 cost the MQTT task
+    unsigned long now = millis();
+    if (mqttLastPoll != 0 && now - mqttLastPoll > mqttLongestGap) mqttLongestGap = now - mqttLastPoll;
+    mqttLastPoll = now;
     ensureConnected();
     if (!sendingMessage) {
         if (unsubscribeFromResume) {
@@ -700,6 +1434,14 @@ void processMessages() {
             D_println("Unsubscribed from resume topic");
             unsubscribeFromResume = false;
         }
+        if (reportReceivedModel) {
+            reportReceivedModel = false;
+            sendMessageToNetwork(FederateCommand_RECEIVED);
+        }
+        if (requestFullModel) {
+            requestFullModel = false;
+            sendMessageToNetwork(FederateCommand_REQUEST_MODEL);
+        }
         mqtt.loop();
     }
 }
@@ -712,33 +1454,26 @@ void setupResume() {
             return;
         }
         newModelState = ModelState_MODEL_BUSY;
-        model* mm = transformDataToModel(stream);
-        if (mm != NULL && mm->biases != NULL && mm->weights != NULL) {
+        NeuralNetwork* received = NULL;
+        model* mm = transformDataToModel(stream, *federateModelConfig, received);
+        if (mm != NULL) {
             if (tempModel != NULL) {
                 delete tempModel;
             }
-            if (newModel != NULL) {
-                delete newModel;
-            }
             tempModel = mm;
-            newModel = new NeuralNetwork(federateModelConfig->layers, tempModel->weights, tempModel->biases, federateModelConfig->numberOfLayers, federateModelConfig->actvFunctions);
-            newModel->LearningRateOfBiases = federateModelConfig->learningRateOfBiases;
-            newModel->LearningRateOfWeights = federateModelConfig->learningRateOfWeights;
+            newModel = received;
             newModelState = ModelState_READY_TO_TRAIN;
             federateState = FederateState_TRAINING;
+            keepGlobalModel(*newModel);
             unsubscribeFromResume = true;
             D_println("Resume setup done, waiting for training to start...");
         } else {
-            if (mm != NULL) {
-                delete mm;
-            }
             if (tempModel != NULL) {
                 delete tempModel;
             }
             if (newModel != NULL) {
-                delete newModel;
+                deleteModel(newModel);
             }
-            mm = NULL;
             tempModel = NULL;
             newModel = NULL;
             newModelState = ModelState_IDLE;
@@ -757,41 +1492,30 @@ void setupResume() {
             return;
         }
         newModelState = ModelState_MODEL_BUSY;
-
-        File file = LittleFS.open(TEMPORARY_NEW_MODEL_PATH, "w+");
-        if (!file) {
-            D_println("Error opening file for writing");
-            return;
-        }
-        while (stream.available()) {
-            file.write(stream.read());
-        }
-        file.seek(0);
+        unsigned long startTime = millis();
 
         if (tempModel != NULL) {
             delete tempModel;
-        }
-        if (newModel != NULL) {
-            delete newModel;
+            tempModel = NULL;
         }
 
-        newModel = new NeuralNetwork(localModelConfig->layers, localModelConfig->numberOfLayers, localModelConfig->actvFunctions);
-        newModel->LearningRateOfBiases = localModelConfig->learningRateOfBiases;
-        newModel->LearningRateOfWeights = localModelConfig->learningRateOfWeights;
-        
-        if (newModel->load(file)) {
+        bool loaded = receiveRawModel(stream, *localModelConfig);
+        if (loaded) {
+            tempModel = new model;
+            tempModel->parsingTime = millis() - startTime;
             newModelState = ModelState_READY_TO_TRAIN;
             federateState = FederateState_TRAINING;
+            keepGlobalModel(*newModel);
             unsubscribeFromResume = true;
             D_println("Resume setup done, waiting for training to start...");
         } else {
-            D_println("Error loading model from file");
+            D_println("Error receiving raw model");
 
             if (tempModel != NULL) {
                 delete tempModel;
             }
             if (newModel != NULL) {
-                delete newModel;
+                deleteModel(newModel);
             }
             tempModel = NULL;
             newModel = NULL;
@@ -837,9 +1561,11 @@ void setupMQTT(bool resume) {
                 sendModelToNetwork(*currentModel, *currentModelMetrics);
                 if (federateState == FederateState_TRAINING) {
                     if (newModel != NULL)
-                        delete newModel;
+                        deleteModel(newModel);
                     if (newModelMetrics != NULL)
                         delete newModelMetrics;
+                    newModel = NULL;
+                    newModelMetrics = NULL;
                     newModelState = ModelState_IDLE;
                 }
             } else if (strcmp(command, "federate_join") == 0) {
@@ -880,6 +1606,37 @@ void setupMQTT(bool resume) {
                         if (doc["config"]["learningRateOfBiases"].is<IDFLOAT>()) {
                             federateModelConfig->learningRateOfBiases = doc["config"]["learningRateOfBiases"].as<IDFLOAT>();
                         }
+                        if (doc["config"]["timeBudget"].is<unsigned long>()) {
+                            federateModelConfig->timeBudget = doc["config"]["timeBudget"].as<unsigned long>();
+                        }
+                        if (doc["config"]["maxRows"].is<unsigned long>()) {
+                            federateModelConfig->maxRows = doc["config"]["maxRows"].as<unsigned long>();
+                        }
+                        if (doc["config"]["batchSize"].is<unsigned int>()) {
+                            federateModelConfig->batchSize = doc["config"]["batchSize"].as<unsigned int>();
+                        }
+                        if (doc["config"]["optimizer"].is<const char*>()) {
+                            federateModelConfig->optimizer.type = optimizerFromName(doc["config"]["optimizer"].as<const char*>());
+                        }
+                        if (doc["config"]["momentum"].is<float>()) {
+                            federateModelConfig->optimizer.momentum = doc["config"]["momentum"].as<float>();
+                        }
+                        if (doc["config"]["beta1"].is<float>()) {
+                            federateModelConfig->optimizer.beta1 = doc["config"]["beta1"].as<float>();
+                        }
+                        if (doc["config"]["beta2"].is<float>()) {
+                            federateModelConfig->optimizer.beta2 = doc["config"]["beta2"].as<float>();
+                        }
+                        if (doc["config"]["trainableLayers"].is<JsonArray>()) {
+                            federateModelConfig->firstTrainableLayer = doc["config"]["trainableLayers"][0] | 0;
+                            federateModelConfig->lastTrainableLayer = doc["config"]["trainableLayers"][1] | -1;
+                        }
+                        if (doc["config"]["sparseUplink"].is<float>()) {
+                            federateModelConfig->sparseUplink = doc["config"]["sparseUplink"].as<float>();
+                        }
+                        if (doc["config"]["sparseThreshold"].is<float>()) {
+                            federateModelConfig->sparseThreshold = doc["config"]["sparseThreshold"].as<float>();
+                        }
                         federateState = FederateState_TRAINING;
                         currentRound = 0;
                         setupFederatedModel();
@@ -947,47 +1704,29 @@ void setupMQTT(bool resume) {
             return;
         }
         newModelState = ModelState_MODEL_BUSY;
-        File file = LittleFS.open(TEMPORARY_NEW_MODEL_PATH, "w+");
-        if (!file) {
-            D_println("Error opening file for writing");
-            return;
-        }
-        while (stream.available()) {
-            file.write(stream.read());
-        }
-        file.seek(0);
-
-        if (federateState == FederateState_NONE) {
-            newModel = new NeuralNetwork(localModelConfig->layers, localModelConfig->numberOfLayers, localModelConfig->actvFunctions);
-            newModel->LearningRateOfBiases = localModelConfig->learningRateOfBiases;
-            newModel->LearningRateOfWeights = localModelConfig->learningRateOfWeights;
-        } else {
-            newModel = new NeuralNetwork(federateModelConfig->layers, federateModelConfig->numberOfLayers, federateModelConfig->actvFunctions);
-            newModel->LearningRateOfBiases = federateModelConfig->learningRateOfBiases;
-            newModel->LearningRateOfWeights = federateModelConfig->learningRateOfWeights;
-        }
+        bool loaded = receiveRawModel(stream, federateState == FederateState_NONE ? *localModelConfig : *federateModelConfig);
 
-        if (newModel->load(file)) {
-            D_println("Model loaded successfully from file");
+        if (loaded) {
             if (tempModel != NULL) {
                 delete tempModel;
             }
             tempModel = new model;
             tempModel->parsingTime = millis() - startTime;
             currentRound++;
+            keepGlobalModel(*newModel);
 
             newModelState = ModelState_READY_TO_TRAIN;
             saveDeviceConfig();
             D_println("New model ready to train");
 
         } else {
-            D_println("Error loading model from file");
+            D_println("Error receiving raw model");
 
             if (tempModel != NULL) {
                 delete tempModel;
             }
             if (newModel != NULL) {
-                delete newModel;
+                deleteModel(newModel);
             }
             tempModel = NULL;
             newModel = NULL;
@@ -1005,41 +1744,28 @@ void setupMQTT(bool resume) {
             return;
         }
         newModelState = ModelState_MODEL_BUSY;
-        model* mm = transformDataToModel(stream);
-        if (mm != NULL && mm->biases != NULL && mm->weights != NULL) {
+        NeuralNetwork* received = NULL;
+        model* mm = transformDataToModel(stream, federateState == FederateState_NONE ? *localModelConfig : *federateModelConfig, received);
+        if (mm != NULL) {
             if (tempModel != NULL) {
                 delete tempModel;
             }
-            if (newModel != NULL) {
-                delete newModel;
-            }
             if (mm->round >= 0) {
                 currentRound = mm->round;
             }
             tempModel = mm;
+            newModel = received;
+            keepGlobalModel(*newModel);
             D_println("Model parsed successfully from subscribe...");
-            if (federateState == FederateState_NONE) {
-                newModel = new NeuralNetwork(localModelConfig->layers, tempModel->weights, tempModel->biases, localModelConfig->numberOfLayers, localModelConfig->actvFunctions);
-                newModel->LearningRateOfBiases = localModelConfig->learningRateOfBiases;
-                newModel->LearningRateOfWeights = localModelConfig->learningRateOfWeights;
-            } else {
-                newModel = new NeuralNetwork(federateModelConfig->layers, tempModel->weights, tempModel->biases, federateModelConfig->numberOfLayers, federateModelConfig->actvFunctions);
-                newModel->LearningRateOfBiases = federateModelConfig->learningRateOfBiases;
-                newModel->LearningRateOfWeights = federateModelConfig->learningRateOfWeights;
-            }
             newModelState = ModelState_READY_TO_TRAIN;
             saveDeviceConfig();
         } else {
-            if (mm != NULL) {
-                delete mm;
-            }
             if (tempModel != NULL) {
                 delete tempModel;
             }
             if (newModel != NULL) {
-                delete newModel;
+                deleteModel(newModel);
             }
-            mm = NULL;
             tempModel = NULL;
             newModel = NULL;
             newModelState = ModelState_IDLE;
@@ -1174,16 +1900,7 @@ void sendMessageToNetwork(FederateCommand command) {
         doc["metrics"]["f1Score"] = currentModelMetrics->f1Score();
         doc["metrics"]["meanSqrdError"] = currentModelMetrics->meanSqrdError;
         doc["metrics"]["numberOfClasses"] = currentModelMetrics->numberOfClasses;
-        doc["metrics"]["truePositives"] = JsonArray();
-        doc["metrics"]["falsePositives"] = JsonArray();
-        doc["metrics"]["trueNegatives"] = JsonArray();
-        doc["metrics"]["falseNegatives"] = JsonArray();
-        for (int i = 0; i < currentModelMetrics->numberOfClasses; i++) {
-            doc["metrics"]["truePositives"].add(currentModelMetrics->metrics[i].truePositives);
-            doc["metrics"]["falsePositives"].add(currentModelMetrics->metrics[i].falsePositives);
-            doc["metrics"]["trueNegatives"].add(currentModelMetrics->metrics[i].trueNegatives);
-            doc["metrics"]["falseNegatives"].add(currentModelMetrics->metrics[i].falseNegatives);
-        }*/
+        writeConfusion(doc["metrics"]["confusion"].to<JsonArray>(), *currentModelMetrics);*/
         auto publish = mqtt.begin_publish(MQTT_SEND_COMMANDS_TOPIC, measureJson(doc));
         serializeJson(doc, publish);
         publish.send();
@@ -1211,11 +1928,75 @@ void sendMessageToNetwork(FederateCommand command) {
         publishAlive.send();
         break;
     }
+    case FederateCommand_RECEIVED: {
+        char crc[9];
+        snprintf(crc, sizeof(crc), "%08lx", (unsigned long)receivedModelCrc);
+        doc["command"] = "received";
+        doc["client"] = CLIENT_NAME;
+        doc["round"] = currentRound;
+        doc["bytes"] = (unsigned long)receivedModelBytes;
+        doc["crc32"] = crc;
+        auto publishReceived = mqtt.begin_publish(MQTT_SEND_COMMANDS_TOPIC, measureJson(doc));
+        serializeJson(doc, publishReceived);
+        publishReceived.send();
+        break;
+    }
+    case FederateCommand_REQUEST_MODEL: {
+        D_println("Requesting the full model...");
+
+        doc["command"] = "model";
+        doc["client"] = CLIENT_NAME;
+        doc["round"] = currentRound;
+        doc["full"] = true;
+        auto publishRequest = mqtt.begin_publish(MQTT_SEND_COMMANDS_TOPIC, measureJson(doc));
+        serializeJson(doc, publishRequest);
+        publishRequest.send();
+        break;
+    }
     }
     sendingMessage = false;
 }
 
-void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics) {
+void addParameters(JsonArray array, const IDFLOAT* values, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+#if defined(USE_64_BIT_DOUBLE)
+        array.add(String(values[k], 16));
+#else
+        array.add(values[k]);
+#endif
+    }
+}
+
+// Collects small writes into chunk and hands them to out in full chunks
+template <typename Out>
+struct ChunkedWriter {
+    Out& out;
+    uint8_t* chunk;
+    size_t capacity;
+    size_t fill = 0;
+
+    ChunkedWriter(Out& out, uint8_t* chunk, size_t capacity) : out(out), chunk(chunk), capacity(capacity) {}
+
+    size_t write(const uint8_t* data, size_t length) {
+        size_t left = length;
+        while (left > 0) {
+            size_t n = min(left, capacity - fill);
+            memcpy(chunk + fill, data, n);
+            fill += n;
+            data += n;
+            left -= n;
+            if (fill == capacity) flush();
+        }
+        return length;
+    }
+
+    void flush() {
+        if (fill > 0) out.write(chunk, fill);
+        fill = 0;
+    }
+};
+
+void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics, bool roundUpload) {
     // ! PicoMQTT can only handle send one message at a time, so we do a semaphore to prevent other messages from being sent at the same time
     while (sendingMessage) delay(10);
     sendingMessage = true;
@@ -1243,21 +2024,21 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
     // TODO Migrate this code into a function that persists after the function exits
     doc["client"] = CLIENT_NAME;
     doc["metrics"] = JsonObject();
-    doc["metrics"]["accuracy"] = metrics.accuracy();
-    doc["metrics"]["precision"] = metrics.precision();
-    doc["metrics"]["recall"] = metrics.recall();
-    doc["metrics"]["f1Score"] = metrics.f1Score();
+    const MetricsSummary& summary = metrics.summary();
+    doc["metrics"]["accuracy"] = summary.accuracy;
+    doc["metrics"]["precision"] = summary.precision;
+    doc["metrics"]["recall"] = summary.recall;
+    doc["metrics"]["f1Score"] = summary.f1Score;
+    doc["metrics"]["weightedPrecision"] = summary.weightedPrecision;
+    doc["metrics"]["weightedRecall"] = summary.weightedRecall;
+    doc["metrics"]["weightedF1Score"] = summary.weightedF1Score;
     doc["metrics"]["meanSqrdError"] = metrics.meanSqrdError;
+    doc["metrics"]["rollbacks"] = metrics.rollbacks;
+    doc["metrics"]["learningRateScale"] = metrics.learningRateScale;
     doc["metrics"]["numberOfClasses"] = metrics.numberOfClasses;
-    doc["metrics"]["truePositives"] = JsonArray();
-    doc["metrics"]["falsePositives"] = JsonArray();
-    doc["metrics"]["trueNegatives"] = JsonArray();
-    doc["metrics"]["falseNegatives"] = JsonArray();
-    for (int i = 0; i < metrics.numberOfClasses; i++) {
-        doc["metrics"]["truePositives"].add(metrics.metrics[i].truePositives);
-        doc["metrics"]["falsePositives"].add(metrics.metrics[i].falsePositives);
-        doc["metrics"]["trueNegatives"].add(metrics.metrics[i].trueNegatives);
-        doc["metrics"]["falseNegatives"].add(metrics.metrics[i].falseNegatives);
+    // The per-class counts follow from the matrix, the receiver derives them
+    if (metrics.confusion != NULL) {
+        writeConfusion(doc["metrics"]["confusion"].to<JsonArray>(), metrics);
     }
 
     doc["model"] = JsonArray();
@@ -1265,6 +2046,13 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
         doc["model"].add(NN.layers[n]._numberOfInputs);
     }
     doc["model"].add(NN.layers[NN.numberOflayers - 1]._numberOfOutputs);
+    // Fine-tuning rounds only send the trainable layers, in both the JSON weights and the raw model
+    unsigned int firstLayer = 0, lastLayer = NN.numberOflayers - 1;
+    bool partial = partialExchange(NN, firstLayer, lastLayer);
+    if (partial) {
+        doc["layerRange"].add(firstLayer);
+        doc["layerRange"].add(lastLayer);
+    }
     doc["epochs"] = metrics.epochs;
     doc["datasetSize"] = datasetSize;
     doc["timings"] = JsonObject();
@@ -1272,6 +2060,21 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
     doc["timings"]["previousConstruct"] = previousConstruct;
     doc["timings"]["training"] = metrics.trainingTime;
     doc["timings"]["parsing"] = metrics.parsingTime;
+    doc["timings"]["datasetBytesPerSecond"] = metrics.datasetBytesPerSecond;
+    doc["timings"]["datasetRowsPerSecond"] = metrics.datasetRowsPerSecond;
+    doc["timings"]["budgetReached"] = metrics.budgetReached;
+
+    if (currentQuantizedModel != NULL && quantizationReport.rows > 0) {
+        doc["quantized"] = JsonObject();
+        doc["quantized"]["heldOut"] = quantizationReport.heldOut;
+        doc["quantized"]["rows"] = quantizationReport.rows;
+        doc["quantized"]["floatAccuracy"] = quantizationReport.floatAccuracy();
+        doc["quantized"]["accuracy"] = quantizationReport.quantizedAccuracy();
+        doc["quantized"]["floatMicros"] = quantizationReport.floatMicros;
+        doc["quantized"]["micros"] = quantizationReport.quantizedMicros;
+        doc["quantized"]["floatBytes"] = quantizationReport.floatBytes;
+        doc["quantized"]["bytes"] = quantizationReport.quantizedBytes;
+    }
 
     doc["memory"] = JsonObject();
     doc["memory"]["fixed"] = JsonObject();
@@ -1288,29 +2091,63 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
     doc["memory"]["round"]["afterTrain"] = roundMemoryUsage.afterTrain;
 
     if ((federateModelConfig != NULL && federateModelConfig->jsonWeights && federateState != FederateState_NONE) || (federateState == FederateState_NONE && localModelConfig->jsonWeights)) {
-        doc["biases"] = JsonArray();
-        doc["weights"] = JsonArray();
-        for (unsigned int n = 0; n < NN.numberOflayers; n++) {
-            for (unsigned int i = 0; i < NN.layers[n]._numberOfOutputs; i++) {
-#if defined(USE_64_BIT_DOUBLE)
-                doc["biases"].add(String(NN.layers[n].bias[i], 16));
-#else
-                doc["biases"].add(NN.layers[n].bias[i]);
-#endif
-                for (unsigned int j = 0; j < NN.layers[n]._numberOfInputs; j++) {
-#if defined(USE_64_BIT_DOUBLE)
-                    doc["weights"].add(String(NN.layers[n].weights[i][j], 16));
-#else
-                    doc["weights"].add(NN.layers[n].weights[i][j]);
-#endif
+        JsonArray biases = doc["biases"].to<JsonArray>();
+        JsonArray weights = doc["weights"].to<JsonArray>();
+        FlatModel* flat = getFlatModel(&NN);
+        if (flat != NULL) {
+            // The range is one slice of the weights and one of the biases
+            size_t weightStart = 0, biasStart = 0, weightCount = 0, biasCount = 0;
+            for (unsigned int n = 0; n <= lastLayer; n++) {
+                size_t layerWeights = (size_t)NN.layers[n]._numberOfInputs * NN.layers[n]._numberOfOutputs;
+                if (n < firstLayer) {
+                    weightStart += layerWeights;
+                    biasStart += NN.layers[n]._numberOfOutputs;
+                } else {
+                    weightCount += layerWeights;
+                    biasCount += NN.layers[n]._numberOfOutputs;
+                }
+            }
+            addParameters(biases, flat->biases() + biasStart, biasCount);
+            addParameters(weights, flat->weights() + weightStart, weightCount);
+        } else {
+            for (unsigned int n = firstLayer; n <= lastLayer; n++) {
+                addParameters(biases, NN.layers[n].bias, NN.layers[n]._numberOfOutputs);
+                for (unsigned int i = 0; i < NN.layers[n]._numberOfOutputs; i++) {
+                    addParameters(weights, NN.layers[n].weights[i], NN.layers[n]._numberOfInputs);
                 }
             }
         }
     }
 
-    File modelFile = LittleFS.open(TEMPORARY_NEW_MODEL_PATH, "w");
-    NN.save(modelFile);
-    
+    // Both layouts go out straight from RAM. The layer range one has its exact size up front, NN.save() is run once to count its bytes
+    TrainLayer* layers = describeLayers(NN, federateModelConfig != NULL && federateState != FederateState_NONE ? *federateModelConfig : *localModelConfig);
+    bool layerRange = partial || RAW_PUBLISH_LAYER_RANGE;
+    // With a sparse uplink a federated round sends its largest changes against the global model it received. Other sends
+    // (request_model replies, serial commands) go out whole and leave the residual alone.
+    FlatModel* parameters = getFlatModel(&NN);
+    bool sparse = roundUpload && !partial && federateState == FederateState_TRAINING && sparseUplink.hasGlobalModel() && parameters != NULL &&
+                  parameters->getParameterCount() == sparseUplink.getParameterCount();
+    size_t size;
+    if (sparse) {
+        size_t k = 0;
+        if (federateModelConfig->sparseUplink > 0) {
+            k = (size_t)(federateModelConfig->sparseUplink * parameters->getParameterCount());
+            if (k == 0) k = 1;
+        }
+        size_t entries = sparseUplink.select(parameters->parameters(), k, federateModelConfig->sparseThreshold);
+        size = sparseDeltaBytes(entries);
+        doc["sparseDelta"]["entries"] = entries;
+        doc["sparseDelta"]["parameters"] = parameters->getParameterCount();
+    } else if (layerRange) {
+        size = partialModelBytes(layers, firstLayer, lastLayer);
+    } else {
+        SizeCounter counter;
+        File counting = sinkFile(counter);
+        NN.save(counting);
+        size = counter.bytes;
+    }
+    doc["rawBytes"] = size;
+
     printMemory();
     roundMemoryUsage.beforeSend = info.total_free_bytes;
     roundMemoryUsage.minimumFree = info.minimum_free_bytes;
@@ -1321,21 +2158,24 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
     String topic = String(MQTT_RAW_PUBLISH_TOPIC);
     topic.concat("/");
     topic.concat(CLIENT_NAME);
-    modelFile = LittleFS.open(TEMPORARY_NEW_MODEL_PATH, "r");
-    size_t size = modelFile.available();
-    D_println("Model serialized to file");
     D_println("Topic: " + topic);
-    char* buffer = new char[1024];
-    uint8_t* buff = (uint8_t*)buffer;
-    size_t bytesRead = modelFile.readBytes(buffer, 1024);
     auto publish = mqtt.begin_publish(topic, size);
-    while (bytesRead > 0) {
-        publish.write(buff, bytesRead);
-        bytesRead = modelFile.readBytes(buffer, 1024);
+    ChunkedWriter<decltype(publish)> out(publish, rawPublishChunk, sizeof(rawPublishChunk));
+    if (sparse) {
+        sparseUplink.write(out);
+        doc["sparseDelta"]["residual"] = sparseUplink.residualNorm();
+        D_println("Sparse delta streamed from RAM");
+    } else if (layerRange) {
+        writePartialModel(out, layers, NN.numberOflayers, firstLayer, lastLayer);
+        D_println("Model streamed from RAM");
+    } else {
+        File sink = sinkFile(out);
+        NN.save(sink);
+        D_println("Model saved straight to the stream");
     }
+    out.flush();
     publish.send();
-    delete[] buffer;
-    modelFile.close();
+    delete[] layers;
 
     auto publish2 = mqtt.begin_publish(MQTT_PUBLISH_TOPIC, measureJson(doc));
     serializeJson(doc, publish2);
@@ -1352,7 +2192,18 @@ void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics)
     sendingMessage = false;
 }
 
+void releaseQuantizedModel() {
+    if (currentQuantizedModel != NULL) {
+        delete currentQuantizedModel;
+        currentQuantizedModel = NULL;
+    }
+    quantizationReport = {};
+}
+
 DFLOAT* predictFromCurrentModel(DFLOAT* x) {
+    if (currentQuantizedModel != NULL) {
+        return currentQuantizedModel->predict(x);
+    }
     return currentModel->FeedForward(x);
 }
 
@@ -1496,13 +2347,15 @@ void processModel() {
         printMemory();
         roundMemoryUsage.afterTrain = info.total_free_bytes;
         if (federateState == FederateState_TRAINING) {
-            sendModelToNetwork(*newModel, *newModelMetrics);
+            sendModelToNetwork(*newModel, *newModelMetrics, true);
             if (newModelMetrics != NULL) {
                 delete newModelMetrics;
                 newModelMetrics = NULL;
             }
-            if (newModel != NULL) {
-                delete newModel;
+            // In fine-tuning rounds the trained model holds the frozen layers the next partial pull is written over
+            unsigned int firstLayer, lastLayer;
+            if (newModel != NULL && !partialExchange(*newModel, firstLayer, lastLayer)) {
+                deleteModel(newModel);
                 newModel = NULL;
             }
             if (tempModel != NULL) {
@@ -1514,7 +2367,7 @@ void processModel() {
     }
     if (newModelState == ModelState_DONE_TRAINING && currentModel != NULL) {
         if (compareMetrics(currentModelMetrics, newModelMetrics)) {
-            delete currentModel;
+            deleteModel(currentModel);
             currentModel = newModel;
             newModel = NULL;
             newModelState = ModelState_IDLE;
@@ -1523,9 +2376,16 @@ void processModel() {
             }
             currentModelMetrics = newModelMetrics;
             newModelMetrics = NULL;
+            #ifdef DATASET_BINARY
+            // Inference between rounds runs on an int8 copy of the accepted model
+            if (QUANTIZED_MODEL) {
+                ModelConfig* config = federateState != FederateState_NONE && federateModelConfig != NULL ? federateModelConfig : localModelConfig;
+                quantizeCurrentModel(*config, XY_TRAIN_PATH, METADATA_JSON_PATH);
+            }
+            #endif
         }
         else {
-            delete newModel;
+            deleteModel(newModel);
             newModel = NULL;
             newModelState = ModelState_IDLE;
             if (newModelMetrics != NULL) {
@@ -1536,6 +2396,7 @@ void processModel() {
         if (federateState == FederateState_DONE) {
             sendModelToNetwork(*currentModel, *currentModelMetrics);
             federateState = FederateState_NONE;
+            sparseUplink.release();
             currentRound = -1;
             saveDeviceConfig();
         }
@@ -1596,17 +2457,14 @@ bool loadDeviceConfig() {
     deviceConfig->newModelState = static_cast<ModelState>(doc["modelState"] | ModelState_IDLE);
 
     deviceConfig->currentModelMetrics = new multiClassClassifierMetrics;
-    deviceConfig->currentModelMetrics->numberOfClasses = doc["metrics"]["numberOfClasses"] | 0;
+    deviceConfig->currentModelMetrics->begin(doc["metrics"]["numberOfClasses"] | 0, doc["metrics"]["confusion"].is<JsonArray>());
     deviceConfig->currentModelMetrics->epochs = doc["metrics"]["epochs"] | 0;
     deviceConfig->currentModelMetrics->meanSqrdError = doc["metrics"]["meanSqrdError"] | 0;
     deviceConfig->currentModelMetrics->trainingTime = doc["timings"]["training"] | 0;
     deviceConfig->currentModelMetrics->parsingTime = doc["timings"]["parsing"] | 0;
-    deviceConfig->currentModelMetrics->metrics = new classClassifierMetricts[deviceConfig->currentModelMetrics->numberOfClasses];
-    for (int i = 0; i < deviceConfig->currentModelMetrics->numberOfClasses; i++) {
-        deviceConfig->currentModelMetrics->metrics[i].truePositives = doc["metrics"]["truePositives"][i] | 0;
-        deviceConfig->currentModelMetrics->metrics[i].falsePositives = doc["metrics"]["falsePositives"][i] | 0;
-        deviceConfig->currentModelMetrics->metrics[i].trueNegatives = doc["metrics"]["trueNegatives"][i] | 0;
-        deviceConfig->currentModelMetrics->metrics[i].falseNegatives = doc["metrics"]["falseNegatives"][i] | 0;
+    // The per-class counts are derived from the matrix on the next summary()
+    if (deviceConfig->currentModelMetrics->confusion != nullptr && !readConfusion(doc["metrics"]["confusion"], *deviceConfig->currentModelMetrics)) {
+        D_println("Stored confusion matrix does not match the number of classes");
     }
     if (doc["federateModelConfig"].is<JsonObject>()) {
         JsonObject federateModelConfigObj = doc["federateModelConfig"];
@@ -1623,6 +2481,17 @@ bool loadDeviceConfig() {
                                                             federateModelConfigObj["learningRateOfBiases"].as<IDFLOAT>());
         deviceConfig->loadedFederateModelConfig->numberOfLayers = federateModelConfigObj["numberOfLayers"] | federateModelConfigObj["layers"].size() - 1;
         deviceConfig->loadedFederateModelConfig->epochs = federateModelConfigObj["epochs"] | 1;
+        deviceConfig->loadedFederateModelConfig->timeBudget = federateModelConfigObj["timeBudget"] | 0UL;
+        deviceConfig->loadedFederateModelConfig->maxRows = federateModelConfigObj["maxRows"] | 0UL;
+        deviceConfig->loadedFederateModelConfig->batchSize = federateModelConfigObj["batchSize"] | 1U;
+        deviceConfig->loadedFederateModelConfig->optimizer.type = optimizerFromName(federateModelConfigObj["optimizer"] | "sgd");
+        deviceConfig->loadedFederateModelConfig->optimizer.momentum = federateModelConfigObj["momentum"] | 0.9f;
+        deviceConfig->loadedFederateModelConfig->optimizer.beta1 = federateModelConfigObj["beta1"] | 0.9f;
+        deviceConfig->loadedFederateModelConfig->optimizer.beta2 = federateModelConfigObj["beta2"] | 0.999f;
+        deviceConfig->loadedFederateModelConfig->firstTrainableLayer = federateModelConfigObj["firstTrainableLayer"] | 0;
+        deviceConfig->loadedFederateModelConfig->lastTrainableLayer = federateModelConfigObj["lastTrainableLayer"] | -1;
+        deviceConfig->loadedFederateModelConfig->sparseUplink = federateModelConfigObj["sparseUplink"] | 0.0f;
+        deviceConfig->loadedFederateModelConfig->sparseThreshold = federateModelConfigObj["sparseThreshold"] | 0.0f;
     }
 
     if (false) {
@@ -1636,6 +2505,7 @@ bool loadDeviceConfig() {
         D_println("Mean squared error: " + String(deviceConfig->currentModelMetrics->meanSqrdError));
         D_println("Training time: " + String(deviceConfig->currentModelMetrics->trainingTime));
         D_println("Parsing time: " + String(deviceConfig->currentModelMetrics->parsingTime));
+        deviceConfig->currentModelMetrics->summary();
         for (int i = 0; i < deviceConfig->currentModelMetrics->numberOfClasses; i++) {
             D_println("Class " + String(i) + ": ");
             D_println("True positives: " + String(deviceConfig->currentModelMetrics->metrics[i].truePositives));
@@ -1664,11 +2534,8 @@ bool saveDeviceConfig() {
     doc["metrics"]["meanSqrdError"] = currentModelMetrics ? currentModelMetrics->meanSqrdError : 0;
     doc["metrics"]["trainingTime"] = currentModelMetrics ? currentModelMetrics->trainingTime : 0;
     doc["metrics"]["parsingTime"] = currentModelMetrics ? currentModelMetrics->parsingTime : 0;
-    for (int i = 0; i < (currentModelMetrics ? currentModelMetrics->numberOfClasses : 0); i++) {
-        doc["metrics"]["truePositives"][i] = currentModelMetrics->metrics[i].truePositives;
-        doc["metrics"]["falsePositives"][i] = currentModelMetrics->metrics[i].falsePositives;
-        doc["metrics"]["trueNegatives"][i] = currentModelMetrics->metrics[i].trueNegatives;
-        doc["metrics"]["falseNegatives"][i] = currentModelMetrics->metrics[i].falseNegatives;
+    if (currentModelMetrics != NULL && currentModelMetrics->confusion != NULL) {
+        writeConfusion(doc["metrics"]["confusion"].to<JsonArray>(), *currentModelMetrics);
     }
     if (federateModelConfig) {
         doc["federateModelConfig"] = JsonObject();
@@ -1684,6 +2551,17 @@ bool saveDeviceConfig() {
         doc["federateModelConfig"]["learningRateOfBiases"] = federateModelConfig->learningRateOfBiases;
         doc["federateModelConfig"]["numberOfLayers"] = federateModelConfig->numberOfLayers;
         doc["federateModelConfig"]["epochs"] = federateModelConfig->epochs;
+        doc["federateModelConfig"]["timeBudget"] = federateModelConfig->timeBudget;
+        doc["federateModelConfig"]["maxRows"] = federateModelConfig->maxRows;
+        doc["federateModelConfig"]["batchSize"] = federateModelConfig->batchSize;
+        doc["federateModelConfig"]["optimizer"] = optimizerName(federateModelConfig->optimizer.type);
+        doc["federateModelConfig"]["momentum"] = federateModelConfig->optimizer.momentum;
+        doc["federateModelConfig"]["beta1"] = federateModelConfig->optimizer.beta1;
+        doc["federateModelConfig"]["beta2"] = federateModelConfig->optimizer.beta2;
+        doc["federateModelConfig"]["firstTrainableLayer"] = federateModelConfig->firstTrainableLayer;
+        doc["federateModelConfig"]["lastTrainableLayer"] = federateModelConfig->lastTrainableLayer;
+        doc["federateModelConfig"]["sparseUplink"] = federateModelConfig->sparseUplink;
+        doc["federateModelConfig"]["sparseThreshold"] = federateModelConfig->sparseThreshold;
     }
 
     bool result = serializeJson(doc, configFile) > 0;
@@ -1702,7 +2580,8 @@ bool saveDeviceConfig() {
 /*
 void receiveModelFromNetwork() {
     File modelFile = LittleFS.open(NEW_MODEL_PATH, "w");
-    transformDataToModel(modelFile);
+    NeuralNetwork* NN = NULL;
+    transformDataToModel(modelFile, *localModelConfig, NN);
     modelFile.close();
 }
 
@@ -29,6 +29,20 @@
 #endif
 
 #include "Config.h"
+#include "DatasetFormat.h"
+#include "BatchTrainer.h"
+#include "QuantizedModel.h"
+#include "FlatModel.h"
+#include "PartialModel.h"
+#include "ModelJsonParser.h"
+#if defined(USE_FIXED_POINT)
+#include "FixedPoint.h"
+typedef FixedPointTrainer ModelTrainer;
+#define FIXED_POINT_TRAINING true // integer training replaces BackProp for every batch size
+#else
+typedef BatchTrainer ModelTrainer;
+#define FIXED_POINT_TRAINING false
+#endif
 
 /**
  * Defining the JSON structure for networking messaging
@@ -42,21 +56,8 @@
  */
 
 struct model {
-    IDFLOAT *biases;
-    IDFLOAT *weights;
     unsigned long parsingTime = 0;
-    int round;
-    
-    model() : biases(nullptr), weights(nullptr), round(-1) {}
-    
-    ~model() {
-        if (biases != nullptr) {
-            delete[] biases;
-        }
-        if (weights != nullptr) {
-            delete[] weights;
-        }
-    }
+    int round = -1;
 };
 
 struct classClassifierMetricts {
@@ -95,99 +96,96 @@ struct classClassifierMetricts {
     }
 };
 
+// Scores derived from the confusion matrix, macro averages weigh every class the same, weighted ones by support
+struct MetricsSummary {
+    DFLOAT accuracy = 0;
+    DFLOAT precision = 0;
+    DFLOAT recall = 0;
+    DFLOAT f1Score = 0;
+    DFLOAT weightedPrecision = 0;
+    DFLOAT weightedRecall = 0;
+    DFLOAT weightedF1Score = 0;
+};
+
 struct multiClassClassifierMetrics {
-    classClassifierMetricts* metrics;
-    unsigned int numberOfClasses;
-    DFLOAT meanSqrdError;
+    classClassifierMetricts* metrics = nullptr; // one-vs-rest counts, derived from confusion
+    unsigned int numberOfClasses = 0;
+    uint32_t* confusion = nullptr; // [actual][predicted] row counts, NULL for metrics loaded without one
+    DFLOAT meanSqrdError = 0; // mean over every trained row
+    double lossSum = 0;
+    unsigned long lossRows = 0;
     unsigned long parsingTime = 0;
     unsigned long trainingTime = 0;
     unsigned long epochs = 0;
-
-    DFLOAT totalPredictions() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].truePositives + metrics[i].falseNegatives;
-        }
-        return sum;
-    }
-
-    DFLOAT accuracy() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].accuracy();
+    unsigned long datasetBytesPerSecond = 0;
+    unsigned long datasetRowsPerSecond = 0;
+    bool budgetReached = false; // training stopped early on the time or row budget
+    unsigned int rollbacks = 0; // checkpoints restored after the error turned NaN/Inf
+    DFLOAT learningRateScale = 1; // learning rate factor left by the rollbacks
+
+    void begin(unsigned int classes, bool withConfusion = true) {
+        numberOfClasses = classes;
+        metrics = new classClassifierMetricts[classes];
+        if (withConfusion) {
+            confusion = new uint32_t[(size_t)classes * classes];
+            memset(confusion, 0, (size_t)classes * classes * sizeof(uint32_t));
         }
-        return sum / numberOfClasses;
+        dirty = true;
     }
 
-    DFLOAT precision() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].precision();
-        }
-        return sum / numberOfClasses;
+    void add(unsigned int actual, unsigned int predicted) {
+        confusion[actual * numberOfClasses + predicted]++;
+        dirty = true;
     }
 
-    DFLOAT recall() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].recall();
-        }
-        return sum / numberOfClasses;
+    // loss is the mean over rows
+    void addLoss(DFLOAT loss, unsigned int rows) {
+        lossSum += (double)loss * rows;
+        lossRows += rows;
+        dirty = true;
     }
 
-    DFLOAT f1Score() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].f1Score();
-        }
-        return sum / numberOfClasses;
+    // Derives the per-class counts and scores, later calls reuse them until a row is added
+    const MetricsSummary& summary() {
+        if (dirty) finalize();
+        return scores;
     }
 
-    DFLOAT balancedAccuracy() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].accuracy() * (metrics[i].totalPredictions() / totalPredictions());
-        }
-        return sum;
-    }
-
-    DFLOAT balancedPrecision() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].precision() * (metrics[i].totalPredictions() / totalPredictions());
-        }
-        return sum;
-    }
-
-    DFLOAT balancedRecall() {
-        DFLOAT sum = 0;
-        for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].recall() * (metrics[i].totalPredictions() / totalPredictions());
-        }
-        return sum;
-    }
-
-    DFLOAT balancedF1Score() {
+    DFLOAT totalPredictions() {
         DFLOAT sum = 0;
         for (unsigned int i = 0; i < numberOfClasses; i++) {
-            sum += metrics[i].f1Score() * (metrics[i].totalPredictions() / (float) totalPredictions());
+            sum += metrics[i].truePositives + metrics[i].falseNegatives;
         }
         return sum;
     }
 
+    DFLOAT accuracy() { return summary().accuracy; }
+    DFLOAT precision() { return summary().precision; }
+    DFLOAT recall() { return summary().recall; }
+    DFLOAT f1Score() { return summary().f1Score; }
+    DFLOAT weightedPrecision() { return summary().weightedPrecision; }
+    DFLOAT weightedRecall() { return summary().weightedRecall; }
+    DFLOAT weightedF1Score() { return summary().weightedF1Score; }
 
     void print() {
+        summary();
         Serial.println("Metrics:");
         Serial.print("Mean Squared Error: ");
         Serial.println(meanSqrdError);
         Serial.print("Accuracy: ");
         Serial.println(accuracy());
-        Serial.print("Precision: ");
-        Serial.println(precision());
-        Serial.print("Recall: ");
-        Serial.println(recall());
-        Serial.print("F1 Score: ");
-        Serial.println(f1Score());
+        Serial.print("Precision (macro / weighted): ");
+        Serial.print(precision());
+        Serial.print(" / ");
+        Serial.println(weightedPrecision());
+        Serial.print("Recall (macro / weighted): ");
+        Serial.print(recall());
+        Serial.print(" / ");
+        Serial.println(weightedRecall());
+        Serial.print("F1 Score (macro / weighted): ");
+        Serial.print(f1Score());
+        Serial.print(" / ");
+        Serial.println(weightedF1Score());
         Serial.println("Class Metrics:");
         for (unsigned int i = 0; i < numberOfClasses; i++) {
             Serial.print("Class ");
@@ -210,11 +208,72 @@ struct multiClassClassifierMetrics {
             Serial.print("F1 Score: ");
             Serial.println(metrics[i].f1Score());
         }
+        if (confusion != nullptr) {
+            Serial.println("Confusion matrix (rows actual, columns predicted):");
+            for (unsigned int i = 0; i < numberOfClasses; i++) {
+                for (unsigned int j = 0; j < numberOfClasses; j++) {
+                    Serial.print(confusion[i * numberOfClasses + j]);
+                    Serial.print(j + 1 < numberOfClasses ? " " : "\n");
+                }
+            }
+        }
     }
 
     ~multiClassClassifierMetrics() {
         delete[] metrics;
+        delete[] confusion;
     }
+
+private:
+    void finalize() {
+        if (confusion != nullptr) {
+            unsigned long total = 0;
+            for (size_t k = 0; k < (size_t)numberOfClasses * numberOfClasses; k++) total += confusion[k];
+            for (unsigned int c = 0; c < numberOfClasses; c++) {
+                unsigned long actual = 0, predicted = 0;
+                for (unsigned int k = 0; k < numberOfClasses; k++) {
+                    actual += confusion[c * numberOfClasses + k];
+                    predicted += confusion[k * numberOfClasses + c];
+                }
+                classClassifierMetricts& m = metrics[c];
+                m.truePositives = confusion[c * numberOfClasses + c];
+                m.falseNegatives = actual - m.truePositives;
+                m.falsePositives = predicted - m.truePositives;
+                m.trueNegatives = total - actual - m.falsePositives;
+            }
+        }
+        if (lossRows > 0) meanSqrdError = lossSum / lossRows;
+
+        scores = MetricsSummary();
+        DFLOAT correct = 0, total = totalPredictions();
+        for (unsigned int c = 0; c < numberOfClasses; c++) {
+            classClassifierMetricts& m = metrics[c];
+            DFLOAT support = m.truePositives + m.falseNegatives;
+            DFLOAT precision = m.precision(), recall = m.recall(), f1Score = m.f1Score();
+            correct += m.truePositives;
+            scores.precision += precision;
+            scores.recall += recall;
+            scores.f1Score += f1Score;
+            scores.weightedPrecision += precision * support;
+            scores.weightedRecall += recall * support;
+            scores.weightedF1Score += f1Score * support;
+        }
+        if (numberOfClasses > 0) {
+            scores.precision /= numberOfClasses;
+            scores.recall /= numberOfClasses;
+            scores.f1Score /= numberOfClasses;
+        }
+        if (total > 0) {
+            scores.accuracy = correct / total;
+            scores.weightedPrecision /= total;
+            scores.weightedRecall /= total;
+            scores.weightedF1Score /= total;
+        }
+        dirty = false;
+    }
+
+    MetricsSummary scores;
+    bool dirty = true;
 };
 
 struct testData {
@@ -249,6 +308,8 @@ enum FederateCommand {
     FederateCommand_LEAVE,
     FederateCommand_RESUME,
     FederateCommand_ALIVE,
+    FederateCommand_REQUEST_MODEL,
+    FederateCommand_RECEIVED,
 };
 
 struct FixedMemoryUsage {
@@ -268,6 +329,21 @@ struct RoundMemoryUsage {
     size_t minimumFree;
 };
 
+// Int8 copy of the accepted model against the float one, on XY_TEST_PATH or else on training rows (training-set accuracy)
+struct QuantizationReport {
+    bool heldOut;
+    unsigned long rows;
+    unsigned long floatCorrect;
+    unsigned long quantizedCorrect;
+    float floatMicros;
+    float quantizedMicros;
+    size_t floatBytes;
+    size_t quantizedBytes;
+
+    float floatAccuracy() const { return rows == 0 ? 0 : (float)floatCorrect / rows; }
+    float quantizedAccuracy() const { return rows == 0 ? 0 : (float)quantizedCorrect / rows; }
+};
+
 struct ModelConfig {
     unsigned int* layers;
     unsigned int numberOfLayers;
@@ -277,6 +353,14 @@ struct ModelConfig {
     DFLOAT learningRateOfBiases = 0.0666;
     unsigned long randomSeed = 10;
     bool jsonWeights = false;
+    unsigned long timeBudget = 0; // ms of training per round, 0 for no limit
+    unsigned long maxRows = 0; // rows trained per round (over all epochs), 0 for no limit
+    unsigned int batchSize = 1; // rows per weight update, 1 keeps the per-row BackProp
+    OptimizerSettings optimizer; // anything but SGD trains through the batch trainer
+    int firstTrainableLayer = 0; // first layer trained and exchanged, the ones before it stay frozen
+    int lastTrainableLayer = -1; // last one (inclusive), -1 for the output layer
+    float sparseUplink = 0; // fraction of the parameters uploaded as top-k deltas against the received model, 0 uploads the whole model
+    float sparseThreshold = 0; // smallest delta uploaded, alone or together with sparseUplink
 
     ModelConfig(unsigned int* layers, unsigned int numberOfLayers, byte* actvFunctions, unsigned int epochs = 1, unsigned long randomSeed = 10, DFLOAT learningRateOfWeights = 0.3333f, DFLOAT learningRateOfBiases = 0.0666f, bool jsonWeights = false)
         : layers(layers), numberOfLayers(numberOfLayers), actvFunctions(actvFunctions), epochs(epochs), randomSeed(randomSeed), learningRateOfWeights(learningRateOfWeights), learningRateOfBiases(learningRateOfBiases), jsonWeights(jsonWeights) {}
@@ -308,6 +392,15 @@ ModelState newModelState = ModelState_IDLE;
 FederateState federateState = FederateState_NONE;
 NeuralNetwork* newModel = NULL;
 NeuralNetwork* currentModel = NULL;
+NeuralNetwork* globalBase = NULL; // newModel while its frozen layers are those of the last global model received
+// Networks whose parameters live in a FlatModel block, see createModel/flattenModel
+struct FlatModelSlot {
+    NeuralNetwork* network;
+    FlatModel* storage;
+};
+FlatModelSlot flatModelSlots[FLAT_MODEL_SLOTS] = {};
+QuantizedModel* currentQuantizedModel = NULL;
+QuantizationReport quantizationReport = {};
 multiClassClassifierMetrics* currentModelMetrics = NULL;
 multiClassClassifierMetrics* newModelMetrics = NULL;
 DeviceConfig* deviceConfig = NULL;
@@ -326,25 +419,59 @@ void bootUp(bool initBaseModel = true);
 bool saveModelToFlash(NeuralNetwork& NN, const String file);
 
 NeuralNetwork* loadModelFromFlash(const String& file);
-
-model* transformDataToModel(Stream& stream);
+// New network for config, in one block with FLAT_MODEL_STORAGE
+NeuralNetwork* createModel(const ModelConfig& config);
+// Moves a row-allocated network into one block and deletes it, returns NN itself when it cannot
+NeuralNetwork* flattenModel(NeuralNetwork* NN, const ModelConfig& config);
+// Block holding NN's parameters, NULL for row-allocated networks
+FlatModel* getFlatModel(const NeuralNetwork* NN);
+// Deletes NN and its block, use instead of delete for every model
+void deleteModel(NeuralNetwork* NN);
+
+// Parses a JSON model message straight into NN, a network of config's topology (partial models over the frozen layers of last round), NULL on error
+model* transformDataToModel(Stream& stream, const ModelConfig& config, NeuralNetwork*& NN);
+// Reads a raw model message into newModel, straight from the stream when it is in PartialModel format and fits in RAM, else staged in flash
+bool receiveRawModel(Stream& stream, const ModelConfig& config);
 
 multiClassClassifierMetrics* trainModelFromOriginalDataset(NeuralNetwork& NN, ModelConfig& config, const String& x_file, const String& y_file);
-// Train directly from binary dataset using metadata.json schema (no CSV, streaming)
+// True once the round's time or row budget from federate_start is used up
+bool trainingBudgetReached(const ModelConfig& config, unsigned long startTime, unsigned long rows);
+// Layers config trains and exchanges (inclusive), false when that is the whole network
+bool partialLayerRange(const ModelConfig& config, unsigned int& first, unsigned int& last);
+// Mini-batch trainer over NN's own weights for config.batchSize rows, NULL when the batch buffers do not fit
+ModelTrainer* createBatchTrainer(NeuralNetwork& NN, const ModelConfig& config);
+// Views over NN's layers with the activations of config, delete[] when done
+TrainLayer* describeLayers(NeuralNetwork& NN, const ModelConfig& config);
+// One update over the rows queued in trainer, counts them into metrics; false when the error diverged
+bool trainBatch(NeuralNetwork& NN, ModelTrainer& trainer, unsigned int count, multiClassClassifierMetrics* metrics);
+// Copy the LittleFS binary dataset into the raw dataset partition (no-op if already staged)
+bool stageDatasetPartition();
+// Decode plan from the metadata.json schema of a legacy xy_train.bin
+bool loadDatasetPlanFromMetadata(const String& meta_file, unsigned int numberOfInputs, DecodePlan& plan);
+// Decode plan from the header of a v2 container, read from the mapping when given and from binF otherwise
+bool loadDatasetPlanFromV2(const uint8_t* mapped, size_t mappedBytes, File& binF, unsigned int numberOfInputs, DecodePlan& plan, DatasetV2Header& header);
+// Int8 copy of currentModel calibrated on QUANTIZED_CALIBRATION_ROWS shuffled rows, compared with it on the next QUANTIZED_EVALUATION_ROWS
+bool quantizeCurrentModel(const ModelConfig& config, const String& bin_file, const String& meta_file);
+// Train directly from a binary dataset, either a v2 container or a raw file described by metadata.json (no CSV, streaming)
 multiClassClassifierMetrics* trainModelFromBinaryDataset(NeuralNetwork& NN, ModelConfig& config, const String& bin_file, const String& meta_file);
 
-void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics);
+// roundUpload for the model trained in a federated round, the only one that may go out as a sparse delta
+void sendModelToNetwork(NeuralNetwork& NN, multiClassClassifierMetrics& metrics, bool roundUpload = false);
 
 void sendMessageToNetwork(FederateCommand command);
 
 void processMessages();
 
+// Drops the int8 copy, call whenever currentModel changes outside processModel
+void releaseQuantizedModel();
 DFLOAT* predictFromCurrentModel(DFLOAT* x);
 
 testData* readTestData(ModelConfig modelConfig);
 
-// Convert binary dataset into X and Y CSV files on LittleFS using metadata.json schema
+// Convert binary dataset (v2, or raw with its metadata.json schema) into X and Y CSV files on LittleFS
 bool convertBinaryToXY(const char* binPath, const char* metaPath, const char* xOutPath, const char* yOutPath);
+// Repack an X / Y CSV pair on LittleFS into a v2 binary dataset
+bool convertXYToBinary(const char* xPath, const char* yPath, const char* outPath);
 
 void setupMQTT(bool resume = false);
 
@@ -0,0 +1,182 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+/**
+ * Per-parameter optimizer state for BatchTrainer updates.
+ *
+ * Plain SGD keeps no state. Momentum and Nesterov keep one velocity per
+ * parameter, and Adam keeps first and second moments. All of it lives in one
+ * arena laid out in FlatModel order (the weights of every layer, then the
+ * biases). With reduced precision each value is stored as bfloat16 (the upper
+ * half of a float). That halves the arena and keeps the float exponent range,
+ * so Adam's small second moments do not underflow as they would in IEEE half.
+ * The arithmetic is always done in float.
+ *
+ * update() is called once per weight row with the summed batch gradient.
+ * Rows are independent, so the two halves of a split layer can update their
+ * own rows in parallel.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same order as the "optimizer" names accepted by federate_start
+enum OptimizerType : uint8_t {
+    Optimizer_SGD,
+    Optimizer_MOMENTUM,
+    Optimizer_NESTEROV,
+    Optimizer_ADAM,
+};
+
+#define OPTIMIZER_EPSILON 1e-7f
+
+struct OptimizerSettings {
+    uint8_t type = Optimizer_SGD;
+    float momentum = 0.9f; // velocity decay for momentum and Nesterov
+    float beta1 = 0.9f;    // Adam first moment decay
+    float beta2 = 0.999f;  // Adam second moment decay
+};
+
+inline const char* optimizerName(uint8_t type) {
+    switch (type) {
+        case Optimizer_MOMENTUM: return "momentum";
+        case Optimizer_NESTEROV: return "nesterov";
+        case Optimizer_ADAM: return "adam";
+        default: return "sgd";
+    }
+}
+
+inline uint8_t optimizerFromName(const char* name) {
+    if (name == nullptr) return Optimizer_SGD;
+    for (uint8_t t = Optimizer_MOMENTUM; t <= Optimizer_ADAM; t++) {
+        if (strcmp(name, optimizerName(t)) == 0) return t;
+    }
+    return Optimizer_SGD;
+}
+
+class OptimizerState {
+public:
+    OptimizerState() {}
+    ~OptimizerState() { free(arena); }
+
+    // Values kept per parameter by type
+    static unsigned int slotsPerParameter(uint8_t type) {
+        return type == Optimizer_ADAM ? 2 : (type == Optimizer_SGD ? 0 : 1);
+    }
+
+    static size_t bytesFor(uint8_t type, size_t parameters, bool reduced) {
+        return parameters * slotsPerParameter(type) * (reduced ? sizeof(uint16_t) : sizeof(float));
+    }
+
+    // Allocates zeroed state for parameters values, false when it does not fit
+    bool begin(const OptimizerSettings& settings, size_t parameters, bool reduced) {
+        free(arena);
+        arena = nullptr;
+        this->settings = settings;
+        this->parameters = parameters;
+        this->reduced = reduced;
+        bytes = bytesFor(settings.type, parameters, reduced);
+        if (bytes > 0) {
+            arena = malloc(bytes);
+            if (arena == nullptr) {
+                this->settings.type = Optimizer_SGD;
+                bytes = 0;
+                return false;
+            }
+        }
+        reset();
+        return true;
+    }
+
+    // Forgets the accumulated state, for when the weights were replaced
+    void reset() {
+        if (arena != nullptr) memset(arena, 0, bytes);
+        steps = 0;
+    }
+
+    bool isActive() const { return settings.type != Optimizer_SGD; }
+    uint8_t getType() const { return settings.type; }
+    bool isReduced() const { return reduced; }
+    size_t getBytes() const { return bytes; }
+
+    // Once per batch, before the rows are updated
+    void step() {
+        steps++;
+        if (settings.type == Optimizer_ADAM) {
+            correction1 = 1.0f / (1.0f - powf(settings.beta1, (float)steps));
+            correction2 = 1.0f / (1.0f - powf(settings.beta2, (float)steps));
+        }
+    }
+
+    // p[k] -= learningRate * direction for n parameters starting at offset, the gradient is scaled by gradientScale first
+    template <typename T>
+    void update(size_t offset, T* p, const T* gradient, unsigned int n, float gradientScale, float learningRate) {
+        switch (settings.type) {
+            case Optimizer_MOMENTUM:
+            case Optimizer_NESTEROV: {
+                bool nesterov = settings.type == Optimizer_NESTEROV;
+                float mu = settings.momentum;
+                for (unsigned int k = 0; k < n; k++) {
+                    float g = gradient[k] * gradientScale;
+                    float v = mu * load(offset + k) + g;
+                    store(offset + k, v);
+                    p[k] -= learningRate * (nesterov ? g + mu * v : v);
+                }
+                break;
+            }
+            case Optimizer_ADAM: {
+                float b1 = settings.beta1, b2 = settings.beta2;
+                size_t second = parameters;
+                for (unsigned int k = 0; k < n; k++) {
+                    float g = gradient[k] * gradientScale;
+                    float m = b1 * load(offset + k) + (1 - b1) * g;
+                    float v = b2 * load(second + offset + k) + (1 - b2) * g * g;
+                    store(offset + k, m);
+                    store(second + offset + k, v);
+                    p[k] -= learningRate * (m * correction1) / (sqrtf(v * correction2) + OPTIMIZER_EPSILON);
+                }
+                break;
+            }
+            default:
+                for (unsigned int k = 0; k < n; k++) p[k] -= learningRate * gradientScale * gradient[k];
+                break;
+        }
+    }
+
+    OptimizerState(const OptimizerState&) = delete;
+    OptimizerState& operator=(const OptimizerState&) = delete;
+
+private:
+    float load(size_t k) const {
+        if (!reduced) return ((const float*)arena)[k];
+        uint32_t bits = (uint32_t)((const uint16_t*)arena)[k] << 16;
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    void store(size_t k, float v) {
+        if (!reduced) {
+            ((float*)arena)[k] = v;
+            return;
+        }
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        // Round to nearest even on the dropped half
+        bits += 0x7FFF + ((bits >> 16) & 1);
+        ((uint16_t*)arena)[k] = (uint16_t)(bits >> 16);
+    }
+
+    OptimizerSettings settings;
+    void* arena = nullptr;
+    size_t parameters = 0;
+    size_t bytes = 0;
+    bool reduced = false;
+    unsigned long steps = 0;
+    float correction1 = 1;
+    float correction2 = 1;
+};
+
+#endif /* OPTIMIZER_H_ */
@@ -0,0 +1,111 @@
+#ifndef PARTIALMODEL_H_
+#define PARTIALMODEL_H_
+
+/**
+ * Raw encoding of a contiguous range of layers, for fine-tuning rounds where
+ * only some layers are trained and exchanged.
+ *
+ * A PartialModelHeader is followed by the weights of layers first..last
+ * ([layer][output][input]) and then their biases. That is the FlatModel order
+ * restricted to the range, so both parts are one slice each of a flat model.
+ * The values are raw IDFLOAT in the device's byte order, like NN.save(). The
+ * magic tells a partial payload apart from a full NN.save() one on the same
+ * topic. The frozen layers are not sent. The receiver keeps its own copy of
+ * them and writes the received values over the range. A range over every
+ * layer is a whole model, which the raw receive decodes straight from the
+ * MQTT stream without needing a local copy.
+ *
+ * Out needs write(const uint8_t*, size_t) (Print, File, a publish) and In
+ * needs readBytes(char*, size_t) (Stream, File).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "BatchTrainer.h"
+
+#define PARTIAL_MODEL_MAGIC 0x4C525046UL // "FPRL" read little-endian
+
+struct PartialModelHeader {
+    uint32_t magic;
+    uint8_t valueBytes;     // sizeof(IDFLOAT) of the sender
+    uint8_t numberOfLayers; // of the whole network
+    uint8_t firstLayer;
+    uint8_t lastLayer;      // inclusive
+    uint32_t weightCount;
+    uint32_t biasCount;
+};
+
+inline size_t partialWeightCount(const TrainLayer* layers, unsigned int first, unsigned int last) {
+    size_t n = 0;
+    for (unsigned int l = first; l <= last; l++) n += (size_t)layers[l].outputs * layers[l].inputs;
+    return n;
+}
+
+inline size_t partialBiasCount(const TrainLayer* layers, unsigned int first, unsigned int last) {
+    size_t n = 0;
+    for (unsigned int l = first; l <= last; l++) n += layers[l].outputs;
+    return n;
+}
+
+inline PartialModelHeader describePartialModel(const TrainLayer* layers, unsigned int numberOfLayers, unsigned int first, unsigned int last) {
+    PartialModelHeader header;
+    header.magic = PARTIAL_MODEL_MAGIC;
+    header.valueBytes = sizeof(IDFLOAT);
+    header.numberOfLayers = numberOfLayers;
+    header.firstLayer = first;
+    header.lastLayer = last;
+    header.weightCount = partialWeightCount(layers, first, last);
+    header.biasCount = partialBiasCount(layers, first, last);
+    return header;
+}
+
+// Payload bytes for the range, header included
+inline size_t partialModelBytes(const TrainLayer* layers, unsigned int first, unsigned int last) {
+    return sizeof(PartialModelHeader) + (partialWeightCount(layers, first, last) + partialBiasCount(layers, first, last)) * sizeof(IDFLOAT);
+}
+
+// True when header describes a range of layers, with this build's precision and matching counts
+inline bool partialModelMatches(const PartialModelHeader& header, const TrainLayer* layers, unsigned int numberOfLayers) {
+    return header.magic == PARTIAL_MODEL_MAGIC && header.valueBytes == sizeof(IDFLOAT) && header.numberOfLayers == numberOfLayers &&
+           header.firstLayer <= header.lastLayer && header.lastLayer < numberOfLayers &&
+           header.weightCount == partialWeightCount(layers, header.firstLayer, header.lastLayer) &&
+           header.biasCount == partialBiasCount(layers, header.firstLayer, header.lastLayer);
+}
+
+template <typename Out>
+size_t writePartialModel(Out& out, const TrainLayer* layers, unsigned int numberOfLayers, unsigned int first, unsigned int last) {
+    PartialModelHeader header = describePartialModel(layers, numberOfLayers, first, last);
+    size_t written = out.write((const uint8_t*)&header, sizeof(header));
+    for (unsigned int l = first; l <= last; l++) {
+        for (unsigned int i = 0; i < layers[l].outputs; i++) written += out.write((const uint8_t*)layers[l].weights[i], layers[l].inputs * sizeof(IDFLOAT));
+    }
+    for (unsigned int l = first; l <= last; l++) written += out.write((const uint8_t*)layers[l].bias, layers[l].outputs * sizeof(IDFLOAT));
+    return written;
+}
+
+// Reads the values that follow an already read and checked header into the range
+template <typename In>
+bool readPartialModel(In& in, const PartialModelHeader& header, const TrainLayer* layers) {
+    for (unsigned int l = header.firstLayer; l <= header.lastLayer; l++) {
+        for (unsigned int i = 0; i < layers[l].outputs; i++) {
+            size_t bytes = layers[l].inputs * sizeof(IDFLOAT);
+            if (in.readBytes((char*)layers[l].weights[i], bytes) != bytes) return false;
+        }
+    }
+    for (unsigned int l = header.firstLayer; l <= header.lastLayer; l++) {
+        size_t bytes = layers[l].outputs * sizeof(IDFLOAT);
+        if (in.readBytes((char*)layers[l].bias, bytes) != bytes) return false;
+    }
+    return true;
+}
+
+// Copies layers first..last from one network to another of the same topology
+inline void copyPartialModel(const TrainLayer* to, const TrainLayer* from, unsigned int first, unsigned int last) {
+    for (unsigned int l = first; l <= last; l++) {
+        for (unsigned int i = 0; i < to[l].outputs; i++) memcpy(to[l].weights[i], from[l].weights[i], to[l].inputs * sizeof(IDFLOAT));
+        memcpy(to[l].bias, from[l].bias, to[l].outputs * sizeof(IDFLOAT));
+    }
+}
+
+#endif /* PARTIALMODEL_H_ */
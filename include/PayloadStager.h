@@ -0,0 +1,138 @@
+#ifndef PAYLOADSTAGER_H_
+#define PAYLOADSTAGER_H_
+
+/**
+ * Copies an incoming MQTT payload to a file in whole filesystem blocks.
+ *
+ * Staging a raw model with file.write(stream.read()) costs one VFS call per
+ * byte. PayloadStager reads the stream into one block-sized buffer and writes
+ * it out only when it is full, so every write but the last covers a whole
+ * block at a block-aligned offset. It computes the CRC-32 of the payload as
+ * the bytes arrive and times the copy. CrcReader computes the same CRC for a
+ * payload decoded straight from the stream.
+ *
+ * In needs available() and readBytes(char*, size_t) (Stream), Out needs
+ * write(const uint8_t*, size_t) (File). Both run on the host as well
+ * (examples/host_bench_staging.cpp).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DatasetReader.h"
+
+#if defined(ARDUINO)
+#include <esp_rom_crc.h>
+#endif
+
+// CRC-32 (IEEE 802.3), start with 0 and feed the running value back in
+inline uint32_t payloadCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+#if defined(ARDUINO)
+    return esp_rom_crc32_le(crc, data, length);
+#else
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+#endif
+}
+
+struct PayloadStageStats {
+    size_t bytes = 0;
+    unsigned int writes = 0;
+    uint32_t crc = 0;
+    unsigned long micros = 0;
+
+    unsigned long bytesPerSecond() const {
+        return micros == 0 ? 0 : (unsigned long)((unsigned long long)bytes * 1000000ULL / micros);
+    }
+};
+
+// Reader over in that keeps the CRC-32 of the bytes passing through, for payloads decoded without staging
+template <typename In>
+class CrcReader {
+public:
+    // crc of the bytes already taken from in
+    CrcReader(In& in, uint32_t crc, size_t bytes) : in(in), crc(crc), bytes(bytes) {}
+
+    int available() { return in.available(); }
+
+    size_t readBytes(char* out, size_t length) {
+        size_t got = in.readBytes(out, length);
+        crc = payloadCrc32(crc, (const uint8_t*)out, got);
+        bytes += got;
+        return got;
+    }
+
+    uint32_t getCrc() const { return crc; }
+    size_t getBytes() const { return bytes; }
+
+private:
+    In& in;
+    uint32_t crc;
+    size_t bytes;
+};
+
+class PayloadStager {
+public:
+    explicit PayloadStager(size_t blockSize) : blockSize(blockSize) {}
+
+    ~PayloadStager() { free(buffer); }
+
+    // Copies prefix (bytes already taken from in, at most one block) and then the rest of in to out
+    template <typename In, typename Out>
+    bool stage(In& in, Out& out, const uint8_t* prefix = nullptr, size_t prefixBytes = 0) {
+        stats = PayloadStageStats();
+        if (buffer == nullptr) buffer = (uint8_t*)malloc(blockSize);
+        if (buffer == nullptr || prefixBytes > blockSize) return false;
+        unsigned long start = readerMicros();
+        size_t fill = prefixBytes;
+        if (prefixBytes > 0) {
+            memcpy(buffer, prefix, prefixBytes);
+            stats.crc = payloadCrc32(stats.crc, buffer, prefixBytes);
+        }
+        size_t want;
+        while ((want = in.available()) > 0) {
+            if (want > blockSize - fill) want = blockSize - fill;
+            size_t got = in.readBytes((char*)buffer + fill, want);
+            if (got == 0) break;
+            stats.crc = payloadCrc32(stats.crc, buffer + fill, got);
+            fill += got;
+            if (fill == blockSize) {
+                if (!flush(out, fill)) return false;
+                fill = 0;
+            }
+        }
+        if (fill > 0 && !flush(out, fill)) return false;
+        stats.micros = readerMicros() - start;
+        return true;
+    }
+
+    const PayloadStageStats& getStats() const { return stats; }
+
+    PayloadStager(const PayloadStager&) = delete;
+    PayloadStager& operator=(const PayloadStager&) = delete;
+
+private:
+    template <typename Out>
+    bool flush(Out& out, size_t length) {
+        if (out.write(buffer, length) != length) return false;
+        stats.bytes += length;
+        stats.writes++;
+        return true;
+    }
+
+    size_t blockSize;
+    uint8_t* buffer = nullptr;
+    PayloadStageStats stats;
+};
+
+#endif /* PAYLOADSTAGER_H_ */
@@ -0,0 +1,196 @@
+#ifndef QUANTIZEDMODEL_H_
+#define QUANTIZEDMODEL_H_
+
+/**
+ * Post-training int8 copy of a float network for inference.
+ *
+ * Weights are quantized symmetrically with one scale per layer. Each layer's
+ * input gets its own scale as well, calibrated from the largest |activation|
+ * seen while running calibration rows through the float network. Inference
+ * multiplies int8 by int8 into int32 accumulators, so a 144-input neuron cannot
+ * overflow. Each neuron is rescaled once to apply the activation, and the
+ * result is requantized for the next layer. The float network is only read
+ * while calibrating and quantizing. After quantize() the copy stands on its own.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTrainer.h"
+
+#ifndef DFLOAT
+#define DFLOAT float
+#endif
+
+struct QuantizedLayer {
+    int8_t* weights; // [outputs][inputs], row-major
+    int32_t* bias;   // in steps of outputScale
+    unsigned int inputs;
+    unsigned int outputs;
+    uint8_t activation;
+    float inputScale;  // real value of one input step
+    float outputScale; // weight scale * input scale, real value of one accumulator step
+};
+
+class QuantizedModel {
+public:
+    QuantizedModel(const TrainLayer* layers, unsigned int numberOfLayers) : numberOfLayers(numberOfLayers) {
+        source = new TrainLayer[numberOfLayers];
+        memcpy(source, layers, numberOfLayers * sizeof(TrainLayer));
+        this->layers = new QuantizedLayer[numberOfLayers];
+        inputRange = new float[numberOfLayers];
+        size_t weights = 0, biases = 0;
+        maxWidth = layers[0].inputs;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            weights += (size_t)layers[l].inputs * layers[l].outputs;
+            biases += layers[l].outputs;
+            if (layers[l].outputs > maxWidth) maxWidth = layers[l].outputs;
+            inputRange[l] = 0;
+        }
+        weightArena = (int8_t*)malloc(weights);
+        biasArena = (int32_t*)malloc(biases * sizeof(int32_t));
+        quantizedInputs = (int8_t*)malloc(maxWidth);
+        values = (DFLOAT*)malloc(2 * (size_t)maxWidth * sizeof(DFLOAT));
+        if (!isValid()) return;
+
+        int8_t* w = weightArena;
+        int32_t* b = biasArena;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            QuantizedLayer& q = this->layers[l];
+            q.weights = w;
+            q.bias = b;
+            q.inputs = layers[l].inputs;
+            q.outputs = layers[l].outputs;
+            q.activation = layers[l].activation;
+            q.inputScale = q.outputScale = 0;
+            w += (size_t)q.inputs * q.outputs;
+            b += q.outputs;
+        }
+    }
+
+    ~QuantizedModel() {
+        free(weightArena);
+        free(biasArena);
+        free(quantizedInputs);
+        free(values);
+        delete[] inputRange;
+        delete[] layers;
+        delete[] source;
+    }
+
+    bool isValid() const { return weightArena != nullptr && biasArena != nullptr && quantizedInputs != nullptr && values != nullptr; }
+
+    // Runs one row through the float network and widens each layer's input range
+    void calibrate(const DFLOAT* x) {
+        DFLOAT* in = values;
+        DFLOAT* out = values + maxWidth;
+        memcpy(in, x, source[0].inputs * sizeof(DFLOAT));
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = source[l];
+            for (unsigned int j = 0; j < layer.inputs; j++) {
+                float v = fabsf((float)in[j]);
+                if (v > inputRange[l]) inputRange[l] = v;
+            }
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                DFLOAT z = layer.bias[i];
+                for (unsigned int j = 0; j < layer.inputs; j++) z += layer.weights[i][j] * in[j];
+                out[i] = z;
+            }
+            activateValues(layer.activation, out, layer.outputs);
+            DFLOAT* t = in;
+            in = out;
+            out = t;
+        }
+        calibrationRows++;
+    }
+
+    // Builds the int8 weights from the float network and the calibrated ranges
+    bool quantize() {
+        if (calibrationRows == 0) return false;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = source[l];
+            QuantizedLayer& q = layers[l];
+            float largest = 0;
+            for (unsigned int i = 0; i < layer.outputs; i++)
+                for (unsigned int j = 0; j < layer.inputs; j++) largest = fmaxf(largest, fabsf((float)layer.weights[i][j]));
+            float weightScale = largest > 0 ? largest / 127.0f : 1.0f;
+            q.inputScale = inputRange[l] > 0 ? inputRange[l] / 127.0f : 1.0f;
+            q.outputScale = weightScale * q.inputScale;
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                int8_t* row = q.weights + (size_t)i * q.inputs;
+                for (unsigned int j = 0; j < layer.inputs; j++) row[j] = saturate8(lrintf((float)layer.weights[i][j] / weightScale));
+                q.bias[i] = (int32_t)lrintf((float)layer.bias[i] / q.outputScale);
+            }
+        }
+        quantized = true;
+        return true;
+    }
+
+    bool isQuantized() const { return quantized; }
+
+    // Network outputs for x, computed with int8 weights and int32 accumulators
+    DFLOAT* predict(const DFLOAT* x) {
+        int8_t* q = quantizedInputs;
+        DFLOAT* z = values;
+        quantizeValues(x, q, layers[0].inputs, layers[0].inputScale);
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const QuantizedLayer& layer = layers[l];
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                const int8_t* w = layer.weights + (size_t)i * layer.inputs;
+                int32_t acc = layer.bias[i];
+                for (unsigned int j = 0; j < layer.inputs; j++) acc += (int32_t)w[j] * q[j];
+                z[i] = acc * layer.outputScale;
+            }
+            activateValues(layer.activation, z, layer.outputs);
+            if (l + 1 < numberOfLayers) quantizeValues(z, q, layer.outputs, layers[l + 1].inputScale);
+        }
+        return z;
+    }
+
+    // Bytes held by the int8 model (weights, biases, scales, inference buffers)
+    size_t getBytes() const {
+        size_t weights = 0, biases = 0;
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            weights += (size_t)layers[l].inputs * layers[l].outputs;
+            biases += layers[l].outputs;
+        }
+        return weights + biases * sizeof(int32_t) + numberOfLayers * sizeof(QuantizedLayer) + maxWidth + 2 * (size_t)maxWidth * sizeof(DFLOAT);
+    }
+
+    // Bytes of the float weights and biases the model was built from
+    size_t getSourceBytes() const {
+        size_t n = 0;
+        for (unsigned int l = 0; l < numberOfLayers; l++) n += (size_t)source[l].outputs * (source[l].inputs + 1);
+        return n * sizeof(IDFLOAT);
+    }
+
+    unsigned long getCalibrationRows() const { return calibrationRows; }
+
+    QuantizedModel(const QuantizedModel&) = delete;
+    QuantizedModel& operator=(const QuantizedModel&) = delete;
+
+private:
+    static int8_t saturate8(long v) { return v > 127 ? 127 : (v < -127 ? -127 : (int8_t)v); }
+
+    static void quantizeValues(const DFLOAT* v, int8_t* q, unsigned int n, float scale) {
+        float inverse = 1.0f / scale;
+        for (unsigned int i = 0; i < n; i++) q[i] = saturate8(lrintf((float)v[i] * inverse));
+    }
+
+    static void activateValues(uint8_t activation, DFLOAT* v, unsigned int n) { BatchTrainer::activate(activation, v, n); }
+
+    TrainLayer* source;
+    QuantizedLayer* layers;
+    unsigned int numberOfLayers;
+    unsigned int maxWidth;
+    float* inputRange;
+    int8_t* weightArena = nullptr;
+    int32_t* biasArena = nullptr;
+    int8_t* quantizedInputs = nullptr;
+    DFLOAT* values = nullptr; // two layer-wide float buffers
+    unsigned long calibrationRows = 0;
+    bool quantized = false;
+};
+
+#endif /* QUANTIZEDMODEL_H_ */
@@ -0,0 +1,199 @@
+#ifndef SPARSEDELTA_H_
+#define SPARSEDELTA_H_
+
+/**
+ * Top-k weight deltas for the uplink, with error feedback.
+ *
+ * Most parameters barely move in one round of local training. Instead of the
+ * whole model the device can send the largest changes against the global
+ * model it received, as (index, value) pairs over the FlatModel order
+ * (weights of every layer, then biases). What is not sent is not lost. The
+ * encoder keeps it as a residual and adds it to the next round's change, so
+ * small but steady updates go out once they add up.
+ *
+ * A SparseDeltaHeader is followed by count entries of a uint32_t index and an
+ * IDFLOAT value, in increasing index order and in the device's byte order.
+ * The server adds the values to the global model it sent
+ * (applySparseDelta(), used by examples/host_bench_sparse.cpp). The magic
+ * tells the payload apart from NN.save() and PartialModel payloads on the
+ * raw push topic.
+ *
+ * The encoder holds two copies of the parameters (the global model and the
+ * residual). Selection needs no sorting or index buffer. It bisects the
+ * magnitude threshold that keeps at most k entries.
+ *
+ * Out needs write(const uint8_t*, size_t) and In readBytes(char*, size_t).
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef IDFLOAT
+#define IDFLOAT float
+#endif
+
+#define SPARSE_DELTA_MAGIC 0x544C4453UL // "SDLT" read little-endian
+#define SPARSE_DELTA_SEARCH_STEPS 32 // threshold bisection steps
+
+struct SparseDeltaHeader {
+    uint32_t magic;
+    uint8_t valueBytes; // sizeof(IDFLOAT) of the sender
+    uint8_t reserved[3];
+    uint32_t parameterCount; // of the whole model
+    uint32_t count;          // entries that follow
+};
+
+inline size_t sparseDeltaBytes(size_t count) {
+    return sizeof(SparseDeltaHeader) + count * (sizeof(uint32_t) + sizeof(IDFLOAT));
+}
+
+class SparseDeltaEncoder {
+public:
+    SparseDeltaEncoder() = default;
+    ~SparseDeltaEncoder() { release(); }
+
+    // Buffers for a model of parameterCount values, the residual starts at zero
+    bool begin(size_t parameterCount) {
+        if (parameterCount == count && global != nullptr) return true;
+        release();
+        global = (IDFLOAT*)malloc(parameterCount * sizeof(IDFLOAT));
+        residual = (IDFLOAT*)calloc(parameterCount, sizeof(IDFLOAT));
+        if (global == nullptr || residual == nullptr) {
+            release();
+            return false;
+        }
+        count = parameterCount;
+        return true;
+    }
+
+    void release() {
+        free(global);
+        free(residual);
+        global = nullptr;
+        residual = nullptr;
+        count = 0;
+        hasGlobal = false;
+    }
+
+    bool isValid() const { return global != nullptr; }
+    size_t getParameterCount() const { return count; }
+
+    // Forgets the residual, as when a new federation starts
+    void reset() {
+        if (residual != nullptr) memset(residual, 0, count * sizeof(IDFLOAT));
+        hasGlobal = false;
+    }
+
+    // Keeps the received global model the next delta is taken against
+    void setGlobal(const IDFLOAT* parameters) {
+        memcpy(global, parameters, count * sizeof(IDFLOAT));
+        hasGlobal = true;
+    }
+
+    bool hasGlobalModel() const { return hasGlobal; }
+
+    /**
+     * Adds trained - global to the residual and picks the entries to send:
+     * the (up to) k largest in magnitude, and only those of at least
+     * threshold. k 0 means no limit. Returns how many write() will send.
+     */
+    size_t select(const IDFLOAT* trained, size_t k, IDFLOAT threshold) {
+        IDFLOAT largest = 0;
+        for (size_t i = 0; i < count; i++) {
+            residual[i] += trained[i] - global[i];
+            IDFLOAT a = fabs(residual[i]);
+            if (a > largest) largest = a;
+        }
+        hasGlobal = false;
+        limit = k == 0 || k > count ? count : k;
+        cut = threshold > 0 ? threshold : FLT_MIN; // never send zeros
+        if (largest == 0 || largest < cut) {
+            selected = 0;
+            cut = largest + 1;
+            return 0;
+        }
+        size_t n = countAtLeast(cut);
+        if (n > limit) {
+            // Smallest cut with at most limit entries at or above it
+            IDFLOAT low = cut, high = largest;
+            for (int step = 0; step < SPARSE_DELTA_SEARCH_STEPS && low < high; step++) {
+                IDFLOAT middle = low + (high - low) / 2;
+                if (middle <= low || middle >= high) break;
+                if (countAtLeast(middle) > limit) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            cut = high;
+            n = countAtLeast(cut);
+        }
+        selected = n < limit ? n : limit;
+        return selected;
+    }
+
+    // Writes the selected entries and clears them from the residual, returns the bytes written
+    template <typename Out>
+    size_t write(Out& out) {
+        SparseDeltaHeader header = {SPARSE_DELTA_MAGIC, sizeof(IDFLOAT), {0, 0, 0}, (uint32_t)count, (uint32_t)selected};
+        size_t written = out.write((const uint8_t*)&header, sizeof(header));
+        size_t left = selected;
+        for (size_t i = 0; i < count && left > 0; i++) {
+            if (!(fabs(residual[i]) >= cut)) continue;
+            uint32_t index = i;
+            IDFLOAT value = residual[i];
+            written += out.write((const uint8_t*)&index, sizeof(index));
+            written += out.write((const uint8_t*)&value, sizeof(value));
+            residual[i] = 0;
+            left--;
+        }
+        return written;
+    }
+
+    // Sum of the magnitudes left for later rounds
+    double residualNorm() const {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++) sum += fabs(residual[i]);
+        return sum;
+    }
+
+    SparseDeltaEncoder(const SparseDeltaEncoder&) = delete;
+    SparseDeltaEncoder& operator=(const SparseDeltaEncoder&) = delete;
+
+private:
+    size_t countAtLeast(IDFLOAT value) const {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) n += fabs(residual[i]) >= value;
+        return n;
+    }
+
+    IDFLOAT* global = nullptr;
+    IDFLOAT* residual = nullptr;
+    size_t count = 0;
+    bool hasGlobal = false;
+    size_t limit = 0;
+    size_t selected = 0;
+    IDFLOAT cut = 0;
+};
+
+// Adds a sparse delta payload to parameters (parameterCount values), false when it does not match or ends early
+template <typename In>
+bool applySparseDelta(In& in, IDFLOAT* parameters, size_t parameterCount) {
+    SparseDeltaHeader header;
+    if (in.readBytes((char*)&header, sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != SPARSE_DELTA_MAGIC || header.valueBytes != sizeof(IDFLOAT) || header.parameterCount != parameterCount) return false;
+    for (uint32_t e = 0; e < header.count; e++) {
+        uint32_t index;
+        IDFLOAT value;
+        if (in.readBytes((char*)&index, sizeof(index)) != sizeof(index) || in.readBytes((char*)&value, sizeof(value)) != sizeof(value)) return false;
+        if (index >= parameterCount) return false;
+        parameters[index] += value;
+    }
+    return true;
+}
+
+#endif /* SPARSEDELTA_H_ */
@@ -0,0 +1,132 @@
+#ifndef STREAMFILE_H_
+#define STREAMFILE_H_
+
+/**
+ * Files over MQTT payloads, for the library's NN.save() layout.
+ *
+ * NeuralNetwork::load() reads that layout from a File and save() writes it
+ * to one. Handing them a File over the payload lets the device decode a
+ * received model as the bytes arrive, and publish one straight from RAM,
+ * without a copy in flash. The layout itself stays the library's business.
+ *
+ * streamFile() reads. The bytes already taken from the stream (the header
+ * receiveRawModel reads to tell the layouts apart) are served first.
+ * Reading only goes forward: a seek is refused unless it lands on the
+ * current position or stays inside those bytes, and load() then fails.
+ *
+ * sinkFile() writes everything to out. SizeCounter as out gives the size
+ * save() writes, which the publish has to announce before the first byte.
+ */
+
+#if defined(ARDUINO)
+
+#include <FS.h>
+#include <FSImpl.h>
+#include <memory>
+
+// A single file with nothing around it
+class PayloadFileImpl : public fs::FileImpl {
+public:
+    size_t position() const { return offset; }
+    void flush() {}
+    bool setBufferSize(size_t) { return false; }
+    void close() {}
+    time_t getLastWrite() { return 0; }
+    const char* path() const { return ""; }
+    const char* name() const { return ""; }
+    boolean isDirectory(void) { return false; }
+    fs::FileImplPtr openNextFile(const char*) { return fs::FileImplPtr(); }
+    boolean seekDir(long) { return false; }
+    String getNextFileName(void) { return ""; }
+    String getNextFileName(bool* isDir) {
+        if (isDir != nullptr) *isDir = false;
+        return "";
+    }
+    void rewindDirectory(void) {}
+    operator bool() { return true; }
+
+protected:
+    size_t offset = 0;
+};
+
+// In needs readBytes(char*, size_t), as Stream has
+template <typename In>
+class StreamFileImpl : public PayloadFileImpl {
+public:
+    StreamFileImpl(In& stream, const uint8_t* prefix, size_t prefixBytes, size_t totalBytes)
+        : stream(stream), prefix(prefix), prefixBytes(prefixBytes), total(totalBytes) {}
+
+    size_t read(uint8_t* buf, size_t size) {
+        size_t n = 0;
+        while (n < size && offset < prefixBytes) buf[n++] = prefix[offset++];
+        if (n < size && offset < total) {
+            size_t want = size - n < total - offset ? size - n : total - offset;
+            size_t got = stream.readBytes((char*)buf + n, want);
+            offset += got;
+            n += got;
+        }
+        return n;
+    }
+
+    bool seek(uint32_t pos, fs::SeekMode mode) {
+        size_t target = mode == fs::SeekSet ? pos : mode == fs::SeekCur ? offset + pos : total + pos;
+        if (target == offset) return true;
+        if (target > prefixBytes || offset > prefixBytes) return false;
+        offset = target;
+        return true;
+    }
+
+    size_t size() const { return total; }
+    size_t write(const uint8_t*, size_t) { return 0; }
+
+private:
+    In& stream;
+    const uint8_t* prefix;
+    size_t prefixBytes;
+    size_t total;
+};
+
+// Out needs write(const uint8_t*, size_t)
+template <typename Out>
+class SinkFileImpl : public PayloadFileImpl {
+public:
+    explicit SinkFileImpl(Out& out) : out(out) {}
+
+    size_t write(const uint8_t* buf, size_t size) {
+        size_t written = out.write(buf, size);
+        offset += written;
+        return written;
+    }
+
+    bool seek(uint32_t pos, fs::SeekMode mode) { return (mode == fs::SeekCur ? offset + pos : pos) == offset; }
+    size_t size() const { return offset; }
+    size_t read(uint8_t*, size_t) { return 0; }
+
+private:
+    Out& out;
+};
+
+struct SizeCounter {
+    size_t bytes = 0;
+
+    size_t write(const uint8_t*, size_t length) {
+        bytes += length;
+        return length;
+    }
+};
+
+// File reading prefix and then the rest of a totalBytes payload from stream, prefix has to outlive it
+template <typename In>
+fs::File streamFile(In& stream, const uint8_t* prefix, size_t prefixBytes, size_t totalBytes) {
+    return fs::File(std::make_shared<StreamFileImpl<In>>(stream, prefix, prefixBytes, totalBytes));
+}
+
+// File writing to out
+template <typename Out>
+fs::File sinkFile(Out& out) {
+    return fs::File(std::make_shared<SinkFileImpl<Out>>(out));
+}
+
+#endif /* ARDUINO */
+
+#endif /* STREAMFILE_H_ */
@@ -0,0 +1,195 @@
+#ifndef TRAININGCHECKPOINT_H_
+#define TRAININGCHECKPOINT_H_
+
+/**
+ * Snapshot of a network's weights and biases taken while it trains.
+ *
+ * save() copies every parameter out and restore() writes the last snapshot
+ * back, so a round whose error turns NaN/Inf can continue from the last good
+ * state instead of returning a corrupted model. The snapshot uses the
+ * FlatModel order (all weights, then all biases). When the parameters are
+ * already in one block the copy is a single memcpy, otherwise it goes row by
+ * row through the TrainLayer views.
+ *
+ * The snapshot is kept in RAM when allocate() succeeds. Otherwise useFile()
+ * puts it in a file (LittleFS on the device, a FILE* on the host).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTrainer.h"
+
+#if defined(ARDUINO)
+#include <FS.h>
+#else
+#include <stdio.h>
+#endif
+
+class TrainingCheckpoint {
+public:
+#if defined(ARDUINO)
+    typedef File FileType;
+#else
+    typedef FILE* FileType;
+#endif
+
+    // contiguous, when given, holds all parameters in FlatModel order
+    TrainingCheckpoint(const TrainLayer* layers, unsigned int numberOfLayers, IDFLOAT* contiguous = nullptr)
+        : numberOfLayers(numberOfLayers), contiguous(contiguous) {
+        this->layers = new TrainLayer[numberOfLayers];
+        memcpy(this->layers, layers, numberOfLayers * sizeof(TrainLayer));
+        for (unsigned int l = 0; l < numberOfLayers; l++) parameterCount += (size_t)layers[l].outputs * (layers[l].inputs + 1);
+    }
+
+    ~TrainingCheckpoint() {
+        free(buffer);
+        delete[] layers;
+    }
+
+    // RAM copy of the parameters, false when it does not fit
+    bool allocate() {
+        if (buffer == nullptr) buffer = (IDFLOAT*)malloc(getBytes());
+        return buffer != nullptr;
+    }
+
+    // Snapshots go to f instead of RAM, the caller opens it for reading and writing and closes it
+    void useFile(FileType f) { file = f; }
+
+    bool isReady() const {
+#if defined(ARDUINO)
+        return buffer != nullptr || (bool)file;
+#else
+        return buffer != nullptr || file != nullptr;
+#endif
+    }
+
+    bool inFile() const { return buffer == nullptr && isReady(); }
+
+    bool save() {
+        if (!isReady()) return false;
+        snapshot = false;
+        if (buffer != nullptr) {
+            copyOut(buffer);
+        } else {
+            seekStart();
+            if (!transfer(true)) return false;
+        }
+        snapshot = true;
+        saves++;
+        return true;
+    }
+
+    bool restore() {
+        if (!snapshot) return false;
+        if (buffer != nullptr) {
+            copyIn(buffer);
+        } else {
+            seekStart();
+            if (!transfer(false)) return false;
+        }
+        restores++;
+        return true;
+    }
+
+    bool hasSnapshot() const { return snapshot; }
+    unsigned long getSaves() const { return saves; }
+    unsigned long getRestores() const { return restores; }
+    size_t getBytes() const { return parameterCount * sizeof(IDFLOAT); }
+
+    TrainingCheckpoint(const TrainingCheckpoint&) = delete;
+    TrainingCheckpoint& operator=(const TrainingCheckpoint&) = delete;
+
+private:
+    void copyOut(IDFLOAT* out) const {
+        if (contiguous != nullptr) {
+            memcpy(out, contiguous, getBytes());
+            return;
+        }
+        IDFLOAT* b = out + weightCount();
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                memcpy(out, layer.weights[i], layer.inputs * sizeof(IDFLOAT));
+                out += layer.inputs;
+            }
+            memcpy(b, layer.bias, layer.outputs * sizeof(IDFLOAT));
+            b += layer.outputs;
+        }
+    }
+
+    void copyIn(const IDFLOAT* in) {
+        if (contiguous != nullptr) {
+            memcpy(contiguous, in, getBytes());
+            return;
+        }
+        const IDFLOAT* b = in + weightCount();
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            const TrainLayer& layer = layers[l];
+            for (unsigned int i = 0; i < layer.outputs; i++) {
+                memcpy(layer.weights[i], in, layer.inputs * sizeof(IDFLOAT));
+                in += layer.inputs;
+            }
+            memcpy(layer.bias, b, layer.outputs * sizeof(IDFLOAT));
+            b += layer.outputs;
+        }
+    }
+
+    size_t weightCount() const {
+        size_t n = 0;
+        for (unsigned int l = 0; l < numberOfLayers; l++) n += (size_t)layers[l].outputs * layers[l].inputs;
+        return n;
+    }
+
+    // Streams the parameters to (write) or from the file, weights row by row and then the biases
+    bool transfer(bool write) {
+        if (contiguous != nullptr) return fileBytes(contiguous, getBytes(), write);
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            for (unsigned int i = 0; i < layers[l].outputs; i++) {
+                if (!fileBytes(layers[l].weights[i], layers[l].inputs * sizeof(IDFLOAT), write)) return false;
+            }
+        }
+        for (unsigned int l = 0; l < numberOfLayers; l++) {
+            if (!fileBytes(layers[l].bias, layers[l].outputs * sizeof(IDFLOAT), write)) return false;
+        }
+#if defined(ARDUINO)
+        if (write) file.flush();
+#else
+        if (write) fflush(file);
+#endif
+        return true;
+    }
+
+    bool fileBytes(IDFLOAT* values, size_t bytes, bool write) {
+#if defined(ARDUINO)
+        return (write ? file.write((const uint8_t*)values, bytes) : file.read((uint8_t*)values, bytes)) == bytes;
+#else
+        return (write ? fwrite(values, 1, bytes, file) : fread(values, 1, bytes, file)) == bytes;
+#endif
+    }
+
+    void seekStart() {
+#if defined(ARDUINO)
+        file.seek(0);
+#else
+        fseek(file, 0, SEEK_SET);
+#endif
+    }
+
+    TrainLayer* layers;
+    unsigned int numberOfLayers;
+    IDFLOAT* contiguous;
+    size_t parameterCount = 0;
+    IDFLOAT* buffer = nullptr;
+#if defined(ARDUINO)
+    FileType file;
+#else
+    FileType file = nullptr;
+#endif
+    bool snapshot = false;
+    unsigned long saves = 0;
+    unsigned long restores = 0;
+};
+
+#endif /* TRAININGCHECKPOINT_H_ */
@@ -0,0 +1,129 @@
+#ifndef WORKER_H_
+#define WORKER_H_
+
+/**
+ * Minimal portable concurrency helpers.
+ *
+ * On the ESP32 they map to FreeRTOS binary semaphores and pinned tasks, on the
+ * host build they map to std::mutex/std::condition_variable and std::thread so
+ * the same pipelines can be exercised and benchmarked on Linux.
+ */
+
+#include <stdint.h>
+
+#if defined(ARDUINO)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// Back-off used by spinning waits, long enough on the ESP32 to let the idle task feed the watchdog
+inline void workerPause() {
+#if defined(ARDUINO)
+    vTaskDelay(1);
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Binary semaphore: give() wakes exactly one take()
+class Signal {
+public:
+#if defined(ARDUINO)
+    Signal() { handle = xSemaphoreCreateBinary(); }
+    ~Signal() { vSemaphoreDelete(handle); }
+    void give() { xSemaphoreGive(handle); }
+    void take() { xSemaphoreTake(handle, portMAX_DELAY); }
+#else
+    Signal() {}
+    void give() {
+        std::lock_guard<std::mutex> lock(mutex);
+        raised = true;
+        cv.notify_one();
+    }
+    void take() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return raised; });
+        raised = false;
+    }
+#endif
+
+    Signal(const Signal&) = delete;
+    Signal& operator=(const Signal&) = delete;
+
+private:
+#if defined(ARDUINO)
+    SemaphoreHandle_t handle;
+#else
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool raised = false;
+#endif
+};
+
+// Runs fn(arg) once on its own task/thread, join() blocks until it returned
+class Worker {
+public:
+    typedef void (*WorkerFunction)(void*);
+
+    Worker() {}
+    ~Worker() { join(); }
+
+    // core is only honoured on the ESP32 (0 = protocol core, 1 = app core)
+    bool start(WorkerFunction fn, void* arg, const char* name, uint32_t stackSize = 4096, int core = 0, unsigned int priority = 1) {
+        if (running) return false;
+        function = fn;
+        argument = arg;
+        running = true;
+#if defined(ARDUINO)
+        if (xTaskCreatePinnedToCore(trampoline, name, stackSize, this, priority, NULL, core) != pdPASS) {
+            running = false;
+            return false;
+        }
+#else
+        (void)name; (void)stackSize; (void)core; (void)priority;
+        thread = std::thread(trampoline, this);
+#endif
+        return true;
+    }
+
+    void join() {
+        if (!running) return;
+#if defined(ARDUINO)
+        done.take();
+#else
+        thread.join();
+#endif
+        running = false;
+    }
+
+    bool isRunning() const { return running; }
+
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+
+private:
+    static void trampoline(void* self) {
+        Worker* w = (Worker*)self;
+        w->function(w->argument);
+#if defined(ARDUINO)
+        w->done.give();
+        vTaskDelete(NULL);
+#endif
+    }
+
+    WorkerFunction function = nullptr;
+    void* argument = nullptr;
+    bool running = false;
+#if defined(ARDUINO)
+    Signal done;
+#else
+    std::thread thread;
+#endif
+};
+
+#endif /* WORKER_H_ */
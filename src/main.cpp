@@ -2,6 +2,8 @@
 
 // #define _1_OPTIMIZE 0B00000001
 #define _2_OPTIMIZE 0B00100000
+// #define USE_FIXED_POINT // train in Q15 fixed point (FixedPoint.h), the saved and federated model stays float
+// #define USE_ACTIVATION_TABLE // interpolated tables for sigmoid, tanh, ELU, SELU and softmax in the batch trainer and int8 model (ActivationTable.h)
 
 #define DEBUG 1 // SET TO 0 OUT TO REMOVE TRACES
 
@@ -52,6 +54,7 @@ void parseSerial() {
       currentModel->print();
       break;
     case 2:
+      releaseQuantizedModel();
       if (currentModelMetrics != NULL) {
         delete currentModelMetrics;
       }
@@ -65,6 +68,7 @@ void parseSerial() {
       saveModelToFlash(*currentModel, MODEL_PATH);
       break;
     case 4:
+      releaseQuantizedModel();
       currentModel = loadModelFromFlash(MODEL_PATH);
       break;
     case 5: